@@ -0,0 +1,90 @@
+#ifndef CAFFE_BATCHING_SERVER_HPP_
+#define CAFFE_BATCHING_SERVER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/inference_engine.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Serves single-sample requests from many threads by running them
+ *        through a TEST net in batches (dynamic batching).
+ *
+ * A request holds one sample per net input: blobs shaped like the net's
+ * input blobs but with 1 as the first (batch) dimension. Queued requests
+ * are batched in arrival order until the batch is full or the oldest one
+ * waited max_latency_us; consecutive requests of equal shapes only go into
+ * one batch. Batches run on an InferenceEngine with one instance per worker
+ * thread, and every request gets its rows of the net's output blobs.
+ */
+class BatchingServer {
+ public:
+  /**
+   * @param net            net with trained weights, TEST phase
+   * @param max_batch      maximum number of requests per batch
+   * @param max_latency_us maximum time a request waits for a batch to fill
+   * @param workers        number of batches run concurrently
+   */
+  BatchingServer(const shared_ptr<Net>& net, int max_batch, int max_latency_us,
+      int workers = 1);
+  /// Answers the requests still queued, then stops the workers.
+  ~BatchingServer();
+
+  /**
+   * @brief Queues a request, thread safe. Blobs must stay alive until the
+   *        returned future is ready; @p outputs are reshaped to (1, ...).
+   */
+  std::future<void> Submit(const vector<Blob*>& inputs, const vector<Blob*>& outputs);
+  /// @brief Submit and wait for the answer.
+  void Infer(const vector<Blob*>& inputs, const vector<Blob*>& outputs) {
+    Submit(inputs, outputs).get();
+  }
+
+  /// Number of batches run so far
+  size_t batches() const {
+    return batches_;
+  }
+  /// Number of requests answered so far
+  size_t requests() const {
+    return requests_;
+  }
+
+ private:
+  struct Request {
+    vector<Blob*> inputs, outputs;
+    std::promise<void> done;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  bool NextBatch(vector<std::unique_ptr<Request>>* batch);
+  void WorkerLoop();
+
+  InferenceEngine engine_;
+  const int max_batch_;
+  const std::chrono::microseconds max_latency_;
+  const int num_inputs_;
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Request>> queue_;
+  bool stop_;
+  vector<std::thread> workers_;
+  std::atomic<size_t> batches_, requests_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(BatchingServer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCHING_SERVER_HPP_
@@ -98,6 +98,16 @@ class Blob {
     return diff_tensor_ == other.diff_tensor_;
   }
 
+  /// Changes on every write access to the data (mutable pointers, set_cpu_data,
+  /// FromProto...). Writes through a pointer taken before are not noticed.
+  uint64_t data_version() const {
+    return data_tensor_->version_;
+  }
+
+  bool data_equals(const Blob& other) const {
+    return data_tensor_ == other.data_tensor_;
+  }
+
   void allocate_data(bool on_gpu = true) {
     data_tensor_->current_memory(on_gpu);
   }
@@ -312,7 +322,7 @@ class Blob {
     CHECK_NOTNULL(data);
     convert_data(tp<Dtype>());
     CHECK(is_type<Dtype>(data_type()));
-    data_tensor_->mutable_synced_mem()->set_cpu_data(data);
+    data_tensor_->set_cpu_data(data);
   }
 
   template<typename Dtype>
@@ -320,7 +330,7 @@ class Blob {
     CHECK_NOTNULL(diff);
     convert_diff(tp<Dtype>());
     CHECK(is_type<Dtype>(diff_type()));
-    diff_tensor_->mutable_synced_mem()->set_cpu_data(diff);
+    diff_tensor_->set_cpu_data(diff);
   }
 
   template<typename Dtype>
@@ -469,6 +479,16 @@ class Blob {
     return diff_tensor_->current_memory(is_gpu);
   }
 
+  void set_cpu_data(void* data) {
+    CHECK_NOTNULL(data);
+    data_tensor_->set_cpu_data(data);
+  }
+
+  void set_cpu_diff(void* diff) {
+    CHECK_NOTNULL(diff);
+    diff_tensor_->set_cpu_data(diff);
+  }
+
 #ifndef CPU_ONLY
   size_t gpu_memory_data_use(bool own_only = false) const;
   size_t gpu_memory_diff_use(bool own_only = false) const;
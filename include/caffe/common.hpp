@@ -293,6 +293,8 @@ struct CuDNNHandle {
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class CounterRNG;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -327,6 +329,9 @@ class Caffe {
     }
     return *(Get().random_generator_);
   }
+  // Counter-based stream behind caffe_rng_uniform/gaussian/bernoulli.
+  // Reset by set_random_seed, seeded from rng_stream() otherwise.
+  static CounterRNG& counter_rng();
 #ifndef CPU_ONLY
   static shared_ptr<CudaStream> thread_pstream(int group = 0) {
     return Get().device_pstream(group);
@@ -475,6 +480,7 @@ class Caffe {
 #endif
 #endif
   shared_ptr<RNG> random_generator_;
+  shared_ptr<CounterRNG> counter_rng_;
 
   Brew mode_;
   int solver_count_;
@@ -0,0 +1,60 @@
+#ifndef CAFFE_INFERENCE_ENGINE_HPP_
+#define CAFFE_INFERENCE_ENGINE_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs Forward of one trained TEST net from many threads at once.
+ *
+ * Every instance is a Net of its own (layers, activations, workspace) whose
+ * weights are shared with the net given to the constructor, so the memory
+ * cost of an instance is its activations only. Infer() picks a free
+ * instance, waiting for one if all of them are busy.
+ */
+class InferenceEngine {
+ public:
+  /**
+   * @param net       net with trained weights, TEST phase
+   * @param instances number of instances including @p net itself,
+   *                  0 for one per hardware thread
+   */
+  InferenceEngine(const shared_ptr<Net>& net, int instances);
+
+  /**
+   * @brief Thread safe: copies @p inputs into the input blobs of a free
+   *        instance, runs Forward and copies its output blobs to @p outputs.
+   *
+   * Inputs are matched to Net::input_blobs() and outputs to
+   * Net::output_blobs() by position. Both may change shape from call to call,
+   * instances are reshaped as needed.
+   */
+  void Infer(const vector<Blob*>& inputs, const vector<Blob*>& outputs);
+
+  int instances() const {
+    return instances_.size();
+  }
+  const Net& net() const {
+    return *instances_[0];
+  }
+
+ private:
+  vector<shared_ptr<Net>> instances_;
+  BlockingQueue<Net*> free_;
+  Caffe::Brew mode_;
+#ifndef CPU_ONLY
+  int device_;
+#endif
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(InferenceEngine);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_ENGINE_HPP_
@@ -56,6 +56,7 @@ class LayerBase {
         parent_net_(nullptr),
         net_inititialized_flag_(nullptr),
         net_iteration0_flag_(nullptr),
+        need_backward_(true),
         is_shared_(false) {
     InitMutex();
   }
@@ -94,6 +95,20 @@ class LayerBase {
    */
   virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top) = 0;
 
+  /**
+   * @brief Adjusts the top blobs and internal buffers to bottom blobs which
+   *        changed in their first (batch) dimension only since Reshape.
+   *
+   * Returns false if the layer has no such shortcut, or finds that the
+   * bottoms changed otherwise, and the caller falls back to Reshape.
+   * Net::ReshapeBatch and Forward try it first, so that a batch change or
+   * an unchanged shape costs only the shortcut. Layers whose Reshape does
+   * nothing but follow the bottom shape (the neurons) do not need one.
+   */
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom, const vector<Blob*>& top) {
+    return false;
+  }
+
   /**
    * @brief Whether a layer should be shared by multiple nets during data
    *        parallelism. By default, all layers except for data layers should
@@ -378,6 +393,57 @@ class LayerBase {
     return false;
   }
 
+  /**
+   * @brief Whether Forward writes to blob @p blob_id (e.g. running
+   *        statistics), so that a recomputed Forward has to put it back.
+   */
+  virtual bool forward_updates_blob(int blob_id) const {
+    return false;
+  }
+
+  /**
+   * @brief Estimated floating point operations of Forward with the current
+   *        shapes, 0 if the layer has no estimate.
+   */
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 0.;
+  }
+
+  /**
+   * @brief Estimated floating point operations of Backward with the current
+   *        shapes, 0 if the layer has no estimate.
+   */
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 0.;
+  }
+
+  /**
+   * @brief Estimated bytes Forward moves: bottom data and parameters read,
+   *        top data written.
+   */
+  virtual double ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const;
+
+  /**
+   * @brief Estimated bytes Backward moves: top data and diffs, bottom data and
+   *        parameters read, bottom and parameter diffs written.
+   */
+  virtual double BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const;
+
+  /**
+   * @brief Sets whether Backward may be called for this layer.
+   *
+   * Net::Init clears it for layers it never back-propagates through (e.g. in
+   * TEST phase), so Forward can skip bookkeeping that only Backward consumes.
+   * Standalone layers default to true.
+   */
+  void set_need_backward(bool value) {
+    need_backward_ = value;
+  }
+
+  bool need_backward() const {
+    return need_backward_;
+  }
+
   /**
    * @brief Writes the layer parameter to a protocol buffer
    */
@@ -453,6 +519,9 @@ class LayerBase {
   /** Gets set when Net::Init is over */
   Flag* net_iteration0_flag_;
 
+  /** Whether Backward may be called after Forward */
+  bool need_backward_;
+
  private:
   /** Whether this layer is actually shared by other nets*/
   bool is_shared_;
@@ -556,7 +625,9 @@ inline float Layer<Ftype, Btype>::Forward(const vector<Blob*>& bottom, const vec
   // Lock during forward to ensure sequential forward
   Lock();
   float loss = 0;
-  Reshape(bottom, top);
+  if (!ReshapeBatch(bottom, top)) {
+    Reshape(bottom, top);
+  }
   switch (Caffe::mode()) {
     case Caffe::CPU:
       Forward_cpu(bottom, top);
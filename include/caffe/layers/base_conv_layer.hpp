@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -23,11 +24,29 @@ class BaseConvolutionLayer : public Layer<Ftype, Btype> {
       const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top);
 
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  // One gemm of the weights with the column buffer per image and bottom,
+  // Backward runs it twice: for the weight and for the bottom gradients.
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    double flops = 2. * bottom.size() * num_ * conv_out_channels_ * conv_out_spatial_dim_
+        * kernel_dim_;
+    if (bias_term_) {
+      for (const Blob* blob : top) {
+        flops += blob->count();
+      }
+    }
+    return flops;
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 2. * ForwardFlops(bottom, top);
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
@@ -50,6 +69,13 @@ class BaseConvolutionLayer : public Layer<Ftype, Btype> {
     }
   }
 
+  /// @brief Whether Forward_cpu runs in int8, see QuantizationParameter.
+  bool int8_forward() const {
+    return this->phase_ == TEST && this->layer_param_.quantization_param().input_scale() > 0.F;
+  }
+  /// @brief forward_cpu_gemm with int8 inputs and weights, int32 accumulation.
+  void forward_cpu_gemm_s8(const Ftype* input, const Ftype* weights, Ftype* output);
+
   template <typename Dtype>
   void forward_cpu_bias(Dtype* output, const Dtype* bias) {
     caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, num_output_,
@@ -193,6 +219,8 @@ class BaseConvolutionLayer : public Layer<Ftype, Btype> {
   /// @brief The spatial dimensions of the output.
   vector<int> output_shape_;
   const vector<int>* bottom_shape_;
+  /// @brief The bottom shape from the channel axis on, as of the last Reshape.
+  vector<int> bottom_image_shape_;
 
   int num_spatial_axes_;
   int bottom_dim_;
@@ -276,6 +304,11 @@ class BaseConvolutionLayer : public Layer<Ftype, Btype> {
   }
 #endif
 
+  // int8 Forward: quantized weights, input, column buffer and its transpose
+  QuantizedWeights weights_s8_;
+  vector<int8_t> input_s8_, col_s8_;
+  vector<int32_t> output_s32_;
+
   int num_kernels_im2col_;
   int num_kernels_col2im_;
   int conv_out_channels_;
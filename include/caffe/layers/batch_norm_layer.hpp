@@ -53,6 +53,20 @@ class BatchNormLayer : public Layer<Ftype, Btype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Batch statistics move the global mean and variance
+  virtual bool forward_updates_blob(int blob_id) const {
+    return !use_global_stats_ && blob_id < 2;
+  }
+
+  // Batch statistics cost mean and variance passes on top of normalization
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return (use_global_stats_ ? 2. : 6.) * bottom[0]->count()
+        + (scale_bias_ ? 2. * bottom[0]->count() : 0.);
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return (use_global_stats_ ? 1. : 7.) * bottom[0]->count()
+        + (scale_bias_ ? 3. * bottom[0]->count() : 0.);
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
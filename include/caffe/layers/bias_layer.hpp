@@ -33,6 +33,13 @@ class BiasLayer : public Layer<Ftype, Btype> {
   virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return top[0]->count();
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return top[0]->count();
+  }
+
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
   virtual void Forward_gpu(const vector<Blob*>& bottom,
@@ -111,6 +111,10 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Ftype, Btype> {
 
   virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
+  // The cuDNN descriptors and workspaces depend on the batch size
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom, const vector<Blob*>& top) {
+    return false;
+  }
   virtual ~CuDNNConvolutionLayer();
 
  protected:
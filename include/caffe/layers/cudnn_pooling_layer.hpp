@@ -25,6 +25,9 @@ class CuDNNPoolingLayer : public PoolingLayer<Ftype, Btype> {
       const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
+  // The cuDNN descriptors hold the batch size
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top) { return false; }
   virtual ~CuDNNPoolingLayer();
   // Currently, cuDNN does not support the extra top blob.
   virtual inline int MinTopBlobs() const { return -1; }
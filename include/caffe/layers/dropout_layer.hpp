@@ -68,6 +68,8 @@ class DropoutLayer : public NeuronLayer<Ftype, Btype> {
 
   /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
   TBlob<unsigned int> rand_vec_;
+  /// CPU keep mask packed one bit per input: bit i % 32 of word i / 32
+  TBlob<unsigned int> mask_bits_;
   /// the probability @f$ p @f$ of dropping any input
   float threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
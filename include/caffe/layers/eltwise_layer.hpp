@@ -24,11 +24,20 @@ class EltwiseLayer : public Layer<Ftype, Btype> {
       const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top);
 
   virtual inline const char* type() const { return "Eltwise"; }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return static_cast<double>(top[0]->count()) * bottom.size();
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return static_cast<double>(top[0]->count()) * bottom.size();
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
@@ -31,6 +31,14 @@ class FlattenLayer : public Layer<Ftype, Btype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  // Top shares the bottom's data and diff, nothing moves
+  virtual double ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 0.;
+  }
+  virtual double BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 0.;
+  }
+
  protected:
   /**
    * @param bottom input Blob vector (length 2+)
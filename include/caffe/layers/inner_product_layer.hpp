@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -24,11 +25,20 @@ class InnerProductLayer : public Layer<Ftype, Btype> {
       const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top);
 
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return (2. * K_ + (bias_term_ ? 1. : 0.)) * M_ * N_;
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return (4. * K_ + (bias_term_ ? 1. : 0.)) * M_ * N_;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
@@ -45,6 +55,10 @@ class InnerProductLayer : public Layer<Ftype, Btype> {
   bool bias_term_;
   shared_ptr<Blob> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  // int8 Forward, see QuantizationParameter
+  QuantizedWeights weights_s8_;
+  vector<int8_t> input_s8_;
+  vector<int32_t> output_s32_;
 };
 
 }  // namespace caffe
@@ -32,6 +32,14 @@ class InputLayer : public Layer<Ftype, Btype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
+  // Inputs are filled from outside the net
+  virtual double ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 0.;
+  }
+  virtual double BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 0.;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {}
@@ -33,6 +33,16 @@ class LRNLayer : public Layer<Ftype, Btype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  // Squares summed over the window, then scale, power and product per element
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    const bool across = this->layer_param_.lrn_param().norm_region()
+        == LRNParameter_NormRegion_ACROSS_CHANNELS;
+    return static_cast<double>(top[0]->count()) * (2. * (across ? size_ : size_ * size_) + 3.);
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 2. * ForwardFlops(bottom, top);
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
@@ -25,6 +25,14 @@ class NeuronLayer : public Layer<Ftype, Btype> {
 
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+
+  // One operation per element, costlier activations are not told apart
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return bottom[0]->count();
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return bottom[0]->count();
+  }
 };
 
 }  // namespace caffe
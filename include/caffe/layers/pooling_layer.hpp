@@ -23,6 +23,8 @@ class PoolingLayer : public Layer<Ftype, Btype> {
       const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
+  virtual bool ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top);
 
   virtual inline const char* type() const { return "Pooling"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
@@ -34,6 +36,14 @@ class PoolingLayer : public Layer<Ftype, Btype> {
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
 
+  // Each output visits its window, max pooling routes its gradient to one input
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return static_cast<double>(top[0]->count()) * kernel_h_ * kernel_w_;
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return is_max_pooling_ ? top[0]->count() : ForwardFlops(bottom, top);
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
@@ -44,6 +54,13 @@ class PoolingLayer : public Layer<Ftype, Btype> {
   virtual void Backward_gpu(const vector<Blob*>& top,
       const vector<bool>& propagate_down, const vector<Blob*>& bottom);
 
+  // Single (num, channel) plane kernels used by Forward_cpu.
+  void ForwardMaxPlane_cpu(const Ftype* bottom_data, Ftype* top_data) const;
+  template <typename Mtype>
+  void ForwardMaxMaskPlane_cpu(const Ftype* bottom_data, Ftype* top_data,
+      Mtype* mask) const;
+  void ForwardAvePlane_cpu(const Ftype* bottom_data, Ftype* top_data) const;
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
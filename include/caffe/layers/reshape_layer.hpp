@@ -29,6 +29,14 @@ class ReshapeLayer : public Layer<Ftype, Btype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  // Top shares the bottom's data and diff, nothing moves
+  virtual double ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 0.;
+  }
+  virtual double BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 0.;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {}
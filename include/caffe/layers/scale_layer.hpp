@@ -36,6 +36,14 @@ class ScaleLayer: public Layer<Ftype, Btype> {
   virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return (bias_term_ ? 2. : 1.) * top[0]->count();
+  }
+  // Bottom gradient and the scale gradient's products, plus the bias sum
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return (bias_term_ ? 3. : 2.) * top[0]->count();
+  }
+
  protected:
   /**
    * In the below shape specifications, @f$ i @f$ denotes the value of the
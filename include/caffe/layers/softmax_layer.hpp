@@ -26,6 +26,14 @@ class SoftmaxLayer : public Layer<Ftype, Btype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  // Max, subtract, exp, sum and divide per element; dot, subtract and scale back
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 5. * bottom[0]->count();
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 4. * bottom[0]->count();
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
@@ -39,8 +47,6 @@ class SoftmaxLayer : public Layer<Ftype, Btype> {
   int outer_num_;
   int inner_num_;
   int softmax_axis_;
-  /// sum_multiplier is used to carry out sum using BLAS
-  TBlob<Ftype> sum_multiplier_;
   /// scale is an intermediate TBlob to hold temporary results.
   TBlob<Ftype> scale_;
 };
@@ -65,6 +65,14 @@ class SoftmaxWithLossLayer : public LossLayer<Ftype, Btype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
 
+  // Softmax plus a log per prediction; gradient is the probability minus the label
+  virtual double ForwardFlops(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+    return 5. * bottom[0]->count() + static_cast<double>(outer_num_) * inner_num_;
+  }
+  virtual double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+    return 2. * bottom[0]->count();
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top);
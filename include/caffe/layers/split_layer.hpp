@@ -26,6 +26,18 @@ class SplitLayer : public Layer<Ftype, Btype> {
   int ExactNumBottomBlobs() const override { return 1; }
   int MinTopBlobs() const override { return 1; }
 
+  // Tops share the bottom's data, their diffs are summed into the bottom's
+  double ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const override {
+    return 0.;
+  }
+  double BackwardFlops(const vector<Blob*>& top, const vector<Blob*>& bottom) const override {
+    return static_cast<double>(bottom[0]->count()) * (top.size() - 1);
+  }
+  double BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const override {
+    return static_cast<double>(bottom[0]->count()) * (top.size() + 1)
+        * tsize(bottom[0]->diff_type());
+  }
+
  protected:
   void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top) override;
   void Forward_gpu(const vector<Blob*>& bottom, const vector<Blob*>& top) override;
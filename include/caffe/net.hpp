@@ -14,7 +14,12 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/counter_rng.hpp"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/task_graph.hpp"
 #include "caffe/util/thread_pool.hpp"
+#include "caffe/util/weight_file.hpp"
 
 namespace caffe {
 
@@ -39,6 +44,13 @@ class Net {
       Flag* solver_init_flag = nullptr,
       Flag* solver_iter0_flag = nullptr,
       const Net* root_net = nullptr);
+  /**
+   * @brief Builds another instance of @p weights_net from its parameter.
+   *
+   * Its layers start out with blobs sharing the data of the trained blobs
+   * of @p weights_net, so that no filler runs and no weights are allocated.
+   */
+  explicit Net(const Net* weights_net);
   ~Net();
 
   /// @brief Initialize a network with a NetParameter.
@@ -90,8 +102,51 @@ class Net {
    * a forward pass, e.g. to compute output feature size.
    */
   void Reshape();
+  /**
+   * @brief Sets the first (batch) dimension of every input blob to @p num and
+   *        reshapes the net, unless its batch size is @p num already.
+   *
+   * Layers with a batch-only shortcut (LayerBase::ReshapeBatch) take it,
+   * the others get the full Reshape. Blobs keep their memory while they
+   * shrink and grow back, so a net set up for its largest batch allocates
+   * nothing for smaller ones, and shared activation memory keeps its plan.
+   */
+  void ReshapeBatch(int num);
   void ReduceAndUpdate();
 
+  /// @brief Bytes of the host arena backing shared activations (0 if none).
+  size_t activation_arena_size() const {
+    return activation_arena_ ? activation_arena_->size() : 0UL;
+  }
+  /// @brief Bytes of the host arena backing shared diffs (0 if none).
+  size_t diff_arena_size() const {
+    return diff_arena_ ? diff_arena_->size() : 0UL;
+  }
+  /// @brief Bytes of the host arena backing recomputed activations (0 if none).
+  size_t recompute_arena_size() const {
+    return recompute_arena_ ? recompute_arena_->size() : 0UL;
+  }
+
+  /// @brief Static FLOP and byte estimates (see LayerBase::ForwardFlops).
+  struct Cost {
+    double forward_flops = 0., backward_flops = 0.;
+    double forward_bytes = 0., backward_bytes = 0.;
+  };
+  /**
+   * @brief Estimated cost of layer @p layer_id with the current shapes.
+   *        Backward is counted only for layers the net back-propagates through.
+   */
+  Cost layer_cost(int layer_id) const;
+  /// @brief Sum of layer_cost over all layers.
+  Cost total_cost() const;
+  /// @brief Bytes of learnable parameter data, diffs not included.
+  size_t param_bytes() const;
+  /**
+   * @brief Bytes of net blob data, plus diffs of those Backward writes,
+   *        as if no memory were shared.
+   */
+  size_t activation_bytes() const;
+
   float ForwardBackward(bool apply_update = true);
 
   /// @brief Updates the network weights based on the diff values computed.
@@ -117,12 +172,33 @@ class Net {
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
-  void CopyTrainedLayersFromBinaryProto(const string trained_filename);
+  /**
+   * @brief With @p defer, the blobs of unshared layers of a binary proto are
+   *        read before the layer's first Forward. Meant for inference.
+   */
+  void CopyTrainedLayersFrom(const string trained_filename, bool defer);
+  /**
+   * @brief Reads the layers of a binary proto in batches, parsing the layers
+   *        of a batch and copying their blobs in parallel.
+   */
+  void CopyTrainedLayersFromBinaryProto(const string trained_filename, bool defer = false);
+  /// @brief Reads the blobs of all layers deferred by CopyTrainedLayersFrom.
+  void LoadDeferredLayers();
+  /// @brief Whether blobs deferred by CopyTrainedLayersFrom are still unread.
+  bool has_deferred_layers() const;
   void CopyTrainedLayersFromHDF5(const string trained_filename);
-  /// @brief Writes the net to a proto.
+  /**
+   * @brief Copies the pre-trained layers from a weight file. Parameters whose
+   *        type matches the file use its memory mapped tensors in place.
+   */
+  void CopyTrainedLayersFromWeightFile(const string trained_filename);
+  /// @brief Writes the net to a proto. Deferred layers have to be loaded first,
+  ///        as for ToHDF5 and ToWeightFile.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /// @brief Writes the net parameters to a weight file.
+  void ToWeightFile(const string& filename) const;
 
   /// @brief returns the network name.
   const string& name() const { return name_; }
@@ -140,6 +216,8 @@ class Net {
   }
   /// @brief returns the phase: TRAIN or TEST
   Phase phase() const { return phase_; }
+  /// @brief returns the parameters the net was built from, after filtering
+  const NetParameter& net_param() const { return net_param_; }
   /**
    * @brief returns the bottom vecs for each layer -- usually you won't
    *        need this unless you do per-layer checks such as gradients.
@@ -253,9 +331,7 @@ class Net {
     return trained_layers_shared_;
   }
 
-#ifndef CPU_ONLY
   void InitializeLearnableDiffSpace();
-#endif
 
   void wait_layers_init() {
     for (Flag* flag : layer_inititialized_flags_) {
@@ -297,18 +373,71 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  enum ArenaKind { ACTIVATION_ARENA, DIFF_ARENA, RECOMPUTE_ARENA };
+  /**
+   * @brief Places buffers whose lifetimes do not overlap at shared offsets of
+   *        one host arena stored to @p arena.
+   *
+   * Blobs aliasing one tensor (in-place and ShareData/ShareDiff layers) form
+   * a single buffer living from its first producer to its last consumer.
+   * Tops of layers without bottoms (inputs, data layers swapping in
+   * prefetched batches) are left alone. Net outputs live to the end of the
+   * pass; their diffs, loss diffs and diffs not written by every consumer
+   * are left alone too. RECOMPUTE_ARENA only places buffers living
+   * inside one recompute segment, alive for the whole segment.
+   */
+  void PlanSharedMemory(ArenaKind kind, shared_ptr<SyncedMemory>* arena);
+  /**
+   * @brief Shares activation memory (see share_activation_memory).
+   *        Runs at the start of a full Forward pass after Init or Reshape,
+   *        once a previous full pass let every layer set up its aliasing.
+   */
+  void PlanActivationMemory();
+  /// @brief Whether every activation still fits where it was placed.
+  bool ActivationPlanFits() const;
+  /// @brief Reshapes every layer, through ReshapeBatch if @p batch_only.
+  void ReshapeLayers(bool batch_only);
+  /**
+   * @brief Shares diff memory (see share_diff_memory).
+   *        Runs at the start of a full Backward pass after Init or Reshape,
+   *        once a previous full pass let every layer set up its aliasing.
+   */
+  void PlanDiffMemory();
+  /**
+   * @brief Shares the inner activations of recompute segments
+   *        (see recompute_segment), after the first full Forward pass.
+   */
+  void PlanRecomputeMemory();
+  /// @brief Reruns Forward of recompute segment @p id for Backward.
+  void RecomputeSegmentForward(int id);
+  /// @brief Builds layer_successors_ from the blobs each layer reads and writes.
+  void BuildLayerGraph();
+  /// @brief Runs Forward of layers [start, end] on inter_op_graph_.
+  float ForwardFromToParallel(int start, int end);
+  /// @brief Forward of layer @p i, recorded by the Profiler when it is on.
+  float ForwardLayer(int i);
+  /// @brief Checks the blobs of @p source_layer and lists them with their targets.
+  void CopyTrainedLayer(const LayerParameter& source_layer,
+      vector<std::pair<const BlobProto*, Blob*>>* copies);
+  /// @brief Parses @p layers of a binary proto in parallel and copies their blobs.
+  void CopyTrainedLayersFromFile(const string& filename, const vector<SerializedLayer>& layers);
+  void LoadDeferredLayer(int layer_id);
+  /// @brief Backward of layer @p i, recorded by the Profiler when it is on.
+  void BackwardLayer(int i);
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
-  /// @brief Multi-GPU reduction for a particular parameter.
-#ifndef CPU_ONLY
+  /// @brief Multi-solver (GPU or CPU) reduction for a particular parameter.
   void Reduce(int param_id);
-  /// @brief Multi-GPU reduction for a particular bucket of parameters.
+  /// @brief Multi-solver (GPU or CPU) reduction for a particular bucket of parameters.
   void ReduceBucket(size_t count, Type bucket_type, void* bucket);
-#endif
+  /// @brief Whether CPU reduction of @p type gradients goes through AllreduceCompressed.
+  bool compress_gradients(Type type) const;
+  /// @brief Sums @p count gradients over the solvers as set by gradient_compression.
+  void AllreduceCompressed(int count, float* bucket);
 
   /// @brief The network name
   string name_;
@@ -339,6 +468,8 @@ class Net {
   vector<vector<int> > param_id_vecs_;
   vector<int> param_owners_;
   vector<string> param_display_names_;
+  /// "layer/param" names of the learnable params, as profiled by updates
+  vector<string> learnable_param_names_;
   vector<pair<int, int> > param_layer_indices_;
   /// (layer, blob) -> param_id map
   map<pair<int, int>, int> layer_index_params_;
@@ -352,13 +483,68 @@ class Net {
   vector<shared_ptr<Blob>> params_;
   vector<shared_ptr<Blob>> learnable_params_;
   bool trained_layers_shared_;
+  /// Host arena holding the activations placed by PlanActivationMemory()
+  shared_ptr<SyncedMemory> activation_arena_;
+  /// Bytes each blob placed in activation_arena_ had when planned, 0 if none
+  vector<size_t> activation_plan_bytes_;
+  bool share_activation_memory_;
+  bool activation_plan_pending_;
+  bool full_forward_done_;
+  /// Host arena holding the diffs placed by PlanDiffMemory()
+  shared_ptr<SyncedMemory> diff_arena_;
+  bool share_diff_memory_;
+  bool diff_plan_pending_;
+  bool full_backward_done_;
+  /// Layer range recomputed in Backward and the state its Forward began with
+  struct RecomputeRange {
+    RecomputeRange(int first, int last)
+        : first(first), last(last), rng(0UL), counter_rng(0UL) {}
+    int first, last;
+    Caffe::RNG rng;
+    CounterRNG counter_rng;
+    /// Blobs produced before the segment and overwritten in place inside it,
+    /// with their values as the segment's Forward began
+    vector<int> inputs;
+    vector<shared_ptr<Blob>> saved_inputs;
+  };
+  vector<RecomputeRange> recompute_ranges_;
+  /// Recompute segment of every layer, -1 if none
+  vector<int> recompute_segment_of_;
+  /// Host arena holding the activations placed by PlanRecomputeMemory()
+  shared_ptr<SyncedMemory> recompute_arena_;
+  bool recompute_plan_pending_;
+  /// Scratch copies of the layer blobs Forward updates, restored after a recompute
+  vector<shared_ptr<Blob>> recompute_stash_;
+  /// Layers to run after each layer: readers after writers of a blob and
+  /// writers after its earlier readers and writers
+  vector<vector<int>> layer_successors_;
+  /// Runs independent layers of Forward concurrently (see inter_op_threads)
+  shared_ptr<TaskGraph> inter_op_graph_;
+  vector<float> layer_losses_;
+  vector<bool> layer_active_;
 
-#ifndef CPU_ONLY
   vector<void*> learnable_params_ptrs_;
+#ifndef CPU_ONLY
   GPUMemory::Workspace learnable_space_;
+#endif
+  /// Mapped weight files holding parameter data
+  vector<shared_ptr<WeightFile>> weight_files_;
+  /// Binary proto and, per layer, the serialized layer to read before its
+  /// first Forward (zero length once read)
+  string deferred_weights_file_;
+  vector<SerializedLayer> deferred_layers_;
+  /// Contiguous host diffs of multi-solver CPU training, reduced in buckets
+  shared_ptr<SyncedMemory> learnable_cpu_space_;
+  /// Top-k error feedback, laid out as learnable_cpu_space_
+  vector<float> compression_residual_;
+  vector<SparseGradient> sparse_send_, sparse_recv_;
+#ifndef CPU_ONLY
+  vector<float16> compression_half_;
+#else
+  vector<uint16_t> half_send_, half_recv_;
+#endif
   size_t learnable_space_count_;
   size_t reduce_buckets_;
-#endif
 
   /**
    * The mapping from params_ -> learnable_params_: we have
@@ -387,6 +573,8 @@ class Net {
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net whose trained blobs the layers share from the start, if any
+  const Net* const weights_net_;
   /// Pointer to the solver being used with this net
   Solver* solver_;
   size_t solver_rank_;
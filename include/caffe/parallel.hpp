@@ -14,6 +14,7 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/transport.hpp"
 
 #ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
@@ -63,6 +64,8 @@ class P2PManager {
     CHECK(rbar);
     rbar->wait();
   }
+  // Sizes the barriers shared by solver threads and data layers
+  static void init_barriers(size_t nranks);
 
  protected:
   const size_t nranks_;
@@ -94,6 +97,7 @@ class P2PSync : public Solver::Callback, public InternalThread {
 
   void allreduce(int param_id) override;
   void allreduce_bucket(int count, void* bucket, Type type) override;
+  void allgather_bucket(const void* send, size_t bytes, void* recv) override;
   void soft_barrier() override;
   void reduce_barrier() override;
   void saveTestResults(float loss, const vector<float>& scores) override;
@@ -131,6 +135,112 @@ class P2PSync : public Solver::Callback, public InternalThread {
   shared_ptr<SharedScores<float>> shared_;
 };
 
+class CPUSync;
+
+class CPUSyncManager {
+ public:
+  CPUSyncManager(shared_ptr<Solver> root_solver, int nranks, const SolverParameter& param);
+  ~CPUSyncManager();
+
+  void Run();
+  void EarlyCancel(CPUSync* killed);
+
+  // Sums the buckets published by all ranks in place.
+  // Blocks until every rank has called it with the same count and type.
+  void Allreduce(int rank, int count, void* bucket, Type type);
+  // Copies @p bytes of @p send of every rank to @p recv, ordered by rank.
+  void Allgather(int rank, const void* send, size_t bytes, void* recv);
+
+ protected:
+  template<typename Dtype>
+  void ReduceScatterAllGather(int rank, int count);
+
+  const size_t nranks_;
+  vector<shared_ptr<CPUSync>> syncs_;
+  shared_ptr<SharedScores<float>> shared_;
+  shared_ptr<Solver> root_solver_;
+
+  // Buckets being reduced or gathered, published by every rank's reduction thread
+  vector<const void*> buckets_;
+  boost::barrier reduce_bar_;
+
+  // Elements reduced at once: the source blocks of all ranks stay in L1/L2
+  static constexpr int CACHE_BLOCK = 2048;
+};
+
+// Synchronous data parallelism between solver replicas running on CPU core groups.
+// Gradients are summed over shared memory: every rank reduces its own slice
+// of the bucket across all replicas (reduce-scatter), then copies the slices
+// reduced by the others (all-gather).
+class CPUSync : public Solver::Callback, public InternalThread {
+  friend class CPUSyncManager;
+ public:
+  CPUSync(CPUSyncManager* mgr, shared_ptr<Solver> root_solver,
+      int rank, int nranks, const SolverParameter& param);
+  virtual ~CPUSync();
+
+  void allreduce(int param_id) override;
+  void allreduce_bucket(int count, void* bucket, Type type) override;
+  void allgather_bucket(const void* send, size_t bytes, void* recv) override;
+  void soft_barrier() override;
+  void reduce_barrier() override;
+  void saveTestResults(float loss, const vector<float>& scores) override;
+  void aggregateTestResults(float* loss, vector<float>* scores) override;
+
+#ifndef CPU_ONLY
+  cublasHandle_t cublas_handle() const override {
+    return nullptr;
+  }
+#endif
+
+ protected:
+  void on_start(const vector<shared_ptr<Blob>>& net) override;
+  void InternalThreadEntry() override;
+
+  CPUSyncManager* mgr_;
+  const int rank_;
+  const size_t nranks_;
+  shared_ptr<Solver> solver_, root_solver_;
+  SolverParameter solver_param_;
+
+  // memory shared between threads
+  shared_ptr<SharedScores<float>> shared_;
+};
+
+// Synchronous data parallelism between processes running one CPU solver each.
+// The solver thread uses one transport for barriers, the initial weights and
+// test results; the reduction thread uses another one for the gradients.
+class DistSync : public Solver::Callback {
+ public:
+  DistSync(shared_ptr<Solver> solver, shared_ptr<Transport> comm,
+      shared_ptr<Transport> reduce_comm);
+
+  // Returns true if the solver stopped early
+  bool Run();
+
+  void allreduce(int param_id) override;
+  void allreduce_bucket(int count, void* bucket, Type type) override;
+  void allgather_bucket(const void* send, size_t bytes, void* recv) override;
+  void soft_barrier() override;
+  void reduce_barrier() override;
+  void saveTestResults(float loss, const vector<float>& scores) override;
+  void aggregateTestResults(float* loss, vector<float>* scores) override;
+
+#ifndef CPU_ONLY
+  cublasHandle_t cublas_handle() const override {
+    return nullptr;
+  }
+#endif
+
+ protected:
+  void on_start(const vector<shared_ptr<Blob>>& net) override;
+
+  shared_ptr<Solver> solver_;
+  shared_ptr<Transport> comm_, reduce_comm_;
+  // loss followed by scores of the last test on this rank
+  vector<float> test_results_;
+};
+
 }  // namespace caffe
 
 #endif
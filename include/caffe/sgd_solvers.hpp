@@ -1,8 +1,13 @@
 #ifndef CAFFE_SGD_SOLVERS_HPP_
 #define CAFFE_SGD_SOLVERS_HPP_
 
+#include <set>
+#include <string>
+#include <type_traits>
+
 #include "caffe/common.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -41,13 +46,29 @@ class SGDSolver : public Solver {
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
+  // Restores a state and the delta snapshots it applies to, @p chain holds
+  // the states visited so far
+  void RestoreSolverStateChain(const string& state_file, std::set<string>* chain);
   void PrintParams(int param_id);
 
+  // float16 solvers update in float, float and double in their own precision
+  typedef typename std::conditional<std::is_same<Dtype, double>::value,
+      double, float>::type Mtype;
+  /**
+   * @brief Single pass CPU update of a parameter, see reg_update_and_clear_cpu.
+   *        update(i, g) gets the normalized and regularized gradient of
+   *        element i, advances its history and returns the step.
+   */
+  template <typename Update>
+  void UpdateCpu(int param_id, bool clear_grads, const Update& update);
+
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<TBlob<Dtype> > > history_, update_, temp_;
+  // Data hashes of history_ at the previous snapshot, for delta snapshots
+  vector<uint64_t> history_hashes_;
 
   DISABLE_COPY_MOVE_AND_ASSIGN(SGDSolver);
 };
@@ -164,6 +185,66 @@ class AdamSolver : public SGDSolver<Dtype> {
   DISABLE_COPY_MOVE_AND_ASSIGN(AdamSolver);
 };
 
+/**
+ * @brief CPU counterpart of the fused *_reg_update_and_clear_gpu kernels.
+ *
+ * Reads and writes the gradient, the weight and the history of each element
+ * once, in parallel: the gradient is scaled by @p grad_scale (iter_size
+ * normalization) and regularized, @p update returns the step that is
+ * subtracted from the weight and left in the gradient unless @p clear_grads.
+ */
+template <typename Mtype, typename Gtype, typename Wtype, typename Update>
+void reg_update_and_clear_cpu(int N, Gtype* g, Wtype* w, float grad_scale,
+    const std::string& reg_type, float local_decay, bool clear_grads, const Update& update) {
+  bool reg_L2 = true;
+  if (local_decay != 0.F) {
+    if (reg_type == "L1") {
+      reg_L2 = false;
+    } else if (reg_type != "L2") {
+      LOG(FATAL) << "Unknown regularization type: " << reg_type;
+    }
+  }
+  caffe_cpu_parallel_for(N, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const Mtype wi = static_cast<Mtype>(w[i]);
+      Mtype gi = static_cast<Mtype>(g[i]) * grad_scale;
+      if (local_decay != 0.F) {
+        gi += local_decay * (reg_L2 ? wi : Mtype((Mtype(0) < wi) - (wi < Mtype(0))));
+      }
+      const Mtype step = update(i, gi);
+      w[i] = static_cast<Wtype>(wi - step);
+      g[i] = clear_grads ? Gtype(0) : static_cast<Gtype>(step);
+    }
+  }, 16384);
+}
+
+template <typename Dtype>
+template <typename Update>
+void SGDSolver<Dtype>::UpdateCpu(int param_id, bool clear_grads, const Update& update) {
+  shared_ptr<Blob> param = this->net_->learnable_params()[param_id];
+  const std::string& regularization_type = this->param_.regularization_type();
+  const float decay = local_decay(param_id);
+  const float grad_scale = 1.F / this->param_.iter_size();
+  const Type gtype = param->diff_type();
+  if (gtype == tp<float>()) {
+    reg_update_and_clear_cpu<Mtype>(param->count(), param->mutable_cpu_diff<float>(),
+        param->mutable_cpu_data<Dtype>(), grad_scale, regularization_type, decay,
+        clear_grads, update);
+  } else if (gtype == tp<double>()) {
+    reg_update_and_clear_cpu<Mtype>(param->count(), param->mutable_cpu_diff<double>(),
+        param->mutable_cpu_data<Dtype>(), grad_scale, regularization_type, decay,
+        clear_grads, update);
+#ifndef CPU_ONLY
+  } else if (gtype == tp<float16>()) {
+    reg_update_and_clear_cpu<Mtype>(param->count(), param->mutable_cpu_diff<float16>(),
+        param->mutable_cpu_data<Dtype>(), grad_scale, regularization_type, decay,
+        clear_grads, update);
+#endif
+  } else {
+    LOG(FATAL) << "Gradient type " << Type_Name(gtype) << " is not supported";
+  }
+}
+
 }  // namespace caffe
 
 #endif  // CAFFE_SGD_SOLVERS_HPP_
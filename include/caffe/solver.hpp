@@ -9,6 +9,7 @@
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -82,6 +83,8 @@ class Solver {
    public:
     virtual void allreduce(int param_id) = 0;
     virtual void allreduce_bucket(int count, void* bucket, Type type) = 0;
+    // Gathers @p bytes of @p send from every solver into @p recv, by rank
+    virtual void allgather_bucket(const void* send, size_t bytes, void* recv) = 0;
     virtual void soft_barrier() = 0;
     virtual void reduce_barrier() = 0;
     virtual void saveTestResults(float loss, const vector<float>& scores) = 0;
@@ -149,6 +152,21 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  // Writes a snapshot file, in the background if snapshot_async is set
+  void WriteSnapshot(const shared_ptr<google::protobuf::Message>& proto,
+      const string& filename);
+  // Returns when all snapshot files are written
+  void WaitForSnapshots();
+  // Hash of the data of @p blob, to tell which blobs changed between snapshots
+  static uint64_t DataHash(Blob* blob, uint64_t seed = 0ULL);
+  // True if the snapshot being taken is a delta, see snapshot_delta_chain
+  bool snapshot_delta() const {
+    return snapshot_delta_;
+  }
+  // The solver state the current delta snapshot applies to
+  const string& snapshot_base() const {
+    return snapshot_base_;
+  }
   // The test routine
   bool TestAll(const int iters = 0, bool use_multi_gpu = false);
   bool Test(const int test_net_id = 0, const int iters = 0, bool use_multi_gpu = false);
@@ -157,7 +175,7 @@ class Solver {
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void UpdateSmoothedLoss(float loss, int start_iter, int average_loss);
   void Reduce(int device, Caffe::Brew mode, uint64_t rand_seed,
-      int solver_count, bool root_solver);
+      int solver_count, bool root_solver, int cpu_core_group);
 
   void callback_soft_barrier() {
     if (callback_ != nullptr) {
@@ -178,6 +196,14 @@ class Solver {
   vector<float> losses_;
   float smoothed_loss_;
   unique_ptr<boost::thread> reduce_thread_;
+  unique_ptr<SnapshotWriter> snapshot_writer_;
+  // Delta snapshots: the previous solver state, the number of deltas since
+  // the last full snapshot, and the data hash of every layer at the previous
+  // snapshot
+  string snapshot_base_;
+  int snapshot_deltas_;
+  bool snapshot_delta_;
+  vector<uint64_t> snapshot_layer_hashes_;
 
   // The root solver that holds root nets (actually containing shared layers)
   // in data parallelism
@@ -74,7 +74,7 @@ class SyncedMemory {
 
  protected:
   void MallocHost(void** ptr, size_t size, bool* use_cuda);
-  void FreeHost(void* ptr, bool use_cuda);
+  void FreeHost(void* ptr);
 
  private:
   void to_cpu();
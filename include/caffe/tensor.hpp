@@ -63,6 +63,7 @@ class Tensor {
   shared_ptr<SyncedMemory>& mutable_synced_mem(bool flush = true);
   void convert(Type new_type);
   void Reshape(int count);
+  void set_cpu_data(void* data);
 
   bool is_current_valid() const {
     const shared_ptr<SyncedMemory>& mem = synced_arrays_->at(type_);
@@ -96,6 +97,8 @@ class Tensor {
   shared_ptr<vector<shared_ptr<SyncedMemory>>> synced_arrays_;
   // number of entries - comes from Blob via Reshape
   int count_;
+  // changes whenever the memory is handed out for writing
+  uint64_t version_;
 
   DISABLE_COPY_MOVE_AND_ASSIGN(Tensor);
 };  // class Tensor
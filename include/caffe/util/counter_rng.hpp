@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_COUNTER_RNG_HPP_
+#define CAFFE_UTIL_COUNTER_RNG_HPP_
+
+#include <cstdint>
+
+#include "caffe/util/philox.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Counter-based random stream on top of Philox4x32-10.
+ *
+ * A stream is keyed by the seed and identified by a stream id; the value at
+ * any position (offset) is a pure function of (seed, stream, offset). Bulk
+ * generators run on the CPU worker pool and produce identical results for
+ * any number of threads. Split() derives independent child streams for
+ * threads, solver ranks or data loaders without sharing generator state.
+ *
+ * Offsets count 128-bit counters; every bulk call consumes a whole number of
+ * 8-counter batches, so consecutive calls never overlap.
+ */
+class CounterRNG {
+ public:
+  explicit CounterRNG(uint64_t seed, uint64_t stream = 0UL);
+
+  /// Child stream @p id of this stream. Same parent and id give same child.
+  CounterRNG Split(uint64_t id) const;
+
+  uint64_t seed() const {
+    return seed_;
+  }
+  uint64_t stream() const {
+    return stream_;
+  }
+  uint64_t offset() const {
+    return offset_;
+  }
+  /// Repositions the stream, e.g. to resume it where a snapshot left it.
+  void set_offset(uint64_t offset) {
+    offset_ = offset;
+  }
+
+  /// Next 64 random bits (consumes one counter).
+  uint64_t Next64();
+
+  /// r[i] ~ U[a, b], closed like the boost generator it replaced
+  template <typename Dtype>
+  void Uniform(int n, float a, float b, Dtype* r);
+  /// r[i] ~ U{a, ..., b}
+  void UniformInt(int n, int a, int b, int* r);
+  /// r[i] ~ N(mu, sigma^2), Box-Muller
+  template <typename Dtype>
+  void Gaussian(int n, float mu, float sigma, Dtype* r);
+  /// r[i] = 1 with probability p, 0 otherwise
+  template <typename Itype>
+  void Bernoulli(int n, double p, Itype* r);
+
+ private:
+  /// Outputs produced per Philox batch (4 words per counter)
+  static constexpr int kBlock = 4 * Philox4x32::kBatch;
+
+  /// Calls fn(words, first, count) for every block of up to kBlock outputs
+  /// of [0, n) in parallel and advances the stream past them.
+  template <typename Fn>
+  void ForBlocks(int n, const Fn& fn);
+
+  uint64_t seed_;
+  uint64_t stream_;
+  uint64_t offset_;
+  Philox4x32 philox_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_COUNTER_RNG_HPP_
@@ -0,0 +1,37 @@
+#ifndef CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+#define CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+
+#include <cstdint>
+
+namespace caffe {
+
+/// @brief A gradient kept by top-k sparsification and its position in the bucket.
+struct SparseGradient {
+  int32_t index;
+  float value;
+};
+
+/**
+ * @brief Top-k sparsification with error feedback: adds the @p n gradients
+ *        @p g to @p residual, moves the @p k largest by magnitude to @p out
+ *        and leaves the others in @p residual for the next iteration.
+ */
+void caffe_cpu_topk_compress(int n, const float* g, float* residual, int k,
+    SparseGradient* out);
+
+/// @brief Sets the @p n gradients @p g to the sum of @p m sparse gradients.
+void caffe_cpu_sparse_accumulate(int n, int m, const SparseGradient* in, float* g);
+
+/**
+ * @brief Rounds the @p n gradients @p g to IEEE half precision, stored as
+ *        plain 16 bit words so that builds without float16 can send them.
+ */
+void caffe_cpu_half_compress(int n, const float* g, uint16_t* out);
+
+/// @brief Sets the @p n gradients @p g to the sum of @p m consecutive sets of
+///        @p n half precision gradients.
+void caffe_cpu_half_accumulate(int n, int m, const uint16_t* in, float* g);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
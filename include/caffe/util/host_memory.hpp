@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Caching allocator for the host buffers of SyncedMemory.
+ *
+ * Sizes are rounded up to size classes, four per power of two, so that a
+ * freed buffer serves later requests of about the same size without going
+ * back to the system (and without faulting its pages in again). Freed
+ * buffers are cached per class, per kind (pageable or CUDA pinned) and per
+ * NUMA node of the thread which allocated them, so that reuse keeps pages
+ * where they were first touched. Beyond cache_limit() bytes the largest
+ * cached buffers are returned to the system first; a buffer larger than the
+ * limit itself is returned directly.
+ *
+ * Buffers are aligned to ALIGNMENT bytes; pageable buffers of HUGE_PAGE_SIZE
+ * or more are aligned to it and advised to use transparent huge pages.
+ */
+struct HostMemory {
+  struct Stats {
+    size_t in_use;          ///< Bytes of live buffers, rounded up to their class
+    size_t peak;            ///< Maximum of in_use
+    size_t cached;          ///< Bytes of freed buffers kept for reuse
+    uint64_t allocations;   ///< Buffers handed out...
+    uint64_t reuses;        ///< ...of which came from the cache
+    uint64_t releases;      ///< Buffers returned to the system
+  };
+
+  /// @brief Returns a buffer of at least @p size bytes, CUDA pinned if @p pinned.
+  static void* allocate(size_t size, bool pinned = false);
+  /// @brief Takes back a buffer returned by allocate.
+  static void deallocate(void* ptr);
+  /// @brief The number of bytes allocated for a request of @p size bytes.
+  static size_t size_class(size_t size);
+
+  /// @brief Caps the bytes kept in the cache (CAFFE_HOST_CACHE_MB, 1 GB by default).
+  static void set_cache_limit(size_t bytes);
+  static size_t cache_limit();
+  /// @brief Returns all cached buffers to the system.
+  static void release_cached();
+
+  static Stats stats();
+  static std::string report();
+  /// @brief The NUMA node of the CPU running the calling thread, 0 if unknown.
+  static int current_numa_node();
+  /// @brief NUMA node of every CPU as listed in sysfs, empty if unknown.
+  static const std::vector<int>& cpu_numa_nodes();
+
+  static const size_t ALIGNMENT;
+  static const size_t HUGE_PAGE_SIZE;
+  static const size_t DEFAULT_CACHE_LIMIT;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_HPP_
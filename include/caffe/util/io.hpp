@@ -83,6 +83,21 @@ inline void ReadProtoFromBinaryFileOrDie(const string& filename,
   ReadProtoFromBinaryFileOrDie(filename.c_str(), proto);
 }
 
+// Where a layer lies in a binary NetParameter file
+struct SerializedLayer {
+  string name;
+  int64_t offset;
+  int length;
+};
+
+// Lists the layers of a binary NetParameter file with their names only,
+// seeking over the rest. Returns false if the file holds V0/V1 layers, which
+// have to be parsed as a whole to be upgraded.
+bool IndexLayersInBinaryFile(const string& filename, vector<SerializedLayer>* layers);
+// Reads and parses one layer listed by IndexLayersInBinaryFile.
+void ReadLayerFromBinaryFile(const string& filename, const SerializedLayer& range,
+    LayerParameter* layer);
+
 
 void WriteProtoToBinaryFile(const Message& proto, const char* filename);
 inline void WriteProtoToBinaryFile(
@@ -90,6 +105,14 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Writes to filename.tmp, fsyncs it and renames it to filename, so that
+// filename never holds a partially written proto.
+void WriteProtoToBinaryFileAtomic(const Message& proto, const char* filename);
+inline void WriteProtoToBinaryFileAtomic(
+    const Message& proto, const string& filename) {
+  WriteProtoToBinaryFileAtomic(proto, filename.c_str());
+}
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
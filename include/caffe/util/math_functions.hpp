@@ -177,6 +177,20 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Softmax over the channel axis of an (outer_num, channels, inner_num) tensor.
+// One fused max / exp+sum / scale sweep per row, rows run on the CPU worker
+// pool. y may alias x.
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y);
+
+// bottom_diff = (top_diff - dot(top_diff, top_data)) * top_data per row,
+// bottom_diff may alias top_diff.
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* top_data, const Dtype* top_diff,
+    Dtype* bottom_diff);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_PARALLEL_FOR_HPP_
+#define CAFFE_UTIL_PARALLEL_FOR_HPP_
+
+#include <functional>
+
+namespace caffe {
+
+/**
+ * @brief Runs fn(begin, end) over contiguous chunks of [0, n) using the
+ *        process-wide CPU worker pool and returns when all chunks are done.
+ *
+ * Chunks are at least @p grain items long. Calls made from inside a worker
+ * or while the pool is busy with another caller run inline on the calling
+ * thread, so kernels may nest parallel_for safely. fn must not touch
+ * thread-local Caffe state (mode, streams, RNG): workers are plain threads.
+ */
+void caffe_cpu_parallel_for(int n, const std::function<void(int, int)>& fn,
+    int grain = 1);
+
+/// @brief Number of threads used by caffe_cpu_parallel_for (including caller).
+int caffe_cpu_threads();
+
+/**
+ * @brief Resizes the CPU worker pool. Zero or negative value selects
+ *        the number of hardware threads.
+ */
+void caffe_set_cpu_threads(int threads);
+
+/**
+ * @brief Splits the CPUs the process may run on into @p groups disjoint core
+ *        groups, each served by its own worker pool. Groups keep to one NUMA
+ *        node each as long as there are no fewer groups than nodes. On Linux
+ *        the workers of a group are pinned to its cores. One group (the
+ *        default) leaves only the process-wide pool. Call it before any
+ *        thread joins a group.
+ */
+void caffe_set_cpu_core_groups(int groups);
+
+/// @brief Number of core groups set by caffe_set_cpu_core_groups.
+int caffe_cpu_core_groups();
+
+/**
+ * @brief Binds the calling thread to core group @p group: it is pinned to
+ *        the group's cores and its caffe_cpu_parallel_for calls run on the
+ *        group's pool. Negative value (or a single group) binds it back to
+ *        the process-wide pool.
+ */
+void caffe_cpu_join_core_group(int group);
+
+/// @brief Core group of the calling thread, -1 when it uses the process-wide pool.
+int caffe_cpu_core_group();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PARALLEL_FOR_HPP_
@@ -0,0 +1,93 @@
+#ifndef CAFFE_UTIL_PHILOX_HPP_
+#define CAFFE_UTIL_PHILOX_HPP_
+
+#include <cstdint>
+
+namespace caffe {
+
+/**
+ * @brief Philox4x32-10 counter-based random number generator
+ *        (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC'11).
+ *
+ * Output is a pure function of a 64-bit key and a 128-bit counter, so any
+ * element of a stream can be produced independently of the others: threads
+ * may generate disjoint counter ranges in any order and get the same bits.
+ */
+class Philox4x32 {
+ public:
+  /// Counters evaluated together by Batch(); loops over lanes vectorize.
+  static constexpr int kBatch = 8;
+
+  explicit Philox4x32(uint64_t key)
+      : k0_(static_cast<uint32_t>(key)), k1_(static_cast<uint32_t>(key >> 32)) {}
+
+  /// Writes 4 random words for counter (hi, lo) to out.
+  void operator()(uint64_t hi, uint64_t lo, uint32_t* out) const {
+    uint32_t c0 = static_cast<uint32_t>(lo), c1 = static_cast<uint32_t>(lo >> 32);
+    uint32_t c2 = static_cast<uint32_t>(hi), c3 = static_cast<uint32_t>(hi >> 32);
+    uint32_t k0 = k0_, k1 = k1_;
+    for (int r = 0; r < kRounds; ++r) {
+      Round(&c0, &c1, &c2, &c3, k0, k1);
+      k0 += kWeyl0;
+      k1 += kWeyl1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+  /**
+   * @brief Writes 4 * kBatch words for counters (hi, lo + i), i < kBatch.
+   *        Words of counter i are out[4 * i] .. out[4 * i + 3].
+   */
+  void Batch(uint64_t hi, uint64_t lo, uint32_t* out) const {
+    uint32_t c0[kBatch], c1[kBatch], c2[kBatch], c3[kBatch];
+    for (int i = 0; i < kBatch; ++i) {
+      const uint64_t ctr = lo + i;
+      c0[i] = static_cast<uint32_t>(ctr);
+      c1[i] = static_cast<uint32_t>(ctr >> 32);
+      c2[i] = static_cast<uint32_t>(hi);
+      c3[i] = static_cast<uint32_t>(hi >> 32);
+    }
+    uint32_t k0 = k0_, k1 = k1_;
+    for (int r = 0; r < kRounds; ++r) {
+      for (int i = 0; i < kBatch; ++i) {
+        Round(&c0[i], &c1[i], &c2[i], &c3[i], k0, k1);
+      }
+      k0 += kWeyl0;
+      k1 += kWeyl1;
+    }
+    for (int i = 0; i < kBatch; ++i) {
+      out[4 * i] = c0[i];
+      out[4 * i + 1] = c1[i];
+      out[4 * i + 2] = c2[i];
+      out[4 * i + 3] = c3[i];
+    }
+  }
+
+ private:
+  static constexpr int kRounds = 10;
+  static constexpr uint32_t kMul0 = 0xD2511F53U;
+  static constexpr uint32_t kMul1 = 0xCD9E8D57U;
+  static constexpr uint32_t kWeyl0 = 0x9E3779B9U;
+  static constexpr uint32_t kWeyl1 = 0xBB67AE85U;
+
+  static void Round(uint32_t* c0, uint32_t* c1, uint32_t* c2, uint32_t* c3,
+      uint32_t k0, uint32_t k1) {
+    const uint64_t p0 = static_cast<uint64_t>(kMul0) * *c0;
+    const uint64_t p1 = static_cast<uint64_t>(kMul1) * *c2;
+    const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ *c1 ^ k0;
+    const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ *c3 ^ k1;
+    *c1 = static_cast<uint32_t>(p1);
+    *c3 = static_cast<uint32_t>(p0);
+    *c0 = n0;
+    *c2 = n2;
+  }
+
+  uint32_t k0_, k1_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_HPP_
@@ -0,0 +1,101 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Process-wide recorder of timed events of real runs: layer Forward
+ *        and Backward, data loading and waits, gradient reduction and updates.
+ *
+ * Off until Start(). Events go to a ring buffer of fixed capacity, the
+ * oldest are overwritten once it is full. Timestamps are host time: in GPU
+ * mode they show when work was issued unless the stream is synchronized.
+ */
+class Profiler {
+ public:
+  struct Event {
+    string category, name;
+    int thread;
+    int64_t begin_us, end_us;
+    double flops, bytes;
+  };
+
+  static Profiler& Get();
+
+  /// @brief Clears recorded events and starts recording.
+  void Start(size_t capacity = 65536UL);
+  void Stop();
+  bool enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Microseconds since the profiler was created.
+  int64_t Now() const;
+  void Record(const char* category, const string& name, int64_t begin_us, int64_t end_us,
+      double flops = 0., double bytes = 0.);
+
+  /// @brief Events still held by the ring buffer, oldest first.
+  vector<Event> Events() const;
+  /// @brief Writes events in Chrome trace_event JSON (chrome://tracing).
+  void WriteChromeTrace(const string& filename) const;
+  /**
+   * @brief Table of events grouped by category and name: calls, total and
+   *        average time, achieved GFLOP/s and GB/s.
+   */
+  string Summary() const;
+
+  /// @brief Small id of the calling thread, stable for its lifetime.
+  static int thread_id();
+
+ private:
+  Profiler();
+
+  mutable std::mutex m_;
+  std::atomic<bool> enabled_;
+  vector<Event> events_;
+  size_t recorded_;
+  const int64_t origin_us_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(Profiler);
+};
+
+/**
+ * @brief Records an event from construction to destruction when the
+ *        profiler is on, costs a relaxed atomic load otherwise.
+ */
+class ProfileScope {
+ public:
+  ProfileScope(const char* category, const string& name)
+      : category_(category), begin_us_(-1L) {
+    Profiler& profiler = Profiler::Get();
+    if (profiler.enabled()) {
+      name_ = name;
+      begin_us_ = profiler.Now();
+    }
+  }
+  ~ProfileScope() {
+    if (begin_us_ >= 0L) {
+      Profiler& profiler = Profiler::Get();
+      profiler.Record(category_, name_, begin_us_, profiler.Now());
+    }
+  }
+
+ private:
+  const char* category_;
+  string name_;
+  int64_t begin_us_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(ProfileScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
@@ -0,0 +1,73 @@
+#ifndef CAFFE_UTIL_QUANTIZE_HPP_
+#define CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+/**
+ * @brief y[i] = x[i] / scale rounded to nearest and saturated to
+ *        [-127, 127], the symmetric int8 range.
+ */
+template <typename Dtype>
+void caffe_cpu_quantize_s8(const int n, const Dtype* x, const float scale, int8_t* y);
+
+/**
+ * @brief C = A op(B) accumulated in int32 for int8 in [-127, 127], where A is
+ *        M x K and C is M x N, row-major; op(B) is B (K x N, as im2col lays
+ *        out columns) or, with CblasTrans, B stored N x K (as inner product
+ *        weights are).
+ *
+ * B is packed block by block for a register tiled kernel picked at run time:
+ * AVX-512 VNNI (vpdpbusd) or AVX2 (vpmaddubsw), both exact, with a plain
+ * loop elsewhere.
+ */
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C);
+
+/// @brief Name of the kernel caffe_cpu_gemm_s8 runs on this CPU.
+const char* caffe_cpu_gemm_s8_kernel();
+
+/**
+ * @brief Weights of a layer quantized to int8 with one scale per output
+ *        channel, taken from the channel's largest magnitude.
+ *
+ * Update() quantizes again only when the weights live elsewhere than last
+ * time (shared or replaced blobs), were written to since (see
+ * Blob::data_version) or the solver moved on to another iteration.
+ */
+class QuantizedWeights {
+ public:
+  QuantizedWeights() : source_(nullptr), version_(0UL), iter_(-1) {}
+
+  /**
+   * @brief Quantizes @p rows output channels of @p cols weights each. With
+   *        @p transposed the weights are stored cols x rows and are
+   *        transposed on the way.
+   */
+  template <typename Dtype>
+  void Update(int rows, int cols, const Dtype* weights, uint64_t version, int iter,
+      bool transposed = false);
+
+  /// @brief rows x cols quantized weights, row-major.
+  const int8_t* data() const { return data_.data(); }
+  /// @brief Real value of one int8 step of each row.
+  const float* scales() const { return scales_.data(); }
+
+ private:
+  std::vector<int8_t> data_;
+  std::vector<float> scales_;
+  const void* source_;
+  uint64_t version_;
+  int iter_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(QuantizedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
@@ -0,0 +1,51 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "google/protobuf/message.h"
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Writes binary protos on a background thread so that the caller
+ *        only pays for building them.
+ *
+ * Files are written in the order they were queued, each one to a temporary
+ * file which is fsync'ed and then renamed, so a snapshot file either is
+ * complete or does not exist. At most max_pending protos are held in memory:
+ * Write blocks until the writer catches up.
+ */
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(int max_pending);
+  /// @brief Writes everything still queued before returning.
+  ~SnapshotWriter();
+
+  /// @brief Queues @p proto to be written to @p filename and takes it over.
+  void Write(const shared_ptr<google::protobuf::Message>& proto, const string& filename);
+  /// @brief Returns when all queued protos are on disk.
+  void Wait();
+
+ protected:
+  void Entry();
+
+  const int max_pending_;
+  // Queued and being written
+  int pending_;
+  bool stop_;
+  std::deque<std::pair<shared_ptr<google::protobuf::Message>, string>> queue_;
+  boost::mutex mutex_;
+  boost::condition_variable queued_, written_;
+  boost::thread thread_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
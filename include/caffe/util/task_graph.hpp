@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_TASK_GRAPH_HPP_
+#define CAFFE_UTIL_TASK_GRAPH_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs the tasks of a dependency graph on a fixed set of threads,
+ *        each task as soon as all of its predecessors are done.
+ *
+ * The calling thread takes part in the work, so TaskGraph(1) runs tasks
+ * inline in a topological order. Workers are plain threads: tasks touching
+ * thread-local Caffe state (mode, RNG) have to set it up themselves.
+ */
+class TaskGraph {
+ public:
+  explicit TaskGraph(int threads);
+  ~TaskGraph();
+
+  int threads() const {
+    return static_cast<int>(workers_.size()) + 1;
+  }
+
+  /**
+   * @brief Calls fn(t) for every task t with active[t] set and returns when
+   *        all of them are done.
+   *
+   * @param successors tasks depending on each task
+   * @param active     tasks to run; inactive ones count as already done
+   */
+  void Run(const vector<vector<int>>& successors, const vector<bool>& active,
+      const std::function<void(int)>& fn);
+
+ private:
+  void Work();
+  void WorkerLoop();
+
+  std::mutex m_;
+  std::condition_variable cv_, ready_cv_, done_cv_;
+  vector<std::thread> workers_;
+  const vector<vector<int>>* successors_;
+  const std::function<void(int)>* fn_;
+  vector<int> pending_;
+  std::deque<int> ready_;
+  int remaining_;
+  int busy_;
+  uint64_t generation_;
+  bool stop_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(TaskGraph);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_GRAPH_HPP_
@@ -0,0 +1,108 @@
+#ifndef CAFFE_UTIL_TRANSPORT_HPP_
+#define CAFFE_UTIL_TRANSPORT_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/type.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Collective communication between the processes of a distributed run,
+ *        arranged in a ring: rank r sends to rank (r + 1) % size and receives
+ *        from rank (r + size - 1) % size.
+ *
+ * Implementations provide the two ring links; the collectives are built on
+ * top of them and may be overridden by transports with native ones. All
+ * ranks must call the same collectives in the same order. A transport is
+ * not thread safe: threads that communicate concurrently need their own.
+ */
+class Transport {
+ public:
+  Transport(int rank, int size);
+  virtual ~Transport() {}
+
+  int rank() const {
+    return rank_;
+  }
+  int size() const {
+    return size_;
+  }
+
+  /// @brief Returns when all ranks have entered it.
+  virtual void Barrier();
+  /// @brief Copies @p bytes of @p data on rank @p root to all other ranks.
+  virtual void Broadcast(void* data, size_t bytes, int root = 0);
+  /**
+   * @brief Sums @p count elements of @p type over all ranks in place.
+   *        Ring reduce-scatter followed by ring all-gather: every rank sends
+   *        and receives 2 * (size - 1) / size of the buffer.
+   */
+  virtual void Allreduce(void* data, int count, Type type);
+  /// @brief Copies @p bytes of @p send of every rank to @p recv, ordered by rank.
+  virtual void Allgather(const void* send, size_t bytes, void* recv);
+
+ protected:
+  /// @brief Blocking send to the next rank of the ring.
+  virtual void SendNext(const void* data, size_t bytes) = 0;
+  /// @brief Blocking receive from the previous rank of the ring.
+  virtual void RecvPrev(void* data, size_t bytes) = 0;
+  /**
+   * @brief Sends to the next rank while receiving from the previous one.
+   *        The default sends on a thread of its own, transports should
+   *        override it with a non-blocking exchange.
+   */
+  virtual void SendRecv(const void* send_data, size_t send_bytes,
+      void* recv_data, size_t recv_bytes);
+
+  template<typename Dtype>
+  void RingAllreduce(Dtype* data, int count);
+
+  const int rank_, size_;
+  vector<char> recv_buffer_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(Transport);
+};
+
+/**
+ * @brief Transport over stream sockets.
+ *
+ * The address is either "tcp://host[,host...]:port" or "unix:///path".
+ * With TCP, rank r listens on port + channel * size + r of its host (the
+ * r-th of the list, or the only one given). With Unix domain sockets rank r
+ * listens on path.channel.r, so all ranks must share a file system.
+ * Different channels give independent rings for threads that communicate
+ * at the same time.
+ */
+class SocketTransport : public Transport {
+ public:
+  SocketTransport(const string& address, int rank, int size, int channel = 0,
+      int timeout_sec = 120);
+  ~SocketTransport() override;
+
+ protected:
+  void SendNext(const void* data, size_t bytes) override;
+  void RecvPrev(void* data, size_t bytes) override;
+  /// @brief Interleaves both directions with poll instead of a sender thread.
+  void SendRecv(const void* send_data, size_t send_bytes,
+      void* recv_data, size_t recv_bytes) override;
+
+  int Listen();
+  int Connect(int peer);
+
+  bool unix_;
+  vector<string> hosts_;
+  int port_;
+  string path_;
+  const int channel_;
+  const int timeout_sec_;
+  int next_fd_, prev_fd_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(SocketTransport);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRANSPORT_HPP_
@@ -0,0 +1,92 @@
+#ifndef CAFFE_UTIL_WEIGHT_FILE_HPP_
+#define CAFFE_UTIL_WEIGHT_FILE_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Weight file layout: a fixed header, the raw tensors each starting
+ *        at a multiple of kWeightFileAlignment bytes, then a WeightFileIndex
+ *        proto locating them. Tensors are stored in host byte order.
+ *
+ * Because the index comes last, files are written in one streaming pass
+ * without holding the whole model in memory.
+ */
+struct WeightFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t index_offset;
+  uint64_t index_bytes;
+};
+
+constexpr size_t kWeightFileAlignment = 64;
+
+/**
+ * @brief Writes a weight file tensor by tensor. The file gets its name only
+ *        when closed, so it is either complete or absent.
+ */
+class WeightFileWriter {
+ public:
+  explicit WeightFileWriter(const string& filename);
+  ~WeightFileWriter();
+
+  /// @brief Appends the data of @p blob as blob @p blob_id of @p layer.
+  void Add(const string& layer, const string& layer_type, int blob_id, Blob* blob);
+  /// @brief Writes the index and header, syncs and renames the file.
+  void Close();
+
+ protected:
+  void WriteBytes(const void* data, size_t bytes);
+  void Pad();
+
+  const string filename_, tmp_filename_;
+  int fd_;
+  uint64_t offset_;
+  WeightFileIndex index_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(WeightFileWriter);
+};
+
+/**
+ * @brief A weight file mapped into memory.
+ *
+ * The mapping is private and writable: pages are shared with the page cache,
+ * and so with every process mapping the same file, until written to, when
+ * the writer gets its own copy. Blobs may therefore use tensors in place
+ * for as long as the WeightFile lives.
+ */
+class WeightFile {
+ public:
+  explicit WeightFile(const string& filename);
+  ~WeightFile();
+
+  /// @brief True if @p filename starts with a weight file header.
+  static bool Check(const string& filename);
+
+  const WeightFileIndex& index() const {
+    return index_;
+  }
+  /// @brief The tensor of @p entry, padded to an even number of elements.
+  void* data(const WeightFileIndex::Entry& entry) const {
+    return static_cast<char*>(map_) + entry.offset();
+  }
+
+ protected:
+  const string filename_;
+  void* map_;
+  size_t size_;
+  WeightFileIndex index_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(WeightFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_FILE_HPP_
@@ -0,0 +1,139 @@
+#include <algorithm>
+
+#include "caffe/batching_server.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+BatchingServer::BatchingServer(const shared_ptr<Net>& net, int max_batch,
+    int max_latency_us, int workers)
+    : engine_(net, workers),
+      max_batch_(max_batch),
+      max_latency_(max_latency_us),
+      num_inputs_(net->num_inputs()),
+      stop_(false),
+      batches_(0UL),
+      requests_(0UL) {
+  CHECK_GT(max_batch, 0) << "Batches hold one request at least";
+  CHECK_GE(max_latency_us, 0) << "Latency can't be negative";
+  for (int i = 0; i < engine_.instances(); ++i) {
+    workers_.emplace_back(&BatchingServer::WorkerLoop, this);
+  }
+}
+
+BatchingServer::~BatchingServer() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+std::future<void> BatchingServer::Submit(const vector<Blob*>& inputs,
+    const vector<Blob*>& outputs) {
+  CHECK_EQ(inputs.size(), num_inputs_) << "Wrong number of inputs";
+  for (const Blob* input : inputs) {
+    CHECK_GT(input->num_axes(), 0);
+    CHECK_EQ(input->shape(0), 1) << "Requests hold one sample, got shape "
+        << input->shape_string();
+  }
+  std::unique_ptr<Request> request(new Request);
+  request->inputs = inputs;
+  request->outputs = outputs;
+  request->arrival = std::chrono::steady_clock::now();
+  std::future<void> done = request->done.get_future();
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    CHECK(!stop_) << "BatchingServer is shutting down";
+    queue_.push_back(std::move(request));
+  }
+  cv_.notify_all();
+  return done;
+}
+
+bool BatchingServer::NextBatch(vector<std::unique_ptr<Request>>* batch) {
+  batch->clear();
+  std::unique_lock<std::mutex> lock(m_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    // Oldest request waits for others until its deadline. Another worker
+    // may take it meanwhile.
+    const auto deadline = queue_.front()->arrival + max_latency_;
+    cv_.wait_until(lock, deadline, [this] {
+      return stop_ || queue_.size() >= max_batch_;
+    });
+    if (!queue_.empty()) {
+      break;
+    }
+  }
+  const vector<Blob*>& first = queue_.front()->inputs;
+  while (!queue_.empty() && batch->size() < max_batch_) {
+    const vector<Blob*>& inputs = queue_.front()->inputs;
+    bool same_shape = true;
+    for (int i = 0; i < num_inputs_; ++i) {
+      same_shape = same_shape && inputs[i]->shape() == first[i]->shape();
+    }
+    if (!same_shape) {
+      break;
+    }
+    batch->push_back(std::move(queue_.front()));
+    queue_.pop_front();
+  }
+  return true;
+}
+
+void BatchingServer::WorkerLoop() {
+  vector<shared_ptr<Blob>> batch_inputs, batch_outputs;
+  vector<Blob*> inputs, outputs;
+  for (int i = 0; i < num_inputs_; ++i) {
+    batch_inputs.push_back(Blob::create<float>());
+    inputs.push_back(batch_inputs.back().get());
+  }
+  vector<std::unique_ptr<Request>> batch;
+  while (NextBatch(&batch)) {
+    const int num = batch.size();
+    // Gather samples into rows of the batch
+    for (int i = 0; i < num_inputs_; ++i) {
+      vector<int> shape = batch[0]->inputs[i]->shape();
+      shape[0] = num;
+      batch_inputs[i]->Reshape(shape);
+      const int count = batch_inputs[i]->count() / num;
+      float* data = batch_inputs[i]->mutable_cpu_data<float>();
+      for (int n = 0; n < num; ++n) {
+        caffe_copy(count, batch[n]->inputs[i]->cpu_data<float>(), data + n * count);
+      }
+    }
+    const int num_outputs = engine_.net().num_outputs();
+    while (batch_outputs.size() < num_outputs) {
+      batch_outputs.push_back(Blob::create<float>());
+      outputs.push_back(batch_outputs.back().get());
+    }
+    engine_.Infer(inputs, outputs);
+    ++batches_;
+    requests_ += num;
+    // Scatter rows of the outputs
+    for (int n = 0; n < num; ++n) {
+      CHECK_EQ(batch[n]->outputs.size(), num_outputs) << "Wrong number of outputs";
+      for (int j = 0; j < num_outputs; ++j) {
+        vector<int> shape = batch_outputs[j]->shape();
+        CHECK(!shape.empty() && shape[0] == num)
+            << "Output " << j << " has no batch dimension";
+        shape[0] = 1;
+        Blob* output = batch[n]->outputs[j];
+        output->Reshape(shape);
+        const int count = output->count();
+        caffe_copy(count, batch_outputs[j]->cpu_data<float>() + n * count,
+            output->mutable_cpu_data<float>());
+      }
+      batch[n]->done.set_value();
+    }
+  }
+}
+
+}  // namespace caffe
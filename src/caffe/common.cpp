@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "caffe/common.hpp"
+#include "caffe/util/counter_rng.hpp"
 #include "caffe/util/device_alternate.hpp"
 #include "caffe/util/gpu_memory.hpp"
 #include "caffe/util/rng.hpp"
@@ -98,12 +99,24 @@ void Caffe::set_random_seed(uint64_t random_seed) {
 #endif
   // RNG seed
   Get().random_generator_.reset(new RNG(random_seed));
+  if (random_seed == Caffe::SEED_NOT_SET) {
+    Get().counter_rng_.reset();
+  } else {
+    Get().counter_rng_.reset(new CounterRNG(random_seed));
+  }
 }
 
 uint64_t Caffe::next_seed() {
   return (*caffe_rng())();
 }
 
+CounterRNG& Caffe::counter_rng() {
+  if (!Get().counter_rng_) {
+    Get().counter_rng_.reset(new CounterRNG(next_seed()));
+  }
+  return *(Get().counter_rng_);
+}
+
 void Caffe::set_restored_iter(int val) {
   std::lock_guard<std::mutex> lock(caffe_mutex_);
   restored_iter_ = val;
@@ -157,6 +170,8 @@ Caffe::RNG::RNG() : generator_(new Generator()) { }
 
 Caffe::RNG::RNG(uint64_t seed) : generator_(new Generator(seed)) { }
 
+Caffe::RNG::RNG(const RNG& other) : generator_(other.generator_) { }
+
 Caffe::RNG& Caffe::RNG::operator=(const RNG& other) {
   generator_ = other.generator_;
   return *this;
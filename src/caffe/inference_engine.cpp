@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <thread>
+
+#include "caffe/inference_engine.hpp"
+
+namespace caffe {
+
+InferenceEngine::InferenceEngine(const shared_ptr<Net>& net, int instances)
+    : mode_(Caffe::mode()) {
+  CHECK(net);
+  CHECK_EQ(net->phase(), TEST) << "InferenceEngine runs TEST phase nets only";
+  CHECK_GE(instances, 0) << "Number of instances can't be negative";
+  if (instances == 0) {
+    instances = std::max(1U, std::thread::hardware_concurrency());
+  }
+#ifndef CPU_ONLY
+  device_ = Caffe::current_device();
+#endif
+  instances_.push_back(net);
+  // Instances share the weights, which have to be in place first
+  net->LoadDeferredLayers();
+  for (int i = 1; i < instances; ++i) {
+    instances_.push_back(make_shared<Net>(net.get()));
+  }
+  // The first Forward of every instance, one at a time, lets layers set up
+  // what they lazily initialize, shared weights converted to their math type
+  // included. Later Forward passes only read the shared weights.
+  for (shared_ptr<Net>& instance : instances_) {
+    for (Blob* input : instance->input_blobs()) {
+      input->set_data(0.F);
+    }
+    instance->Forward();
+    free_.push(instance.get());
+  }
+  LOG(INFO) << "Inference engine of net " << net->name() << " runs "
+            << instances << " instances sharing one set of weights";
+}
+
+void InferenceEngine::Infer(const vector<Blob*>& inputs, const vector<Blob*>& outputs) {
+  Net* net = free_.pop();
+  const Caffe::Brew mode = Caffe::mode();
+  Caffe::set_mode(mode_);
+#ifndef CPU_ONLY
+  if (mode_ == Caffe::GPU) {
+    CUDA_CHECK(cudaSetDevice(device_));
+  }
+#endif
+  const vector<Blob*>& net_inputs = net->input_blobs();
+  CHECK_EQ(inputs.size(), net_inputs.size()) << "Wrong number of inputs";
+  bool reshape = false;
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (net_inputs[i]->shape() != inputs[i]->shape()) {
+      net_inputs[i]->Reshape(inputs[i]->shape());
+      reshape = true;
+    }
+  }
+  if (reshape) {
+    net->Reshape();
+  }
+  for (int i = 0; i < inputs.size(); ++i) {
+    net_inputs[i]->CopyFrom(*inputs[i]);
+  }
+  const vector<Blob*>& net_outputs = net->Forward();
+  CHECK_EQ(outputs.size(), net_outputs.size()) << "Wrong number of outputs";
+  for (int i = 0; i < outputs.size(); ++i) {
+    outputs[i]->CopyFrom(*net_outputs[i], false, true);
+  }
+  Caffe::set_mode(mode);
+  free_.push(net);
+}
+
+}  // namespace caffe
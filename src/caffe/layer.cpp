@@ -78,6 +78,37 @@ void LayerBase::Unlock() {
   }
 }
 
+double LayerBase::ForwardBytes(const vector<Blob*>& bottom, const vector<Blob*>& top) const {
+  double bytes = 0.;
+  for (const Blob* blob : bottom) {
+    bytes += static_cast<double>(blob->count()) * tsize(blob->data_type());
+  }
+  for (const Blob* blob : top) {
+    bytes += static_cast<double>(blob->count()) * tsize(blob->data_type());
+  }
+  for (const shared_ptr<Blob>& blob : blobs_) {
+    bytes += static_cast<double>(blob->count()) * tsize(blob->data_type());
+  }
+  return bytes;
+}
+
+double LayerBase::BackwardBytes(const vector<Blob*>& top, const vector<Blob*>& bottom) const {
+  double bytes = 0.;
+  for (const Blob* blob : top) {
+    bytes += static_cast<double>(blob->count())
+        * (tsize(blob->data_type()) + tsize(blob->diff_type()));
+  }
+  for (const Blob* blob : bottom) {
+    bytes += static_cast<double>(blob->count())
+        * (tsize(blob->data_type()) + tsize(blob->diff_type()));
+  }
+  for (const shared_ptr<Blob>& blob : blobs_) {
+    bytes += static_cast<double>(blob->count())
+        * (tsize(blob->data_type()) + tsize(blob->diff_type()));
+  }
+  return bytes;
+}
+
 const Solver* LayerBase::parent_solver() const {
   return parent_net_ == nullptr ? nullptr : parent_net_->parent_solver();
 }
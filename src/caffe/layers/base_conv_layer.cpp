@@ -5,6 +5,7 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -185,6 +186,7 @@ BaseConvolutionLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom, const v
   }
   // Shape the tops.
   bottom_shape_ = &bottom[0]->shape();
+  bottom_image_shape_.assign(bottom_shape_->begin() + channel_axis_, bottom_shape_->end());
   compute_output_shape();
   vector<int> top_shape(bottom[0]->shape().begin(), bottom[0]->shape().begin() + channel_axis_);
   top_shape.push_back(num_output_);
@@ -238,6 +240,65 @@ BaseConvolutionLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom, const v
   }
 }
 
+template<typename Ftype, typename Btype>
+bool BaseConvolutionLayer<Ftype, Btype>::ReshapeBatch(const vector<Blob*>& bottom,
+    const vector<Blob*>& top) {
+  // Buffers and offsets are per image: only num_ and the tops follow the batch
+  const vector<int>& shape = bottom[0]->shape();
+  if (bottom[0]->num_axes() != channel_axis_ + num_spatial_axes_ + 1 ||
+      !std::equal(bottom_image_shape_.begin(), bottom_image_shape_.end(),
+          shape.begin() + channel_axis_)) {
+    return false;
+  }
+  for (int bottom_id = 1; bottom_id < bottom.size(); ++bottom_id) {
+    if (bottom[bottom_id]->shape() != shape) {
+      return false;
+    }
+  }
+  num_ = bottom[0]->count(0, channel_axis_);
+  vector<int> top_shape = top[0]->shape();
+  std::copy(shape.begin(), shape.begin() + channel_axis_, top_shape.begin());
+  for (int top_id = 0; top_id < top.size(); ++top_id) {
+    top[top_id]->Reshape(top_shape);
+  }
+  return true;
+}
+
+template<typename Ftype, typename Btype>
+void BaseConvolutionLayer<Ftype, Btype>::forward_cpu_gemm_s8(const Ftype* input,
+    const Ftype* weights, Ftype* output) {
+  const float input_scale = this->layer_param_.quantization_param().input_scale();
+  weights_s8_.Update(conv_out_channels_, kernel_dim_, weights,
+      this->blobs_[0]->data_version(), this->iter());
+  input_s8_.resize(bottom_dim_);
+  caffe_cpu_quantize_s8(bottom_dim_, input, input_scale, input_s8_.data());
+  // Padding stays exact: real zero is int8 zero
+  const int8_t* col_buff = input_s8_.data();
+  if (!is_1x1_) {
+    col_s8_.resize(static_cast<size_t>(kernel_dim_) * group_ * conv_out_spatial_dim_);
+    conv_im2col_cpu(input_s8_.data(), col_s8_.data());
+    col_buff = col_s8_.data();
+  }
+  const int M = conv_out_channels_ / group_;
+  const int N = conv_out_spatial_dim_;
+  const int K = kernel_dim_;
+  output_s32_.resize(static_cast<size_t>(M) * N);
+  for (int g = 0; g < group_; ++g) {
+    // The gemm packs the K x N columns itself, block by block
+    caffe_cpu_gemm_s8(CblasNoTrans, M, N, K,
+        weights_s8_.data() + static_cast<size_t>(M) * K * g, col_buff + col_offset_ * g,
+        output_s32_.data());
+    const float* scales = weights_s8_.scales() + M * g;
+    Ftype* output_g = output + output_offset_ * g;
+    for (int m = 0; m < M; ++m) {
+      const float scale = scales[m] * input_scale;
+      for (int n = 0; n < N; ++n) {
+        output_g[m * N + n] = static_cast<Ftype>(scale * output_s32_[m * N + n]);
+      }
+    }
+  }
+}
+
 INSTANTIATE_CLASS_FB(BaseConvolutionLayer);
 
 }  // namespace caffe
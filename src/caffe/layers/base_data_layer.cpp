@@ -8,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -115,7 +116,10 @@ void BasePrefetchingDataLayer<Ftype, Btype>::InternalThreadEntryN(size_t thread_
       shared_ptr<Batch<Ftype>> batch = prefetches_free_[qid]->pop();
 
       CHECK_EQ((size_t) -1, batch->id());
-      load_batch(batch.get(), thread_id, qid);
+      {
+        ProfileScope scope("data", this->layer_param_.name());
+        load_batch(batch.get(), thread_id, qid);
+      }
       if (Caffe::mode() == Caffe::GPU) {
         if (!use_gpu_transform) {
           batch->data_.async_gpu_push();
@@ -129,7 +133,10 @@ void BasePrefetchingDataLayer<Ftype, Btype>::InternalThreadEntryN(size_t thread_
       prefetches_full_[qid]->push(batch);
 #else
       shared_ptr<Batch<Ftype>> batch = prefetches_free_[qid]->pop();
-      load_batch(batch.get(), thread_id, qid);
+      {
+        ProfileScope scope("data", this->layer_param_.name());
+        load_batch(batch.get(), thread_id, qid);
+      }
       prefetches_full_[qid]->push(batch);
 #endif
 
@@ -231,8 +238,11 @@ template<typename Ftype, typename Btype>
 void BasePrefetchingDataLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
     const vector<Blob*>& top) {
   // Note: this function runs in one thread per object and one object per one Solver thread
-  shared_ptr<Batch<Ftype>> batch = prefetches_full_[next_batch_queue_]->pop(
-      "Data layer prefetch queue empty");
+  shared_ptr<Batch<Ftype>> batch;
+  {
+    ProfileScope scope("wait", this->layer_param_.name());
+    batch = prefetches_full_[next_batch_queue_]->pop("Data layer prefetch queue empty");
+  }
   if (this->relative_iter() > 1 && top[0]->data_type() == batch->data_.data_type()
       && top[0]->shape() == batch->data_.shape()) {
     top[0]->Swap(batch->data_);
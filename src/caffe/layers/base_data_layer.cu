@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -8,8 +9,11 @@ template<typename Ftype, typename Btype>
 void BasePrefetchingDataLayer<Ftype, Btype>::Forward_gpu(const vector<Blob*>& bottom,
     const vector<Blob*>& top) {
   // Note: this function runs in one thread per object and one object per one Solver thread
-  shared_ptr<Batch<Ftype>> batch =
-      prefetches_full_[next_batch_queue_]->pop("Data layer prefetch queue empty");
+  shared_ptr<Batch<Ftype>> batch;
+  {
+    ProfileScope scope("wait", this->layer_param_.name());
+    batch = prefetches_full_[next_batch_queue_]->pop("Data layer prefetch queue empty");
+  }
   Blob& transformed_blob = is_gpu_transform() ? *batch->gpu_transformed_data_ : batch->data_;
   if (this->relative_iter() > 1 && top[0]->data_type() == transformed_blob.data_type()
       && top[0]->shape() == transformed_blob.shape()) {
@@ -60,8 +60,8 @@ BatchNormLayer<Ftype, Btype>::LayerSetUp(const vector<Blob*>& bottom, const vect
         this->blobs_[4]->set_data(0.);
       }
     }
-    iter_ = 0;
   }
+  iter_ = 0;
 
   // Mask statistics from optimization by setting local learning rates
   // for mean, variance, and the var_correction to zero.
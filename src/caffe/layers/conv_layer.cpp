@@ -25,12 +25,18 @@ template <typename Ftype, typename Btype>
 void ConvolutionLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {
   const Ftype* weight = this->blobs_[0]->template cpu_data<Ftype>();
+  const bool int8 = this->int8_forward();
   for (int i = 0; i < bottom.size(); ++i) {
     const Ftype* bottom_data = bottom[i]->cpu_data<Ftype>();
     Ftype* top_data = top[i]->mutable_cpu_data<Ftype>();
     for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+      if (int8) {
+        this->forward_cpu_gemm_s8(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+      } else {
+        this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+      }
       if (this->bias_term_) {
         const Ftype* bias = this->blobs_[1]->template cpu_data<Ftype>();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
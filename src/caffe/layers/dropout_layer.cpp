@@ -1,8 +1,11 @@
 // TODO (sergeyk): effect should not be dependent on phase. wasted memcpy.
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/dropout_layer.hpp"
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
@@ -24,6 +27,7 @@ void DropoutLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom,
   // Set up the cache for random number generation
   // ReshapeLike does not work because rand_vec_ is of Dtype uint
   rand_vec_.Reshape(bottom[0]->shape());
+  mask_bits_.Reshape(vector<int>(1, (bottom[0]->count() + 31) / 32));
 }
 
 template <typename Ftype, typename Btype>
@@ -31,14 +35,34 @@ void DropoutLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
     const vector<Blob*>& top) {
   const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
   Ftype* top_data = top[0]->mutable_cpu_data<Ftype>();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
-    // Create random numbers
-    caffe_rng_bernoulli<float>(count, 1. - threshold_, mask);
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
-    }
+    static_assert(4 * Philox4x32::kBatch == 32, "one Philox batch per mask word");
+    unsigned int* mask = mask_bits_.mutable_cpu_data();
+    // One draw from the Caffe RNG per pass keys the counter-based stream,
+    // so masks stay reproducible under Caffe::set_random_seed.
+    const Philox4x32 philox(Caffe::next_seed());
+    const unsigned int threshold = uint_thres_;
+    const float scale = scale_;
+    // Mask word w always comes from counters 8w .. 8w + 7, so the mask does
+    // not depend on how words are split across threads.
+    caffe_cpu_parallel_for(mask_bits_.count(), [&](int begin, int end) {
+      uint32_t r[32];
+      for (int w = begin; w < end; ++w) {
+        philox.Batch(0UL, static_cast<uint64_t>(w) * Philox4x32::kBatch, r);
+        unsigned int bits = 0U;
+        for (int b = 0; b < 32; ++b) {
+          bits |= static_cast<unsigned int>(r[b] > threshold) << b;
+        }
+        mask[w] = bits;
+        const int first = w * 32;
+        const int n = std::min(32, count - first);
+        for (int b = 0; b < n; ++b) {
+          top_data[first + b] = ((bits >> b) & 1U) ?
+              Ftype(bottom_data[first + b] * scale) : Ftype(0);
+        }
+      }
+    }, 64);
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
@@ -52,11 +76,20 @@ void DropoutLayer<Ftype, Btype>::Backward_cpu(const vector<Blob*>& top,
     const Btype* top_diff = top[0]->cpu_diff<Btype>();
     Btype* bottom_diff = bottom[0]->mutable_cpu_diff<Btype>();
     if (this->phase_ == TRAIN) {
-      const unsigned int* mask = rand_vec_.cpu_data();
+      const unsigned int* mask = mask_bits_.cpu_data();
       const int count = bottom[0]->count();
-      for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
-      }
+      const float scale = scale_;
+      caffe_cpu_parallel_for(mask_bits_.count(), [&](int begin, int end) {
+        for (int w = begin; w < end; ++w) {
+          const unsigned int bits = mask[w];
+          const int first = w * 32;
+          const int n = std::min(32, count - first);
+          for (int b = 0; b < n; ++b) {
+            bottom_diff[first + b] = ((bits >> b) & 1U) ?
+                Btype(top_diff[first + b] * scale) : Btype(0);
+          }
+        }
+      }, 64);
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
     }
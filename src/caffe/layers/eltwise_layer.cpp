@@ -41,6 +41,22 @@ void EltwiseLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom,
   }
 }
 
+template <typename Ftype, typename Btype>
+bool EltwiseLayer<Ftype, Btype>::ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top) {
+  // Bottoms which no longer match are left to Reshape to report
+  for (int i = 1; i < bottom.size(); ++i) {
+    if (bottom[i]->shape() != bottom[0]->shape()) {
+      return false;
+    }
+  }
+  top[0]->ReshapeLike(*bottom[0]);
+  if (op_ == EltwiseParameter_EltwiseOp_MAX && top.size() == 1) {
+    max_idx_.Reshape(bottom[0]->shape());
+  }
+  return true;
+}
+
 template <typename Ftype, typename Btype>
 void EltwiseLayer<Ftype, Btype>::Forward_cpu(
     const vector<Blob*>& bottom, const vector<Blob*>& top) {
@@ -3,6 +3,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -49,9 +50,11 @@ InnerProductLayer<Ftype, Btype>::LayerSetUp(const vector<Blob*>& bottom, const v
       shared_ptr<Filler<Ftype>> bias_filler(
           GetFiller<Ftype>(this->layer_param_.inner_product_param().bias_filler()));
       bias_filler->Fill(this->blobs_[1].get());
-      bias_multiplier_ = Blob::create<Ftype>(bias_shape);
     }
   }  // parameter initialization
+  if (bias_term_) {
+    bias_multiplier_ = Blob::create<Ftype>(vector<int>(1, N_));
+  }
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
 
@@ -79,14 +82,55 @@ InnerProductLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom, const vect
   }
 }
 
+template<typename Ftype, typename Btype>
+bool
+InnerProductLayer<Ftype, Btype>::ReshapeBatch(const vector<Blob*>& bottom,
+    const vector<Blob*>& top) {
+  const int axis = bottom[0]->CanonicalAxisIndex(this->layer_param_.inner_product_param().axis());
+  if (bottom[0]->count(axis) != K_) {
+    return false;
+  }
+  M_ = bottom[0]->count(0, axis);
+  vector<int> top_shape = bottom[0]->shape();
+  top_shape.resize(axis + 1);
+  top_shape[axis] = N_;
+  top[0]->Reshape(top_shape);
+  // The gemms read the first M_ ones, so the bias multiplier is refilled
+  // only when it grows
+  if (bias_term_ && bias_multiplier_->count() < M_) {
+    vector<int> bias_shape(1, M_);
+    bias_multiplier_->Reshape(bias_shape);
+    bias_multiplier_->set_data(1.F);
+  }
+  return true;
+}
+
 template<typename Ftype, typename Btype>
 void InnerProductLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
     const vector<Blob*>& top) {
   const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
   Ftype* top_data = top[0]->mutable_cpu_data<Ftype>();
   const Ftype* weight = this->blobs_[0]->template cpu_data<Ftype>();
-  caffe_cpu_gemm(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Ftype) 1.,
-      bottom_data, weight, (Ftype) 0., top_data);
+  const float input_scale = this->layer_param_.quantization_param().input_scale();
+  if (this->phase_ == TEST && input_scale > 0.F) {
+    // int8 inputs and weights (one scale per output), int32 accumulation
+    weights_s8_.Update(N_, K_, weight, this->blobs_[0]->data_version(), this->iter(),
+        transpose_);
+    input_s8_.resize(static_cast<size_t>(M_) * K_);
+    output_s32_.resize(static_cast<size_t>(M_) * N_);
+    caffe_cpu_quantize_s8(M_ * K_, bottom_data, input_scale, input_s8_.data());
+    caffe_cpu_gemm_s8(CblasTrans, M_, N_, K_, input_s8_.data(), weights_s8_.data(),
+        output_s32_.data());
+    const float* scales = weights_s8_.scales();
+    for (int i = 0; i < M_; ++i) {
+      for (int j = 0; j < N_; ++j) {
+        top_data[i * N_ + j] = static_cast<Ftype>(input_scale * scales[j] * output_s32_[i * N_ + j]);
+      }
+    }
+  } else {
+    caffe_cpu_gemm(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Ftype) 1.,
+        bottom_data, weight, (Ftype) 0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Ftype) 1.,
         bias_multiplier_->template cpu_data<Ftype>(), this->blobs_[1]->template cpu_data<Ftype>(),
@@ -1,10 +1,18 @@
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
+// Spatial positions per CrossChannelForward_cpu task; the running window of
+// squares for a block stays in L1 while the kernel walks the channels.
+const int kLRNSpatialBlock = 1024;
+
 template <typename Ftype, typename Btype>
 void LRNLayer<Ftype, Btype>::LayerSetUp(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {
@@ -107,48 +115,83 @@ void LRNLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
 template <typename Ftype, typename Btype>
 void LRNLayer<Ftype, Btype>::CrossChannelForward_cpu(
     const vector<Blob*>& bottom, const vector<Blob*>& top) {
+  // float16 is accumulated in float, float and double in their own precision
+  typedef typename std::conditional<std::is_same<Ftype, double>::value,
+      double, float>::type Mtype;
   const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
   Ftype* top_data = top[0]->mutable_cpu_data<Ftype>();
-  Ftype* scale_data = scale_.template mutable_cpu_data<Ftype>();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  TBlob<Ftype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Ftype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Ftype(0), padded_square_data);
-  Ftype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
-    }
-  }
+  // scale_ is only consumed by Backward, inference nets skip storing it
+  Ftype* scale_data = this->need_backward() ?
+      scale_.template mutable_cpu_data<Ftype>() : nullptr;
+  const int channels = channels_;
+  const int pre_pad = pre_pad_;
+  const int spatial = height_ * width_;
+  const int block = std::min(spatial, kLRNSpatialBlock);
+  const int blocks_per_image = (spatial + block - 1) / block;
+  const Mtype k = k_;
+  const Mtype alpha_over_size = Mtype(alpha_) / size_;
+  const Mtype neg_beta = -beta_;
+  const bool beta_075 = beta_ == 0.75F;
 
-  // In the end, compute output
-  caffe_powx(scale_.count(), scale_data, Ftype(-beta_), top_data);
-  caffe_mul(scale_.count(), top_data, bottom_data, top_data);
+  // Every task owns one image and a contiguous run of spatial positions and
+  // slides the window of squares across channels: add head, subtract tail.
+  caffe_cpu_parallel_for(num_ * blocks_per_image, [&](int begin, int end) {
+    vector<Mtype> window(block);
+    Mtype* sum = window.data();
+    for (int task = begin; task < end; ++task) {
+      const int n = task / blocks_per_image;
+      const int s0 = (task % blocks_per_image) * block;
+      const int len = std::min(block, spatial - s0);
+      const int image = n * channels * spatial + s0;
+      const Ftype* src = bottom_data + image;
+      std::fill(sum, sum + len, Mtype(0));
+      for (int c = 0; c < std::min(pre_pad, channels); ++c) {
+        const Ftype* head = src + c * spatial;
+        for (int i = 0; i < len; ++i) {
+          const Mtype x = head[i];
+          sum[i] += x * x;
+        }
+      }
+      for (int c = 0; c < channels; ++c) {
+        const int c_head = c + pre_pad;
+        const int c_tail = c - pre_pad - 1;
+        if (c_head < channels) {
+          const Ftype* head = src + c_head * spatial;
+          for (int i = 0; i < len; ++i) {
+            const Mtype x = head[i];
+            sum[i] += x * x;
+          }
+        }
+        if (c_tail >= 0) {
+          const Ftype* tail = src + c_tail * spatial;
+          for (int i = 0; i < len; ++i) {
+            const Mtype x = tail[i];
+            sum[i] -= x * x;
+          }
+        }
+        const Ftype* x = src + c * spatial;
+        Ftype* y = top_data + image + c * spatial;
+        if (scale_data != nullptr) {
+          Ftype* scale = scale_data + image + c * spatial;
+          for (int i = 0; i < len; ++i) {
+            scale[i] = k + alpha_over_size * sum[i];
+          }
+        }
+        if (beta_075) {
+          // s^-0.75 == 1 / (sqrt(s) * sqrt(sqrt(s)))
+          for (int i = 0; i < len; ++i) {
+            const Mtype r = std::sqrt(k + alpha_over_size * sum[i]);
+            y[i] = static_cast<Mtype>(x[i]) / (r * std::sqrt(r));
+          }
+        } else {
+          for (int i = 0; i < len; ++i) {
+            y[i] = static_cast<Mtype>(x[i]) *
+                std::pow(k + alpha_over_size * sum[i], neg_beta);
+          }
+        }
+      }
+    }
+  });
 }
 
 template <typename Ftype, typename Btype>
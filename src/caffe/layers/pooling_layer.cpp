@@ -4,6 +4,7 @@
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 namespace caffe {
 
@@ -123,101 +124,251 @@ void PoolingLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+template <typename Ftype, typename Btype>
+bool PoolingLayer<Ftype, Btype>::ReshapeBatch(const vector<Blob*>& bottom,
+      const vector<Blob*>& top) {
+  // The pooled size stays as long as the image size does
+  if (bottom[0]->num_axes() != 4 || bottom[0]->channels() != channels_ ||
+      bottom[0]->height() != height_ || bottom[0]->width() != width_) {
+    return false;
+  }
+  const int num = bottom[0]->num();
+  top[0]->Reshape(num, channels_, pooled_height_, pooled_width_);
+  if (top.size() > 1) {
+    top[1]->ReshapeLike(*top[0]);
+  }
+  if (is_max_pooling_ && top.size() == 1) {
+    max_idx_.Reshape(num, channels_, pooled_height_, pooled_width_);
+  }
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_STOCHASTIC) {
+    rand_idx_.Reshape(num, channels_, pooled_height_, pooled_width_);
+  }
+  return true;
+}
+
+// [lo, hi) range of pooled positions along one axis whose window lies
+// entirely inside the input, i.e. needs neither padding nor clipping.
+inline void pool_interior_range(int size, int kernel, int stride, int pad,
+    int pooled, int* lo, int* hi) {
+  *lo = min((pad + stride - 1) / stride, pooled);
+  *hi = size + pad - kernel >= 0 ? min((size + pad - kernel) / stride + 1, pooled) : 0;
+  *hi = max(*hi, *lo);
+}
+
+// Max pooling of count consecutive interior outputs with a KxK window and
+// stride 2 (the common 2x2/s2 and 3x3/s2 cases). There is no clipping and
+// the window loops unroll, which lets the compiler vectorize over the output
+// width.
+template <int K, typename Dtype>
+inline void pool_max_row_s2(const Dtype* src, const int width, Dtype* dst,
+    const int count) {
+  for (int pw = 0; pw < count; ++pw) {
+    const Dtype* window = src + 2 * pw;
+    Dtype val = -max_dtype<Dtype>();
+    for (int kh = 0; kh < K; ++kh) {
+      for (int kw = 0; kw < K; ++kw) {
+        const Dtype v = window[kh * width + kw];
+        val = v > val ? v : val;
+      }
+    }
+    dst[pw] = val;
+  }
+}
+
+template <typename Ftype, typename Btype>
+void PoolingLayer<Ftype, Btype>::ForwardMaxPlane_cpu(const Ftype* bottom_data,
+    Ftype* top_data) const {
+  if (global_pooling_) {
+    const int count = height_ * width_;
+    Ftype val = -max_dtype<Ftype>();
+    for (int i = 0; i < count; ++i) {
+      val = bottom_data[i] > val ? bottom_data[i] : val;
+    }
+    top_data[0] = val;
+    return;
+  }
+  auto pool_one = [this, bottom_data](int ph, int pw) {
+    int hstart = ph * stride_h_ - pad_h_;
+    int wstart = pw * stride_w_ - pad_w_;
+    const int hend = min(hstart + kernel_h_, height_);
+    const int wend = min(wstart + kernel_w_, width_);
+    hstart = max(hstart, 0);
+    wstart = max(wstart, 0);
+    Ftype val = -max_dtype<Ftype>();
+    for (int h = hstart; h < hend; ++h) {
+      for (int w = wstart; w < wend; ++w) {
+        const Ftype v = bottom_data[h * width_ + w];
+        val = v > val ? v : val;
+      }
+    }
+    return val;
+  };
+  int ph_lo, ph_hi, pw_lo, pw_hi;
+  pool_interior_range(height_, kernel_h_, stride_h_, pad_h_, pooled_height_, &ph_lo, &ph_hi);
+  pool_interior_range(width_, kernel_w_, stride_w_, pad_w_, pooled_width_, &pw_lo, &pw_hi);
+  const bool square_s2 = stride_h_ == 2 && stride_w_ == 2 && kernel_h_ == kernel_w_;
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    Ftype* top_row = top_data + ph * pooled_width_;
+    if (ph < ph_lo || ph >= ph_hi) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        top_row[pw] = pool_one(ph, pw);
+      }
+      continue;
+    }
+    for (int pw = 0; pw < pw_lo; ++pw) {
+      top_row[pw] = pool_one(ph, pw);
+    }
+    const Ftype* src = bottom_data + (ph * stride_h_ - pad_h_) * width_
+        + pw_lo * stride_w_ - pad_w_;
+    if (square_s2 && kernel_w_ == 2) {
+      pool_max_row_s2<2>(src, width_, top_row + pw_lo, pw_hi - pw_lo);
+    } else if (square_s2 && kernel_w_ == 3) {
+      pool_max_row_s2<3>(src, width_, top_row + pw_lo, pw_hi - pw_lo);
+    } else {
+      for (int pw = pw_lo; pw < pw_hi; ++pw, src += stride_w_) {
+        Ftype val = -max_dtype<Ftype>();
+        for (int kh = 0; kh < kernel_h_; ++kh) {
+          for (int kw = 0; kw < kernel_w_; ++kw) {
+            const Ftype v = src[kh * width_ + kw];
+            val = v > val ? v : val;
+          }
+        }
+        top_row[pw] = val;
+      }
+    }
+    for (int pw = pw_hi; pw < pooled_width_; ++pw) {
+      top_row[pw] = pool_one(ph, pw);
+    }
+  }
+}
+
+template <typename Ftype, typename Btype>
+template <typename Mtype>
+void PoolingLayer<Ftype, Btype>::ForwardMaxMaskPlane_cpu(const Ftype* bottom_data,
+    Ftype* top_data, Mtype* mask) const {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      const int hend = min(hstart + kernel_h_, height_);
+      const int wend = min(wstart + kernel_w_, width_);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      Ftype val = -max_dtype<Ftype>();
+      int max_index = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          if (bottom_data[index] > val) {
+            val = bottom_data[index];
+            max_index = index;
+          }
+        }
+      }
+      const int pool_index = ph * pooled_width_ + pw;
+      top_data[pool_index] = val;
+      mask[pool_index] = static_cast<Mtype>(max_index);
+    }
+  }
+}
+
+template <typename Ftype, typename Btype>
+void PoolingLayer<Ftype, Btype>::ForwardAvePlane_cpu(const Ftype* bottom_data,
+    Ftype* top_data) const {
+  if (global_pooling_) {
+    const int count = height_ * width_;
+    Ftype sum = Ftype(0);
+    for (int i = 0; i < count; ++i) {
+      sum += bottom_data[i];
+    }
+    top_data[0] = sum / count;
+    return;
+  }
+  int ph_lo, ph_hi, pw_lo, pw_hi;
+  pool_interior_range(height_, kernel_h_, stride_h_, pad_h_, pooled_height_, &ph_lo, &ph_hi);
+  pool_interior_range(width_, kernel_w_, stride_w_, pad_w_, pooled_width_, &pw_lo, &pw_hi);
+  const int interior_pool_size = kernel_h_ * kernel_w_;
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const bool interior_row = ph >= ph_lo && ph < ph_hi;
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      Ftype sum = Ftype(0);
+      if (interior_row && pw >= pw_lo && pw < pw_hi) {
+        const Ftype* src = bottom_data + hstart * width_ + wstart;
+        for (int kh = 0; kh < kernel_h_; ++kh) {
+          for (int kw = 0; kw < kernel_w_; ++kw) {
+            sum += src[kh * width_ + kw];
+          }
+        }
+        top_data[ph * pooled_width_ + pw] = sum / interior_pool_size;
+        continue;
+      }
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      const int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          sum += bottom_data[h * width_ + w];
+        }
+      }
+      top_data[ph * pooled_width_ + pw] = sum / pool_size;
+    }
+  }
+}
+
+// Every (num, channel) plane is pooled independently, so planes are spread
+// over the CPU worker pool.
 template <typename Ftype, typename Btype>
 void PoolingLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {
   const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
   Ftype* top_data = top[0]->mutable_cpu_data<Ftype>();
-  const int top_count = top[0]->count();
+  const int planes = bottom[0]->num() * channels_;
+  const int bottom_step = bottom[0]->offset(0, 1);
+  const int top_step = top[0]->offset(0, 1);
+  const int grain = max(1, 16384 / max(1, bottom_step));
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitalized variables
+  // The internal argmax mask is only read by Backward: don't write it
+  // when the net never back-propagates through this layer (TEST phase).
+  const bool use_mask = !use_top_mask && this->need_backward();
   Ftype* top_mask = NULL;
+  int* mask = NULL;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data<Ftype>();
-      caffe_set(top_count, Ftype(-1), top_mask);
-    } else {
+    } else if (use_mask) {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
     }
-    caffe_set(top_count, -max_dtype<Ftype>(), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Ftype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+    caffe_cpu_parallel_for(planes, [&](int begin, int end) {
+      for (int p = begin; p < end; ++p) {
         if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
+          ForwardMaxMaskPlane_cpu(bottom_data + p * bottom_step, top_data + p * top_step,
+              top_mask + p * top_step);
+        } else if (use_mask) {
+          ForwardMaxMaskPlane_cpu(bottom_data + p * bottom_step, top_data + p * top_step,
+              mask + p * top_step);
         } else {
-          mask += top[0]->offset(0, 1);
+          ForwardMaxPlane_cpu(bottom_data + p * bottom_step, top_data + p * top_step);
         }
       }
-    }
+    }, grain);
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+    caffe_cpu_parallel_for(planes, [&](int begin, int end) {
+      for (int p = begin; p < end; ++p) {
+        ForwardAvePlane_cpu(bottom_data + p * bottom_step, top_data + p * top_step);
       }
-    }
+    }, grain);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -235,46 +386,43 @@ void PoolingLayer<Ftype, Btype>::Backward_cpu(const vector<Blob*>& top,
   }
   const Btype* top_diff = top[0]->cpu_diff<Btype>();
   Btype* bottom_diff = bottom[0]->mutable_cpu_diff<Btype>();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
-  caffe_set(bottom[0]->count(), Btype(0), bottom_diff);
+  const int planes = top[0]->num() * channels_;
+  const int bottom_step = bottom[0]->offset(0, 1);
+  const int top_step = top[0]->offset(0, 1);
+  const int grain = max(1, 16384 / max(1, bottom_step));
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Btype* top_mask = NULL;
+  // Different pooling methods. We explicitly do the switch outside the for
+  // loop to save time, although this results in more codes.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // The main loop
     if (use_top_mask) {
       top_mask = top[1]->cpu_data<Btype>();
     } else {
       mask = max_idx_.cpu_data();
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? static_cast<int>(top_mask[index]) :
-                static_cast<int>(mask[index]);
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
+    caffe_cpu_parallel_for(planes, [&](int begin, int end) {
+      for (int p = begin; p < end; ++p) {
+        Btype* plane_diff = bottom_diff + p * bottom_step;
+        const Btype* plane_top_diff = top_diff + p * top_step;
+        caffe_set(bottom_step, Btype(0), plane_diff);
+        for (int index = 0; index < top_step; ++index) {
+          const int bottom_index = use_top_mask ?
+              static_cast<int>(top_mask[p * top_step + index]) :
+              mask[p * top_step + index];
+          plane_diff[bottom_index] += plane_top_diff[index];
         }
       }
-    }
+    }, grain);
     break;
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
+    caffe_cpu_parallel_for(planes, [&](int begin, int end) {
+      for (int p = begin; p < end; ++p) {
+        Btype* plane_diff = bottom_diff + p * bottom_step;
+        const Btype* plane_top_diff = top_diff + p * top_step;
+        caffe_set(bottom_step, Btype(0), plane_diff);
         for (int ph = 0; ph < pooled_height_; ++ph) {
           for (int pw = 0; pw < pooled_width_; ++pw) {
             int hstart = ph * stride_h_ - pad_h_;
@@ -286,19 +434,16 @@ void PoolingLayer<Ftype, Btype>::Backward_cpu(const vector<Blob*>& top,
             wstart = max(wstart, 0);
             hend = min(hend, height_);
             wend = min(wend, width_);
+            const Btype grad = plane_top_diff[ph * pooled_width_ + pw] / pool_size;
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
+                plane_diff[h * width_ + w] += grad;
               }
             }
           }
         }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
       }
-    }
+    }, grain);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -308,7 +453,6 @@ void PoolingLayer<Ftype, Btype>::Backward_cpu(const vector<Blob*>& top,
   }
 }
 
-
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
 #endif
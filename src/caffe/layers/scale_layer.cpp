@@ -56,8 +56,13 @@ void ScaleLayer<Ftype, Btype>::LayerSetUp(const vector<Blob*>& bottom,
     bias_layer_ = LayerRegistry::CreateLayer(layer_param);
     bias_bottom_vec_.resize(1);
     bias_bottom_vec_[0] = bottom[0];
+    // Blobs given to this layer end with the bias, which the bias layer takes
+    const bool has_bias_blob = this->blobs_.size() > (bottom.size() == 1 ? 1 : 0);
+    if (has_bias_blob) {
+      bias_layer_->blobs().assign(1, this->blobs_.back());
+    }
     bias_layer_->SetUp(bias_bottom_vec_, top);
-    bias_param_id_ = this->blobs_.size();
+    bias_param_id_ = this->blobs_.size() - (has_bias_blob ? 1 : 0);
     this->blobs_.resize(bias_param_id_ + 1);
     this->blobs_[bias_param_id_] = bias_layer_->blobs()[0];
     bias_propagate_down_.resize(1, false);
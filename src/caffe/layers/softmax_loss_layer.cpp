@@ -95,7 +95,8 @@ template <typename Ftype, typename Btype>
 void SoftmaxWithLossLayer<Ftype, Btype>::Forward_cpu(
     const vector<Blob*>& bottom, const vector<Blob*>& top) {
   // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+  caffe_cpu_softmax(outer_num_, bottom[0]->shape(softmax_axis_), inner_num_,
+      bottom[0]->cpu_data<Ftype>(), prob_->template mutable_cpu_data<Ftype>());
   const Ftype* prob_data = prob_->template cpu_data<Ftype>();
   const Ftype* label = bottom[1]->cpu_data<Ftype>();
   int dim = prob_->count() / outer_num_;
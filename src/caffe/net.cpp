@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <map>
 #include <set>
 #include <boost/thread.hpp>
@@ -14,6 +16,9 @@
 #include "caffe/util/gpu_memory.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/rng.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -29,6 +34,7 @@ Net::Net(const NetParameter& param,
     Flag* solver_iter0_flag,
     const Net* root_net)
     : root_net_(root_net),
+      weights_net_(nullptr),
       solver_(nullptr),
       solver_rank_(solver_rank),
       solver_init_flag_(solver_init_flag),
@@ -43,6 +49,7 @@ Net::Net(const string& param_file,
     Flag* solver_iter0_flag,
     const Net* root_net)
     : root_net_(root_net),
+      weights_net_(nullptr),
       solver_(nullptr),
       solver_rank_(solver_rank),
       solver_init_flag_(solver_init_flag),
@@ -53,6 +60,18 @@ Net::Net(const string& param_file,
   Init(param);
 }
 
+Net::Net(const Net* weights_net)
+    : root_net_(nullptr),
+      weights_net_(weights_net),
+      solver_(nullptr),
+      solver_rank_(0U),
+      solver_init_flag_(nullptr),
+      solver_iter0_flag_(nullptr) {
+  CHECK(!weights_net->has_deferred_layers())
+      << "Layers can only be shared once their blobs are read: call LoadDeferredLayers";
+  Init(weights_net->net_param());
+}
+
 Net::~Net() {
 }
 
@@ -238,6 +257,18 @@ void Net::Init(const NetParameter& in_param) {
             << layer_param.name();
       }
     } else {
+      if (weights_net_ != nullptr && weights_net_->has_layer(layer_param.name())) {
+        // Layers holding blobs already skip their fillers
+        const vector<shared_ptr<Blob>>& source_blobs =
+            weights_net_->layer_by_name(layer_param.name())->blobs();
+        vector<shared_ptr<Blob>>& blobs = layers_[layer_id]->blobs();
+        blobs.clear();
+        for (const shared_ptr<Blob>& source_blob : source_blobs) {
+          blobs.push_back(Blob::create(source_blob->data_type(), source_blob->diff_type()));
+          blobs.back()->Reshape(source_blob->shape());
+          blobs.back()->ShareData(*source_blob);
+        }
+      }
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
     LOG_IF(INFO, Caffe::root_solver())
@@ -359,6 +390,9 @@ void Net::Init(const NetParameter& in_param) {
       }
     }
   }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layers_[layer_id]->set_need_backward(layer_need_backward_[layer_id]);
+  }
   // In the end, all remaining blobs are considered output blobs.
   for (set<string>::iterator it = available_blobs.begin();
       it != available_blobs.end(); ++it) {
@@ -381,9 +415,9 @@ void Net::Init(const NetParameter& in_param) {
     layer_index_params_[param_layer_indices_[i]] = i;
   }
 
-#ifndef CPU_ONLY
   learnable_space_count_ = 0UL;
   reduce_buckets_ = (size_t) in_param.reduce_buckets();
+#ifndef CPU_ONLY
   LOG_IF(INFO, Caffe::root_solver())
       << "Top memory (" << Phase_Name(phase_) << ") required for data: "
       << gpu_top_memory_data_use_ << " diff: " << gpu_top_memory_diff_use_;
@@ -401,7 +435,66 @@ void Net::Init(const NetParameter& in_param) {
           << gpu_shp_memory_data_use_ << " diff: " << gpu_shp_memory_diff_use_;
 #endif
   debug_info_ = param.debug_info();
-  trained_layers_shared_ = false;
+  trained_layers_shared_ = weights_net_ != nullptr;
+  share_activation_memory_ = param.share_activation_memory();
+  activation_plan_pending_ = share_activation_memory_;
+  full_forward_done_ = false;
+  share_diff_memory_ = param.share_diff_memory();
+  diff_plan_pending_ = share_diff_memory_;
+  full_backward_done_ = false;
+  recompute_segment_of_.assign(layers_.size(), -1);
+  vector<int> producer(blobs_.size(), -1);
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    for (int blob_id : top_id_vecs_[layer_id]) {
+      producer[blob_id] = layer_id;
+    }
+  }
+  for (const RecomputeSegment& segment : in_param.recompute_segment()) {
+    CHECK(has_layer(segment.first_layer()))
+        << "Unknown recompute segment layer " << segment.first_layer();
+    CHECK(has_layer(segment.last_layer()))
+        << "Unknown recompute segment layer " << segment.last_layer();
+    const int first = layer_names_index_[segment.first_layer()];
+    const int last = layer_names_index_[segment.last_layer()];
+    CHECK_LE(first, last) << "Recompute segment " << segment.first_layer()
+        << " .. " << segment.last_layer() << " is empty";
+    CHECK(recompute_ranges_.empty() || recompute_ranges_.back().last < first)
+        << "Recompute segments must be ordered and disjoint";
+    for (int layer_id = first; layer_id <= last; ++layer_id) {
+      CHECK(!bottom_vecs_[layer_id].empty()) << "Layer " << layer_names_[layer_id]
+          << " without bottoms can't be recomputed";
+      recompute_segment_of_[layer_id] = recompute_ranges_.size();
+    }
+    recompute_ranges_.emplace_back(first, last);
+    // An in-place layer on a blob from before the segment overwrites a value
+    // which is kept, not recomputed: the rerun has to start from a copy
+    RecomputeRange& range = recompute_ranges_.back();
+    for (int layer_id = first; layer_id <= last; ++layer_id) {
+      for (int blob_id : top_id_vecs_[layer_id]) {
+        const vector<int>& bottoms = bottom_id_vecs_[layer_id];
+        if (producer[blob_id] < first &&
+            std::find(bottoms.begin(), bottoms.end(), blob_id) != bottoms.end() &&
+            std::find(range.inputs.begin(), range.inputs.end(), blob_id) == range.inputs.end()) {
+          range.inputs.push_back(blob_id);
+          range.saved_inputs.push_back(
+              Blob::create(blobs_[blob_id]->data_type(), blobs_[blob_id]->diff_type()));
+        }
+      }
+    }
+  }
+  recompute_plan_pending_ = !recompute_ranges_.empty();
+  BuildLayerGraph();
+  int inter_op_threads = param.inter_op_threads();
+  CHECK_GE(inter_op_threads, 0) << "inter_op_threads can't be negative";
+  if (inter_op_threads == 0) {
+    inter_op_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  inter_op_graph_.reset();
+  if (inter_op_threads > 1) {
+    inter_op_graph_ = make_shared<TaskGraph>(inter_op_threads);
+    layer_losses_.assign(layers_.size(), 0.F);
+    layer_active_.assign(layers_.size(), false);
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -605,6 +698,7 @@ void Net::AppendParam(const NetParameter& param, const int layer_id, const int p
     const int learnable_param_id = learnable_params_.size();
     learnable_params_.push_back(params_[net_param_id]);
     learnable_param_ids_.push_back(learnable_param_id);
+    learnable_param_names_.push_back(layer_names_[layer_id] + "/" + param_display_names_.back());
     has_params_lr_.push_back(param_spec->has_lr_mult());
     has_params_decay_.push_back(param_spec->has_decay_mult());
     params_lr_.push_back(param_spec->lr_mult());
@@ -670,19 +764,146 @@ void Net::AppendParam(const NetParameter& param, const int layer_id, const int p
 float Net::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  const bool full_pass = start == 0 && end == layers_.size() - 1;
+  // Layers sharing data in Forward are only seen aliased after a full pass
+  if (full_pass && full_forward_done_ && activation_plan_pending_) {
+    PlanActivationMemory();
+  }
+  if (full_pass && full_forward_done_ && recompute_plan_pending_) {
+    PlanRecomputeMemory();
+  }
+  if (inter_op_graph_ && !debug_info_ && Caffe::mode() == Caffe::CPU
+      && !activation_arena_ && recompute_ranges_.empty()) {
+    const float loss = ForwardFromToParallel(start, end);
+    full_forward_done_ = full_forward_done_ || full_pass;
+    ++infer_count_;
+    return loss;
+  }
   float loss = 0;
   for (int i = start; i <= end; ++i) {
+    const int segment = recompute_segment_of_[i];
+    if (segment >= 0 && recompute_ranges_[segment].first == i) {
+      // Random state this segment's Forward begins with, replayed by recompute
+      RecomputeRange& range = recompute_ranges_[segment];
+      *static_cast<rng_t*>(range.rng.generator()) = *caffe_rng();
+      range.counter_rng = Caffe::counter_rng();
+      for (int j = 0; recompute_arena_ && j < range.inputs.size(); ++j) {
+        range.saved_inputs[j]->CopyFrom(*blobs_[range.inputs[j]], false, true);
+      }
+    }
     // LOG(INFO) << " ****** [Forward] (" << i << ") Layer '" << layer_names_[i];
     // << "' FT " << Type_Name(layers_[i]->forward_type())
     // << " BT " << Type_Name(layers_[i]->backward_type());
-    float layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    float layer_loss = ForwardLayer(i);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  full_forward_done_ = full_forward_done_ || full_pass;
   ++infer_count_;
   return loss;
 }
 
+float Net::ForwardFromToParallel(int start, int end) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    layer_active_[i] = i >= start && i <= end;
+    layer_losses_[i] = 0.F;
+  }
+  // Workers get the thread-local state of the calling thread
+  const Caffe::Brew mode = Caffe::mode();
+  const int solver_count = Caffe::solver_count();
+  const bool root_solver = Caffe::root_solver();
+  const int core_group = caffe_cpu_core_group();
+  // Per layer random streams keep results independent of the schedule.
+  // This thread runs layers too, so its own state is put back afterwards.
+  const uint64_t seed = Caffe::next_seed();
+  const rng_t rng = *caffe_rng();
+  const CounterRNG counter_rng = Caffe::counter_rng();
+  inter_op_graph_->Run(layer_successors_, layer_active_, [&](int i) {
+    Caffe::set_mode(mode);
+    Caffe::set_solver_count(solver_count);
+    Caffe::set_root_solver(root_solver);
+    if (caffe_cpu_core_group() != core_group) {
+      caffe_cpu_join_core_group(core_group);
+    }
+    CounterRNG stream = CounterRNG(seed).Split(i);
+    *caffe_rng() = rng_t(static_cast<uint32_t>(stream.Next64()));
+    Caffe::counter_rng() = stream;
+    layer_losses_[i] = ForwardLayer(i);
+  });
+  *caffe_rng() = rng;
+  Caffe::counter_rng() = counter_rng;
+  float loss = 0;
+  for (int i = start; i <= end; ++i) {
+    loss += layer_losses_[i];
+  }
+  return loss;
+}
+
+float Net::ForwardLayer(int i) {
+  if (!deferred_layers_.empty() && deferred_layers_[i].length > 0) {
+    LoadDeferredLayer(i);
+  }
+  Profiler& profiler = Profiler::Get();
+  if (!profiler.enabled()) {
+    return layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+  }
+  const int64_t begin_us = profiler.Now();
+  const float loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+  profiler.Record("forward", layer_names_[i], begin_us, profiler.Now(),
+      layers_[i]->ForwardFlops(bottom_vecs_[i], top_vecs_[i]),
+      layers_[i]->ForwardBytes(bottom_vecs_[i], top_vecs_[i]));
+  return loss;
+}
+
+void Net::BackwardLayer(int i) {
+  Profiler& profiler = Profiler::Get();
+  if (!profiler.enabled()) {
+    layers_[i]->Backward(top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+    return;
+  }
+  const int64_t begin_us = profiler.Now();
+  layers_[i]->Backward(top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+  profiler.Record("backward", layer_names_[i], begin_us, profiler.Now(),
+      layers_[i]->BackwardFlops(top_vecs_[i], bottom_vecs_[i]),
+      layers_[i]->BackwardBytes(top_vecs_[i], bottom_vecs_[i]));
+}
+
+void Net::BuildLayerGraph() {
+  const int num_blobs = blobs_.size();
+  vector<int> last_writer(num_blobs, -1);
+  vector<vector<int>> readers(num_blobs);
+  layer_successors_.assign(layers_.size(), vector<int>());
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int blob_id : bottom_id_vecs_[i]) {
+      if (last_writer[blob_id] >= 0) {
+        layer_successors_[last_writer[blob_id]].push_back(i);
+      }
+    }
+    for (int blob_id : top_id_vecs_[i]) {
+      if (last_writer[blob_id] >= 0) {
+        layer_successors_[last_writer[blob_id]].push_back(i);
+      }
+      for (int reader : readers[blob_id]) {
+        layer_successors_[reader].push_back(i);
+      }
+    }
+    for (int blob_id : bottom_id_vecs_[i]) {
+      readers[blob_id].push_back(i);
+    }
+    for (int blob_id : top_id_vecs_[i]) {
+      last_writer[blob_id] = i;
+      readers[blob_id].clear();
+    }
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    vector<int>& successors = layer_successors_[i];
+    std::sort(successors.begin(), successors.end());
+    successors.erase(std::unique(successors.begin(), successors.end()), successors.end());
+    // In-place layers read and write the same blob
+    successors.erase(std::remove(successors.begin(), successors.end(), i), successors.end());
+  }
+}
+
 float Net::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
 }
@@ -724,12 +945,23 @@ void Net::BackwardFromTo(int start, int end) {
 void Net::BackwardFromToAu(int start, int end, bool apply_update) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  const bool full_pass = start == layers_.size() - 1 && end == 0;
+  // Layers sharing diffs in Backward are only seen aliased after a full pass
+  if (full_pass && full_backward_done_ && diff_plan_pending_) {
+    PlanDiffMemory();
+  }
+  int recomputed = -1;
   for (int i = start; i >= end; --i) {
+    const int segment = recompute_segment_of_[i];
+    if (recompute_arena_ && segment >= 0 && segment != recomputed) {
+      RecomputeSegmentForward(segment);
+      recomputed = segment;
+    }
     if (!layer_need_backward_[i]) {
       continue;
     }
 
-    layers_[i]->Backward(top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+    BackwardLayer(i);
 
     if (debug_info_) {
       BackwardDebugInfo(i);
@@ -747,6 +979,7 @@ void Net::BackwardFromToAu(int start, int end, bool apply_update) {
       }  // leave it to the owner otherwise
     }
   }
+  full_backward_done_ = full_backward_done_ || full_pass;
   if (apply_update) {
     reduction_queue_.push(END_OF_ITERATION);
   }
@@ -758,10 +991,11 @@ void Net::Finalize() {
 
 void Net::ReduceAndUpdate() {
 #ifndef CPU_ONLY
+  const bool gpu = Caffe::mode() == Caffe::GPU;
   cublasHandle_t handle = nullptr;
   if (Caffe::solver_count() > 1) {
     handle = solver_->callback()->cublas_handle();
-  } else {
+  } else if (gpu) {
     handle = Caffe::cublas_handle();
   }
 #else
@@ -769,8 +1003,11 @@ void Net::ReduceAndUpdate() {
 #endif
 
 #ifndef CPU_ONLY
-  cudaStream_t stream;
-  CUBLAS_CHECK(cublasGetStream(handle, &stream));
+  cudaStream_t stream = nullptr;
+  if (gpu) {
+    CUBLAS_CHECK(cublasGetStream(handle, &stream));
+  }
+#endif
   int max_params_per_bucket = 0;
   size_t bucket_space_count = 0UL;
   if (Caffe::solver_count() > 1) {
@@ -786,43 +1023,41 @@ void Net::ReduceAndUpdate() {
   int id_from = -1, id_to = -1;
   size_t received_count = 0U;
   std::list<int> au_ids;
-#endif
   const bool clear_grads = !solver_->param().snapshot_diff();
   while (true) {
     int param_id = reduction_queue_.pop();
     SolverAction::Enum request = solver_->GetRequestedAction();
     if (SolverAction::STOP == request) {
 #ifndef CPU_ONLY
-      CUDA_CHECK(cudaStreamSynchronize(stream));
+      if (gpu) {
+        CUDA_CHECK(cudaStreamSynchronize(stream));
+      }
 #endif
       solver_->request_early_exit();
       break;
     }
     if (param_id == END_OF_BATCH) {
 #ifndef CPU_ONLY
-      CUDA_CHECK(cudaStreamSynchronize(stream));
+      if (gpu) {
+        CUDA_CHECK(cudaStreamSynchronize(stream));
+      }
 #endif
       break;
     }
-    if (param_id != END_OF_ITERATION) {
+    if (param_id != END_OF_ITERATION &&
+        (Caffe::solver_count() == 1 || max_params_per_bucket == 1)) {
       if (Caffe::solver_count() > 1) {
-#ifndef CPU_ONLY
-        if (max_params_per_bucket == 1) {
-          Reduce(param_id);
-        }
-#else
-        NO_GPU;
-#endif
-      } else {
-        if (global_grad_scale_ != 1.F) {
-          this->learnable_params()[param_id]->scale_diff(1.F / global_grad_scale_, handle, true);
-        }
-        solver_->ApplyUpdate(param_id, handle, clear_grads);
-        continue;
+        // One parameter per bucket: reduce it right away
+        Reduce(param_id);
+      }
+      ProfileScope scope("update", learnable_param_names_[param_id]);
+      if (global_grad_scale_ != 1.F) {
+        this->learnable_params()[param_id]->scale_diff(1.F / global_grad_scale_, handle, true);
       }
+      solver_->ApplyUpdate(param_id, handle, clear_grads);
+      continue;
     }
 
-#ifndef CPU_ONLY
     if (learnable_params_.size() > 0 && Caffe::solver_count() > 1) {
       // Is bucket big enough? Done with iteration? Next param_id doesn't fit?
       // Type changed?
@@ -840,6 +1075,7 @@ void Net::ReduceAndUpdate() {
         ReduceBucket(count, dtype, learnable_params_ptrs_[id_from]);
 
         for (int i : au_ids) {
+          ProfileScope scope("update", learnable_param_names_[i]);
           if (global_grad_scale_ != 1.F) {
             this->learnable_params()[i]->scale_diff(1.F / global_grad_scale_, handle, true);
           }
@@ -863,23 +1099,36 @@ void Net::ReduceAndUpdate() {
         au_ids.emplace_back(param_id);
       }
     }
-#endif
 
     if (param_id == END_OF_ITERATION) {
 #ifndef CPU_ONLY
-      CUDA_CHECK(cudaStreamSynchronize(stream));
+      if (gpu) {
+        CUDA_CHECK(cudaStreamSynchronize(stream));
+      }
+#endif
       received_count = 0U;
       id_from = id_to = -1;
       au_ids.clear();
-#endif
       solver_->iteration_complete_signal();
     }
   }
   DLOG(INFO) << "[" << Caffe::current_device() << "] Leaving ReduceAndUpdate thread";
 }
 
-#ifndef CPU_ONLY
 void Net::Reduce(int param_id) {
+  ProfileScope scope("reduce", learnable_param_names_[param_id]);
+  if (Caffe::mode() == Caffe::CPU) {
+    // The callback synchronizes the replicas itself
+    const shared_ptr<Blob>& param = this->learnable_params()[param_id];
+    if (compress_gradients(param->diff_type())) {
+      AllreduceCompressed(param->count(), param->mutable_cpu_diff<float>());
+    } else {
+      solver_->callback()->allreduce(param_id);
+    }
+    param->scale_diff(1.F / Caffe::solver_count());
+    return;
+  }
+#ifndef CPU_ONLY
   solver_->callback()->reduce_barrier();
   {
     unique_ptr<unique_lock<shared_mutex>> lock;
@@ -896,9 +1145,24 @@ void Net::Reduce(int param_id) {
   // until all have completed, but the current nature of
   // NCCL makes this unnecessary.
   // solver_->callback()->reduce_barrier();
+#else
+  NO_GPU;
+#endif
 }
 
 void Net::ReduceBucket(size_t count, Type bucket_type, void* bucket) {
+  static const string kBucket("bucket");
+  ProfileScope scope("reduce", kBucket);
+  if (Caffe::mode() == Caffe::CPU) {
+    if (compress_gradients(bucket_type)) {
+      AllreduceCompressed(count, static_cast<float*>(bucket));
+    } else {
+      solver_->callback()->allreduce_bucket(count, bucket, bucket_type);
+    }
+    Tensor::cpu_scal(count, bucket_type, bucket, 1.F / Caffe::solver_count());
+    return;
+  }
+#ifndef CPU_ONLY
   solver_->callback()->reduce_barrier();
   {
     unique_ptr<unique_lock<shared_mutex>> lock;
@@ -911,8 +1175,55 @@ void Net::ReduceBucket(size_t count, Type bucket_type, void* bucket) {
   }
   Tensor::gpu_scal(count, bucket_type, bucket, 1.F / Caffe::solver_count(),
       solver_->callback()->cublas_handle(), true);
+#else
+  NO_GPU;
+#endif
 }
+
+bool Net::compress_gradients(Type type) const {
+  return solver_->param().gradient_compression().method() !=
+      GradientCompressionParameter_Method_NONE && is_type<float>(type);
+}
+
+void Net::AllreduceCompressed(int count, float* bucket) {
+  const GradientCompressionParameter& param = solver_->param().gradient_compression();
+  Solver::Callback* callback = solver_->callback();
+  if (param.method() == GradientCompressionParameter_Method_FP16) {
+#ifndef CPU_ONLY
+    compression_half_.resize(count);
+    caffe_cpu_convert(count, bucket, compression_half_.data());
+    callback->allreduce_bucket(count, compression_half_.data(), tp<float16>());
+    caffe_cpu_convert(count, compression_half_.data(), bucket);
+#else
+    // No float16 to sum in: every solver's halves are gathered and summed as float
+    half_send_.resize(count);
+    half_recv_.resize(static_cast<size_t>(count) * Caffe::solver_count());
+    caffe_cpu_half_compress(count, bucket, half_send_.data());
+    callback->allgather_bucket(half_send_.data(), count * sizeof(uint16_t), half_recv_.data());
+    caffe_cpu_half_accumulate(count, Caffe::solver_count(), half_recv_.data(), bucket);
 #endif
+    return;
+  }
+  CHECK_GT(param.topk_ratio(), 0.F);
+  CHECK_LE(param.topk_ratio(), 1.F);
+  CHECK(learnable_cpu_space_) << "Top-k gradient compression needs the learnable space";
+  if (compression_residual_.empty()) {
+    compression_residual_.resize(learnable_cpu_space_->size() / sizeof(float), 0.F);
+  }
+  // Residuals are laid out as the learnable space the buckets live in
+  const size_t offset = (reinterpret_cast<const char*>(bucket) -
+      static_cast<const char*>(learnable_cpu_space_->cpu_data())) / sizeof(float);
+  CHECK_LE(offset + count, compression_residual_.size());
+  const int k = std::min(count,
+      std::max(1, static_cast<int>(std::ceil(param.topk_ratio() * count))));
+  sparse_send_.resize(k);
+  sparse_recv_.resize(k * Caffe::solver_count());
+  caffe_cpu_topk_compress(count, bucket, compression_residual_.data() + offset, k,
+      sparse_send_.data());
+  callback->allgather_bucket(sparse_send_.data(), k * sizeof(SparseGradient),
+      sparse_recv_.data());
+  caffe_cpu_sparse_accumulate(count, sparse_recv_.size(), sparse_recv_.data(), bucket);
+}
 
 void Net::ForwardDebugInfo(const int layer_id) {
   LOG_IF(INFO, Caffe::root_solver())
@@ -991,6 +1302,8 @@ void Net::UpdateDebugInfo(const int param_id) {
 }
 
 void Net::ShareTrainedLayersWith(const Net* other) {
+  CHECK(!other->has_deferred_layers())
+      << "Layers can only be shared once their blobs are read: call LoadDeferredLayers";
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     LayerBase* source_layer = other->layers()[i].get();
@@ -1018,6 +1331,9 @@ void Net::ShareTrainedLayersWith(const Net* other) {
           << target_blobs[j]->shape_string();
       target_blobs[j]->ShareData(*source_blob);
     }
+    if (!deferred_layers_.empty()) {
+      deferred_layers_[target_layer_id].length = 0;
+    }
   }
   trained_layers_shared_ = true;
 }
@@ -1049,89 +1365,619 @@ void Net::Backward(bool apply_update) {
 }
 
 void Net::Reshape() {
+  ReshapeLayers(false);
+}
+
+void Net::ReshapeLayers(bool batch_only) {
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    if (!batch_only || !layers_[i]->ReshapeBatch(bottom_vecs_[i], top_vecs_[i])) {
+      layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    }
   }
+  activation_plan_pending_ = share_activation_memory_ && !ActivationPlanFits();
+  diff_plan_pending_ = share_diff_memory_;
+  recompute_plan_pending_ = !recompute_ranges_.empty();
 }
 
-void Net::CopyTrainedLayersFrom(const NetParameter& param) {
-  int num_source_layers = param.layer_size();
-  for (int i = 0; i < num_source_layers; ++i) {
-    const LayerParameter& source_layer = param.layer(i);
-    const string& source_layer_name = source_layer.name();
-    const string& source_layer_type = source_layer.type();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
+void Net::ReshapeBatch(int num) {
+  CHECK_GT(num, 0) << "Batch size must be positive";
+  bool reshape = false;
+  for (Blob* input : net_input_blobs_) {
+    CHECK_GT(input->num_axes(), 0) << "Input blob without batch dimension";
+    if (input->shape(0) != num) {
+      vector<int> shape = input->shape();
+      shape[0] = num;
+      input->Reshape(shape);
+      reshape = true;
     }
-    if (target_layer_id == layer_names_.size()) {
-      LOG(INFO) << "Ignoring source layer " << source_layer_name;
-      continue;
+  }
+  if (reshape) {
+    ReshapeLayers(true);
+  }
+}
+
+Net::Cost Net::layer_cost(int layer_id) const {
+  CHECK_GE(layer_id, 0);
+  CHECK_LT(layer_id, layers_.size());
+  const LayerBase& layer = *layers_[layer_id];
+  const vector<Blob*>& bottom = bottom_vecs_[layer_id];
+  const vector<Blob*>& top = top_vecs_[layer_id];
+  Cost cost;
+  cost.forward_flops = layer.ForwardFlops(bottom, top);
+  cost.forward_bytes = layer.ForwardBytes(bottom, top);
+  if (layer_need_backward_[layer_id]) {
+    cost.backward_flops = layer.BackwardFlops(top, bottom);
+    cost.backward_bytes = layer.BackwardBytes(top, bottom);
+  }
+  return cost;
+}
+
+Net::Cost Net::total_cost() const {
+  Cost total;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const Cost cost = layer_cost(i);
+    total.forward_flops += cost.forward_flops;
+    total.backward_flops += cost.backward_flops;
+    total.forward_bytes += cost.forward_bytes;
+    total.backward_bytes += cost.backward_bytes;
+  }
+  return total;
+}
+
+size_t Net::param_bytes() const {
+  size_t bytes = 0UL;
+  for (const shared_ptr<Blob>& param : learnable_params_) {
+    bytes += param->count() * tsize(param->data_type());
+  }
+  return bytes;
+}
+
+size_t Net::activation_bytes() const {
+  size_t bytes = 0UL;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const Blob& blob = *blobs_[blob_id];
+    bytes += blob.count() * tsize(blob.data_type());
+    if (blob_need_backward_[blob_id]) {
+      bytes += blob.count() * tsize(blob.diff_type());
     }
-    DLOG(INFO) << "Copying source layer " << source_layer_name;
-    vector<shared_ptr<Blob> >& target_blobs =
-        layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    LOG(INFO) << "Copying source layer " << source_layer_name << " Type:"
-              << source_layer_type << " #blobs=" << source_layer.blobs_size();
-    // check if BN is in legacy DIGITS format?
-    if (source_layer_type == "BatchNorm" && source_layer.blobs_size() == 5) {
-      for (int j = 0; j < target_blobs.size(); ++j) {
-        const bool kReshape = true;
-        target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
-        DLOG(INFO) << target_blobs[j]->count();
+  }
+  return bytes;
+}
+
+bool Net::ActivationPlanFits() const {
+  if (!activation_arena_) {
+    return false;
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const Blob& blob = *blobs_[blob_id];
+    if (activation_plan_bytes_[blob_id] > 0UL &&
+        even(blob.count()) * tsize(blob.data_type()) > activation_plan_bytes_[blob_id]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Net::PlanActivationMemory() {
+  activation_plan_pending_ = false;
+  if (phase_ != TEST || Caffe::mode() != Caffe::CPU) {
+    LOG_IF(WARNING, Caffe::root_solver()) << "share_activation_memory is ignored: "
+        << "it requires TEST phase and CPU mode";
+    return;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (layer_need_backward_[layer_id]) {
+      LOG_IF(WARNING, Caffe::root_solver()) << "share_activation_memory is ignored: "
+          << "layer " << layer_names_[layer_id] << " needs backward";
+      return;
+    }
+  }
+  PlanSharedMemory(ACTIVATION_ARENA, &activation_arena_);
+}
+
+void Net::PlanDiffMemory() {
+  diff_plan_pending_ = false;
+  if (phase_ != TRAIN || Caffe::mode() != Caffe::CPU) {
+    LOG_IF(WARNING, Caffe::root_solver()) << "share_diff_memory is ignored: "
+        << "it requires TRAIN phase and CPU mode";
+    return;
+  }
+  PlanSharedMemory(DIFF_ARENA, &diff_arena_);
+}
+
+void Net::PlanRecomputeMemory() {
+  recompute_plan_pending_ = false;
+  if (phase_ != TRAIN || Caffe::mode() != Caffe::CPU) {
+    LOG_IF(WARNING, Caffe::root_solver()) << "recompute_segment is ignored: "
+        << "it requires TRAIN phase and CPU mode";
+    return;
+  }
+  PlanSharedMemory(RECOMPUTE_ARENA, &recompute_arena_);
+}
+
+void Net::RecomputeSegmentForward(int id) {
+  RecomputeRange& range = recompute_ranges_[id];
+  // Forward must not update running statistics twice (e.g. BatchNorm)
+  int stashed = 0;
+  for (int layer_id = range.first; layer_id <= range.last; ++layer_id) {
+    const vector<shared_ptr<Blob>>& blobs = layers_[layer_id]->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      if (layers_[layer_id]->forward_updates_blob(j)) {
+        if (stashed == recompute_stash_.size()) {
+          recompute_stash_.push_back(Blob::create(blobs[j]->data_type(), blobs[j]->diff_type()));
+        }
+        recompute_stash_[stashed++]->CopyFrom(*blobs[j], false, true);
       }
-      if (target_blobs[4]->count() == 1) {
-        // old format: 0 - scale , 1 - bias,  2 - mean , 3 - var, 4 - reserved
-        // new format: 0 - mean  , 1 - var,  2 - reserved , 3- scale, 4 - bias
-        LOG(INFO) << "BN legacy DIGITS format detected ... ";
-        std::swap(target_blobs[0], target_blobs[2]);
-        std::swap(target_blobs[1], target_blobs[3]);
-        // ==> 0 - mean , 1 -var,  2 - scale , 3 - bias; 4 - reserved
-        std::swap(target_blobs[2], target_blobs[4]);
-        std::swap(target_blobs[3], target_blobs[4]);
-        LOG(INFO) << "BN Transforming to new format completed.";
+    }
+  }
+  for (int j = 0; j < range.inputs.size(); ++j) {
+    blobs_[range.inputs[j]]->CopyFrom(*range.saved_inputs[j], false, true);
+  }
+  const rng_t rng = *caffe_rng();
+  const CounterRNG counter_rng = Caffe::counter_rng();
+  *caffe_rng() = *static_cast<rng_t*>(range.rng.generator());
+  Caffe::counter_rng() = range.counter_rng;
+  for (int i = range.first; i <= range.last; ++i) {
+    ForwardLayer(i);
+  }
+  *caffe_rng() = rng;
+  Caffe::counter_rng() = counter_rng;
+  stashed = 0;
+  for (int layer_id = range.first; layer_id <= range.last; ++layer_id) {
+    const vector<shared_ptr<Blob>>& blobs = layers_[layer_id]->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      if (layers_[layer_id]->forward_updates_blob(j)) {
+        blobs[j]->CopyFrom(*recompute_stash_[stashed++], false, true);
       }
-      for (int j = 0; j < target_blobs.size(); ++j) {
-        DLOG(INFO) << target_blobs[j]->count();
+    }
+  }
+}
+
+void Net::PlanSharedMemory(ArenaKind kind, shared_ptr<SyncedMemory>* arena) {
+  const bool diff = kind == DIFF_ARENA;
+  const int num_blobs = blobs_.size();
+  const int num_layers = layers_.size();
+  // Union blobs aliasing one tensor into buffers
+  vector<int> root(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    root[blob_id] = blob_id;
+  }
+  auto find_root = [&root](int blob_id) {
+    while (root[blob_id] != blob_id) {
+      blob_id = root[blob_id] = root[root[blob_id]];
+    }
+    return blob_id;
+  };
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int top_id : top_id_vecs_[layer_id]) {
+      for (int bottom_id : bottom_id_vecs_[layer_id]) {
+        const Blob& top = *blobs_[top_id];
+        const Blob& bottom = *blobs_[bottom_id];
+        if (diff ? top.diff_equals(bottom) : top.data_equals(bottom)) {
+          root[find_root(top_id)] = find_root(bottom_id);
+        }
       }
-    } else {
-      for (int j = 0; j < target_blobs.size(); ++j) {
-        if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
-          shared_ptr<Blob> source_blob = Blob::create(target_blobs[j]->data_type(),
-              target_blobs[j]->diff_type());
-          const bool kReshape = true;
-          source_blob->FromProto(source_layer.blobs(j), kReshape);
-          LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
-              << source_layer_name << "'; shape mismatch.  Source param shape is "
-              << source_blob->shape_string() << "; target param shape is "
-              << target_blobs[j]->shape_string() << ". "
-              << "To learn this layer's parameters from scratch rather than "
-              << "copying from a saved net, rename the layer.";
+    }
+  }
+  // Lifetime [first, last] in layer ids and size of every buffer. Backward
+  // visits the same range in reverse: the last consumer writes the diff,
+  // the producer reads it.
+  vector<int> first(num_blobs, num_layers), last(num_blobs, -1);
+  vector<size_t> bytes(num_blobs, 0UL);
+  vector<bool> pinned(num_blobs, false);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int top_id : top_id_vecs_[layer_id]) {
+      const int r = find_root(top_id);
+      first[r] = std::min(first[r], layer_id);
+      last[r] = std::max(last[r], layer_id);
+      if (bottom_id_vecs_[layer_id].empty()) {
+        pinned[r] = true;
+      }
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int r = find_root(bottom_id_vecs_[layer_id][i]);
+      last[r] = std::max(last[r], layer_id);
+      // A diff no consumer writes may still be read (e.g. summed by Split)
+      if (diff && !bottom_need_backward_[layer_id][i]) {
+        pinned[r] = true;
+      }
+    }
+    const int segment = diff ? recompute_segment_of_[layer_id] : -1;
+    if (segment >= 0) {
+      // Forward of the segment reruns inside Backward and may touch these diffs
+      for (const vector<int>* ids : {&top_id_vecs_[layer_id], &bottom_id_vecs_[layer_id]}) {
+        for (int blob_id : *ids) {
+          const int r = find_root(blob_id);
+          first[r] = std::min(first[r], recompute_ranges_[segment].first);
+          last[r] = std::max(last[r], recompute_ranges_[segment].last);
         }
-        const bool kReshape = false;
-        target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
       }
     }
   }
+  for (int blob_id : net_input_blob_indices_) {
+    pinned[find_root(blob_id)] = true;
+  }
+  for (int blob_id : net_output_blob_indices_) {
+    if (diff) {
+      pinned[find_root(blob_id)] = true;
+    } else {
+      last[find_root(blob_id)] = num_layers;
+    }
+  }
+  size_t unshared_bytes = 0UL;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const Blob& blob = *blobs_[blob_id];
+    const int r = find_root(blob_id);
+    if (diff && (!blob_need_backward_[blob_id] || blob_loss_weights_[blob_id] != 0.F)) {
+      pinned[r] = true;
+    }
+    bytes[r] = std::max(bytes[r],
+        even(blob.count()) * tsize(diff ? blob.diff_type() : blob.data_type()));
+    if (r == blob_id) {
+      unshared_bytes += bytes[r];
+    }
+  }
+  if (kind == RECOMPUTE_ARENA) {
+    // Only buffers produced and consumed inside one segment are dropped.
+    // Segments run one at a time, so their buffers live for the whole segment.
+    for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+      if (find_root(blob_id) != blob_id || pinned[blob_id] || first[blob_id] >= num_layers) {
+        continue;
+      }
+      const int segment = recompute_segment_of_[first[blob_id]];
+      if (segment < 0 || last[blob_id] > recompute_ranges_[segment].last) {
+        pinned[blob_id] = true;
+      } else {
+        first[blob_id] = recompute_ranges_[segment].first;
+        last[blob_id] = recompute_ranges_[segment].last;
+      }
+    }
+  }
+  vector<int> buffers;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (find_root(blob_id) == blob_id && !pinned[blob_id] && first[blob_id] < num_layers) {
+      buffers.push_back(blob_id);
+    }
+  }
+  // Largest first, each at the lowest 64-byte aligned offset not overlapping
+  // the already placed buffers it is alive together with
+  std::stable_sort(buffers.begin(), buffers.end(), [&bytes](int a, int b) {
+    return bytes[a] > bytes[b];
+  });
+  vector<size_t> offset(num_blobs, 0UL);
+  vector<pair<size_t, size_t>> busy;
+  size_t arena_bytes = 0UL;
+  for (int i = 0; i < buffers.size(); ++i) {
+    const int b = buffers[i];
+    busy.clear();
+    for (int j = 0; j < i; ++j) {
+      const int p = buffers[j];
+      if (first[p] <= last[b] && first[b] <= last[p]) {
+        busy.emplace_back(offset[p], offset[p] + bytes[p]);
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    size_t candidate = 0UL;
+    for (const pair<size_t, size_t>& range : busy) {
+      if (candidate + bytes[b] <= range.first) {
+        break;
+      }
+      candidate = std::max(candidate, align_up<6>(range.second));
+    }
+    offset[b] = candidate;
+    arena_bytes = std::max(arena_bytes, candidate + bytes[b]);
+  }
+  if (arena_bytes == 0UL) {
+    return;
+  }
+  // The previous arena stays alive until every buffer is moved to the new one
+  shared_ptr<SyncedMemory> new_arena = make_shared<SyncedMemory>(arena_bytes + 64UL);
+  char* base = reinterpret_cast<char*>(
+      align_up<6>(reinterpret_cast<uintptr_t>(new_arena->mutable_cpu_data())));
+  for (int b : buffers) {
+    if (bytes[b] == 0UL) {
+      continue;
+    }
+    void* ptr = static_cast<void*>(base + offset[b]);
+    if (diff) {
+      blobs_[b]->set_cpu_diff(ptr);
+    } else {
+      blobs_[b]->set_cpu_data(ptr);
+    }
+  }
+  *arena = new_arena;
+  if (kind == ACTIVATION_ARENA) {
+    vector<bool> placed(num_blobs, false);
+    for (int b : buffers) {
+      placed[b] = bytes[b] > 0UL;
+    }
+    activation_plan_bytes_.assign(num_blobs, 0UL);
+    for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+      if (placed[find_root(blob_id)]) {
+        const Blob& blob = *blobs_[blob_id];
+        activation_plan_bytes_[blob_id] = even(blob.count()) * tsize(blob.data_type());
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << (diff ? "Diff" : kind == RECOMPUTE_ARENA ? "Recomputed activation" : "Activation")
+      << " memory (" << Phase_Name(phase_) << ") shared: " << arena_bytes << " bytes in "
+      << buffers.size() << " buffers, unshared: " << unshared_bytes << " bytes";
+}
+
+namespace {
+
+// CPU conversion which leaves thread-local Caffe state alone, so that it runs
+// on caffe_cpu_parallel_for workers
+template <typename Dtype>
+void ConvertTrainedData(int n, const Dtype* src, void* dst, Type dst_type) {
+  switch (dst_type) {
+    case FLOAT:
+      caffe_cpu_convert(n, src, static_cast<float*>(dst));
+      break;
+    case DOUBLE:
+      caffe_cpu_convert(n, src, static_cast<double*>(dst));
+      break;
+#ifndef CPU_ONLY
+    case FLOAT16:
+      caffe_cpu_convert(n, src, static_cast<float16*>(dst));
+      break;
+#endif
+    default:
+      LOG(FATAL) << "Unsupported data type " << Type_Name(dst_type);
+  }
+}
+
+void ConvertTrainedData(int n, const void* src, Type src_type, void* dst, Type dst_type) {
+  if (src_type == dst_type) {
+    memcpy(dst, src, n * tsize(src_type));  // NOLINT(caffe/alt_fn)
+    return;
+  }
+  switch (src_type) {
+    case FLOAT:
+      ConvertTrainedData(n, static_cast<const float*>(src), dst, dst_type);
+      break;
+    case DOUBLE:
+      ConvertTrainedData(n, static_cast<const double*>(src), dst, dst_type);
+      break;
+#ifndef CPU_ONLY
+    case FLOAT16:
+      ConvertTrainedData(n, static_cast<const float16*>(src), dst, dst_type);
+      break;
+#endif
+    default:
+      LOG(FATAL) << "Unsupported data type " << Type_Name(src_type);
+  }
+}
+
+// Copies the data of the blob protos into their target blobs. Memory is
+// taken on this thread; the copies and conversions run in parallel in chunks
+// so that one large blob is split too.
+void CopyTrainedBlobs(const vector<std::pair<const BlobProto*, Blob*>>& copies) {
+  struct Chunk {
+    const char* src;
+    Type src_type;
+    char* dst;
+    Type dst_type;
+    int count;
+  };
+  const int kChunk = 1 << 20;
+  vector<Chunk> chunks;
+  for (const std::pair<const BlobProto*, Blob*>& copy : copies) {
+    const BlobProto& proto = *copy.first;
+    Blob* target = copy.second;
+    if (proto.double_diff_size() > 0 || proto.diff_size() > 0 || proto.has_raw_diff()) {
+      // Diffs are only snapshotted for debugging
+      target->FromProto(proto, false);
+      continue;
+    }
+    const char* src;
+    Type src_type;
+    int count;
+    if (proto.double_data_size() > 0) {
+      src = reinterpret_cast<const char*>(proto.double_data().data());
+      src_type = DOUBLE;
+      count = proto.double_data_size();
+    } else if (proto.data_size() > 0) {
+      src = reinterpret_cast<const char*>(proto.data().data());
+      src_type = FLOAT;
+      count = proto.data_size();
+    } else if (proto.has_raw_data()) {
+      CHECK(proto.has_raw_data_type()) << "Missing raw data type";
+      src = proto.raw_data().data();
+      src_type = proto.raw_data_type();
+      count = proto.raw_data().size() / tsize(src_type);
+      CHECK_EQ(count * tsize(src_type), proto.raw_data().size());
+    } else {
+      continue;
+    }
+    CHECK_EQ(target->count(), count);
+    const Type dst_type = target->data_type();
+    char* dst = static_cast<char*>(target->current_mutable_data_memory(false));
+    for (int i = 0; i < count; i += kChunk) {
+      chunks.push_back(Chunk{src + i * tsize(src_type), src_type,
+          dst + i * tsize(dst_type), dst_type, std::min(kChunk, count - i)});
+    }
+  }
+  caffe_cpu_parallel_for(chunks.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const Chunk& c = chunks[i];
+      ConvertTrainedData(c.count, c.src, c.src_type, c.dst, c.dst_type);
+    }
+  });
+}
+
+}  // namespace
+
+void Net::CopyTrainedLayer(const LayerParameter& source_layer,
+    vector<std::pair<const BlobProto*, Blob*>>* copies) {
+  const string& source_layer_name = source_layer.name();
+  const string& source_layer_type = source_layer.type();
+  int target_layer_id = 0;
+  while (target_layer_id != layer_names_.size() &&
+      layer_names_[target_layer_id] != source_layer_name) {
+    ++target_layer_id;
+  }
+  if (target_layer_id == layer_names_.size()) {
+    LOG(INFO) << "Ignoring source layer " << source_layer_name;
+    return;
+  }
+  DLOG(INFO) << "Copying source layer " << source_layer_name;
+  vector<shared_ptr<Blob> >& target_blobs =
+      layers_[target_layer_id]->blobs();
+  CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+      << "Incompatible number of blobs for layer " << source_layer_name;
+  LOG(INFO) << "Copying source layer " << source_layer_name << " Type:"
+            << source_layer_type << " #blobs=" << source_layer.blobs_size();
+  // check if BN is in legacy DIGITS format?
+  if (source_layer_type == "BatchNorm" && source_layer.blobs_size() == 5) {
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const bool kReshape = true;
+      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      DLOG(INFO) << target_blobs[j]->count();
+    }
+    if (target_blobs[4]->count() == 1) {
+      // old format: 0 - scale , 1 - bias,  2 - mean , 3 - var, 4 - reserved
+      // new format: 0 - mean  , 1 - var,  2 - reserved , 3- scale, 4 - bias
+      LOG(INFO) << "BN legacy DIGITS format detected ... ";
+      std::swap(target_blobs[0], target_blobs[2]);
+      std::swap(target_blobs[1], target_blobs[3]);
+      // ==> 0 - mean , 1 -var,  2 - scale , 3 - bias; 4 - reserved
+      std::swap(target_blobs[2], target_blobs[4]);
+      std::swap(target_blobs[3], target_blobs[4]);
+      LOG(INFO) << "BN Transforming to new format completed.";
+    }
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      DLOG(INFO) << target_blobs[j]->count();
+    }
+  } else {
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
+        shared_ptr<Blob> source_blob = Blob::create(target_blobs[j]->data_type(),
+            target_blobs[j]->diff_type());
+        const bool kReshape = true;
+        source_blob->FromProto(source_layer.blobs(j), kReshape);
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob->shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      copies->emplace_back(&source_layer.blobs(j), target_blobs[j].get());
+    }
+  }
+}
+
+void Net::CopyTrainedLayersFrom(const NetParameter& param) {
+  vector<std::pair<const BlobProto*, Blob*>> copies;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    CopyTrainedLayer(param.layer(i), &copies);
+  }
+  CopyTrainedBlobs(copies);
 }
 
 void Net::CopyTrainedLayersFrom(const string trained_filename) {
+  CopyTrainedLayersFrom(trained_filename, false);
+}
+
+void Net::CopyTrainedLayersFrom(const string trained_filename, bool defer) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (WeightFile::Check(trained_filename)) {
+    CopyTrainedLayersFromWeightFile(trained_filename);
   } else {
-    CopyTrainedLayersFromBinaryProto(trained_filename);
+    CopyTrainedLayersFromBinaryProto(trained_filename, defer);
   }
 }
 
-void Net::CopyTrainedLayersFromBinaryProto(
-    const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+void Net::CopyTrainedLayersFromBinaryProto(const string trained_filename, bool defer) {
+  vector<SerializedLayer> layers;
+  if (!IndexLayersInBinaryFile(trained_filename, &layers)) {
+    // V0/V1 layers need upgrading
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+    return;
+  }
+  if (defer && deferred_weights_file_ != trained_filename) {
+    LoadDeferredLayers();
+    deferred_weights_file_ = trained_filename;
+  }
+  // Shared params are read at once: the layers sharing them may run Forward
+  // at the same time
+  vector<bool> shared_params(params_.size(), false);
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] >= 0) {
+      shared_params[i] = shared_params[param_owners_[i]] = true;
+    }
+  }
+  // Bounds the parsed layers held in memory at a time
+  const int64_t kBatchBytes = 256LL << 20;
+  vector<SerializedLayer> batch;
+  int64_t batch_bytes = 0LL;
+  int deferred = 0;
+  for (const SerializedLayer& layer : layers) {
+    auto it = layer_names_index_.find(layer.name);
+    if (defer && it != layer_names_index_.end() && !layers_[it->second]->blobs().empty()) {
+      const vector<int>& param_ids = param_id_vecs_[it->second];
+      if (std::none_of(param_ids.begin(), param_ids.end(),
+          [&](int id) { return shared_params[id]; })) {
+        deferred_layers_.resize(layers_.size());
+        deferred_layers_[it->second] = layer;
+        ++deferred;
+        continue;
+      }
+    }
+    batch.push_back(layer);
+    batch_bytes += layer.length;
+    if (batch_bytes >= kBatchBytes) {
+      CopyTrainedLayersFromFile(trained_filename, batch);
+      batch.clear();
+      batch_bytes = 0LL;
+    }
+  }
+  CopyTrainedLayersFromFile(trained_filename, batch);
+  LOG_IF(INFO, deferred > 0) << "Deferred reading " << deferred << " layers of "
+      << trained_filename << " to their first Forward";
+}
+
+void Net::CopyTrainedLayersFromFile(const string& filename,
+    const vector<SerializedLayer>& layers) {
+  vector<LayerParameter> source_layers(layers.size());
+  caffe_cpu_parallel_for(layers.size(), [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      ReadLayerFromBinaryFile(filename, layers[i], &source_layers[i]);
+    }
+  });
+  vector<std::pair<const BlobProto*, Blob*>> copies;
+  for (const LayerParameter& source_layer : source_layers) {
+    CopyTrainedLayer(source_layer, &copies);
+  }
+  CopyTrainedBlobs(copies);
+}
+
+void Net::LoadDeferredLayer(int layer_id) {
+  LayerParameter source_layer;
+  ReadLayerFromBinaryFile(deferred_weights_file_, deferred_layers_[layer_id], &source_layer);
+  deferred_layers_[layer_id].length = 0;
+  vector<std::pair<const BlobProto*, Blob*>> copies;
+  CopyTrainedLayer(source_layer, &copies);
+  CopyTrainedBlobs(copies);
+}
+
+void Net::LoadDeferredLayers() {
+  for (int i = 0; i < deferred_layers_.size(); ++i) {
+    if (deferred_layers_[i].length > 0) {
+      LoadDeferredLayer(i);
+    }
+  }
+}
+
+bool Net::has_deferred_layers() const {
+  return std::any_of(deferred_layers_.begin(), deferred_layers_.end(),
+      [](const SerializedLayer& layer) { return layer.length > 0; });
 }
 
 void Net::CopyTrainedLayersFromHDF5(const string trained_filename) {
@@ -1182,7 +2028,73 @@ void Net::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+void Net::CopyTrainedLayersFromWeightFile(const string trained_filename) {
+  shared_ptr<WeightFile> file = make_shared<WeightFile>(trained_filename);
+  int mapped = 0, copied = 0;
+  for (const WeightFileIndex::Entry& entry : file->index().entry()) {
+    auto it = layer_names_index_.find(entry.layer());
+    if (it == layer_names_index_.end()) {
+      LOG_IF(INFO, entry.blob() == 0) << "Ignoring source layer " << entry.layer();
+      continue;
+    }
+    vector<shared_ptr<Blob> >& target_blobs = layers_[it->second]->blobs();
+    CHECK_LT(entry.blob(), static_cast<int>(target_blobs.size()))
+        << "Incompatible number of blobs for layer " << entry.layer();
+    Blob* target = target_blobs[entry.blob()].get();
+    vector<int> shape(entry.shape().dim().begin(), entry.shape().dim().end());
+    if (shape != target->shape()) {
+      shared_ptr<Blob> source_blob = Blob::create(entry.type(), entry.type());
+      source_blob->Reshape(shape);
+      LOG(FATAL) << "Cannot copy param " << entry.blob() << " weights from layer '"
+          << entry.layer() << "'; shape mismatch.  Source param shape is "
+          << source_blob->shape_string() << "; target param shape is "
+          << target->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    if (target->count() == 0) {
+      continue;
+    }
+    if (target->data_type() == entry.type()) {
+      target->set_cpu_data(file->data(entry));
+      ++mapped;
+    } else {
+      shared_ptr<Blob> source = Blob::create(entry.type(), entry.type());
+      source->Reshape(shape);
+      source->set_cpu_data(file->data(entry));
+      target->CopyDataFrom(*source);
+      ++copied;
+    }
+  }
+  if (mapped > 0) {
+    weight_files_.push_back(file);
+  }
+  LOG(INFO) << "Loaded " << trained_filename << ": " << mapped << " params mapped, "
+            << copied << " converted";
+}
+
+void Net::ToWeightFile(const string& filename) const {
+  CHECK(!has_deferred_layers())
+      << "Deferred layers would be written without their blobs: call LoadDeferredLayers";
+  WeightFileWriter writer(filename);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
+    const int num_params = layers_[layer_id]->blobs().size();
+    for (int param_id = 0; param_id < num_params; ++param_id) {
+      const int net_param_id = param_id_vecs_[layer_id][param_id];
+      // Only save params that own themselves
+      if (param_owners_[net_param_id] == -1) {
+        writer.Add(layer_param.name(), layer_param.type(), param_id,
+            params_[net_param_id].get());
+      }
+    }
+  }
+  writer.Close();
+}
+
 void Net::ToProto(NetParameter* param, bool write_diff) const {
+  CHECK(!has_deferred_layers())
+      << "Deferred layers would be written without their blobs: call LoadDeferredLayers";
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -1194,6 +2106,8 @@ void Net::ToProto(NetParameter* param, bool write_diff) const {
 }
 
 void Net::ToHDF5(const string& filename, bool write_diff) const {
+  CHECK(!has_deferred_layers())
+      << "Deferred layers would be written without their blobs: call LoadDeferredLayers";
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -1325,7 +2239,6 @@ void Net::set_solver(Solver* s) {
   }
 }
 
-#ifndef CPU_ONLY
 void Net::InitializeLearnableDiffSpace() {
   learnable_space_count_ = 0;
   size_t workspace_size = 0UL;
@@ -1355,11 +2268,23 @@ void Net::InitializeLearnableDiffSpace() {
     workspace_size = 2;
   }
 
+  const bool gpu = Caffe::mode() == Caffe::GPU;
   LOG(INFO) << print_current_device() << " Reserving "
             << workspace_size << " bytes of shared learnable space";
-  learnable_space_.reserve(workspace_size);
-  unsigned char* ptr = reinterpret_cast<unsigned char*>(learnable_space_.data());
-  caffe_gpu_memset(workspace_size, 0, ptr);
+  unsigned char* ptr = nullptr;
+  if (gpu) {
+#ifndef CPU_ONLY
+    learnable_space_.reserve(workspace_size);
+    ptr = reinterpret_cast<unsigned char*>(learnable_space_.data());
+    caffe_gpu_memset(workspace_size, 0, ptr);
+#else
+    NO_GPU;
+#endif
+  } else {
+    learnable_cpu_space_ = make_shared<SyncedMemory>(workspace_size);
+    ptr = reinterpret_cast<unsigned char*>(learnable_cpu_space_->mutable_cpu_data());
+    caffe_memset(workspace_size, 0, ptr);
+  }
 
   for (int i = 0; i < layers_.size(); ++i) {
     for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
@@ -1369,13 +2294,18 @@ void Net::InitializeLearnableDiffSpace() {
       const int lip = layer_index_params_[make_pair(i, j)];
       if (param_owners_[lip] < 0) {
         const int param_id = learnable_param_ids_[lip];
-        learnable_params_[param_id]->set_gpu_diff(static_cast<void*>(ptr));
+        if (gpu) {
+#ifndef CPU_ONLY
+          learnable_params_[param_id]->set_gpu_diff(static_cast<void*>(ptr));
+#endif
+        } else {
+          learnable_params_[param_id]->set_cpu_diff(static_cast<void*>(ptr));
+        }
         learnable_params_ptrs_[param_id] = ptr;
         ptr += align_up<6>(learnable_params_[param_id]->count()) * max_tsize;
       }
     }
   }
 }
-#endif
 
 }  // namespace caffe
@@ -5,8 +5,13 @@
 #include <boost/thread.hpp>
 #include <boost/thread/latch.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/parallel_for.hpp"
 
 #ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
@@ -26,9 +31,13 @@ P2PManager::P2PManager(shared_ptr<Solver> root_solver,
 #ifndef USE_NCCL
   LOG(FATAL) << "USE_NCCL must be specified for multi-GPU mode";
 #endif
-  dl_bar.reset(new boost::barrier(nranks_));
-  bar.reset(new boost::barrier(nranks_));
-  rbar.reset(new boost::barrier(nranks_));
+  init_barriers(nranks_);
+}
+
+void P2PManager::init_barriers(size_t nranks) {
+  dl_bar.reset(new boost::barrier(nranks));
+  bar.reset(new boost::barrier(nranks));
+  rbar.reset(new boost::barrier(nranks));
 }
 
 void P2PManager::Run(const vector<int>& gpus) {
@@ -231,7 +240,25 @@ void P2PSync::allreduce_bucket(int count, void* bucket, Type type) {
   NCCL_CHECK(ncclAllReduce(bucket, bucket, count, nccl::nccl_type(type),
                            ncclSum, nccl_comm_, comm_stream_->get()));
   CUDA_CHECK(cudaStreamSynchronize(comm_stream_->get()));
+#else
+  LOG(FATAL) << "Bucket reduction across GPUs needs USE_NCCL := 1";
 #endif  // USE_NCCL
+#else
+  NO_GPU;
+#endif  // CPU_ONLY
+}
+
+void P2PSync::allgather_bucket(const void* send, size_t bytes, void* recv) {
+#ifndef CPU_ONLY
+#ifdef USE_NCCL
+  NCCL_CHECK(ncclAllGather(send, recv, bytes, ncclChar, nccl_comm_, comm_stream_->get()));
+  CUDA_CHECK(cudaStreamSynchronize(comm_stream_->get()));
+#else
+  // Returning would drop every other rank's top-k gradients without a word
+  LOG(FATAL) << "Top-k gradient compression across GPUs needs USE_NCCL := 1";
+#endif  // USE_NCCL
+#else
+  NO_GPU;
 #endif  // CPU_ONLY
 }
 
@@ -265,6 +292,308 @@ void P2PSync::saveTestResults(float loss, const vector<float>& scores) {
   }
 }
 
+constexpr int CPUSyncManager::CACHE_BLOCK;
+
+CPUSyncManager::CPUSyncManager(shared_ptr<Solver> root_solver,
+    int nranks, const SolverParameter& solver_param) :
+      nranks_(nranks),
+      syncs_(nranks),
+      root_solver_(root_solver),
+      buckets_(nranks, nullptr),
+      reduce_bar_(nranks) {
+  CHECK_EQ(nranks_, Caffe::solver_count());
+  P2PManager::init_barriers(nranks_);
+  caffe_set_cpu_core_groups(nranks_);
+}
+
+CPUSyncManager::~CPUSyncManager() {
+  syncs_.clear();
+  P2PManager::init_barriers(1);
+  caffe_set_cpu_core_groups(1);
+}
+
+void CPUSyncManager::Run() {
+  SolverParameter param = root_solver_->param();
+  this->shared_ = make_shared<SharedScores<float>>(nranks_);
+  for (int i = 0; i < nranks_; ++i) {
+    syncs_[i] = make_shared<CPUSync>(this, root_solver_, i, nranks_, param);
+    syncs_[i]->shared_ = this->shared_;
+  }
+
+  LOG(INFO) << "Starting Optimization on " << nranks_ << " CPU core groups";
+
+  for (int i = 0; i < syncs_.size(); ++i) {
+    syncs_[i]->StartInternalThread(false, static_cast<uint64_t>(param.random_seed()));
+  }
+  for (int i = 0; i < syncs_.size(); ++i) {
+    syncs_[i]->WaitAll();
+  }
+
+  std::ostringstream os;
+  os.precision(4);
+  float total_perf = this->root_solver_->perf_report(os, 0);
+  LOG(INFO) << "Root " << os.str();
+  for (int i = 1; i < syncs_.size(); ++i) {
+    std::ostringstream os;
+    os.precision(4);
+    total_perf += syncs_[i]->solver_->perf_report(os, i, 5 /* "Root " */);
+    LOG(INFO) << os.str();
+  }
+  LOG(INFO) << "Overall multi-CPU performance: " << total_perf << " img/sec";
+}
+
+void CPUSyncManager::EarlyCancel(CPUSync* killed) {
+  for (int i = 0; i < syncs_.size(); ++i) {
+    if (killed != syncs_[i].get()) {
+      syncs_[i]->solver_->request_early_exit();
+      syncs_[i]->StopInternalThread();
+    }
+  }
+}
+
+void CPUSyncManager::Allreduce(int rank, int count, void* bucket, Type type) {
+  buckets_[rank] = bucket;
+  reduce_bar_.wait();
+  if (is_type<float>(type)) {
+    ReduceScatterAllGather<float>(rank, count);
+#ifndef CPU_ONLY
+  } else if (is_type<float16>(type)) {
+    ReduceScatterAllGather<float16>(rank, count);
+#endif
+  } else if (is_type<double>(type)) {
+    ReduceScatterAllGather<double>(rank, count);
+  } else {
+    LOG(FATAL) << "Unsupported data type: " << Type_Name(type);
+  }
+}
+
+void CPUSyncManager::Allgather(int rank, const void* send, size_t bytes, void* recv) {
+  buckets_[rank] = send;
+  reduce_bar_.wait();
+  for (int r = 0; r < nranks_; ++r) {
+    std::memcpy(static_cast<char*>(recv) + r * bytes, buckets_[r], bytes);
+  }
+  reduce_bar_.wait();
+}
+
+template<typename Dtype>
+void CPUSyncManager::ReduceScatterAllGather(int rank, int count) {
+  typedef typename std::conditional<std::is_same<Dtype, double>::value,
+      double, float>::type Mtype;
+  const int nranks = static_cast<int>(nranks_);
+  const int slice = (count + nranks - 1) / nranks;
+  const int begin = std::min(count, rank * slice);
+  const int end = std::min(count, begin + slice);
+  Dtype* own = static_cast<Dtype*>(const_cast<void*>(buckets_[rank]));
+
+  // Reduce-scatter: this rank owns [begin, end) and sums it over all replicas,
+  // one cache block at a time so that every source block is read once.
+  caffe_cpu_parallel_for(end - begin, [&](int from, int to) {
+    Mtype acc[CACHE_BLOCK];
+    for (int b = begin + from; b < begin + to; b += CACHE_BLOCK) {
+      const int n = std::min(CACHE_BLOCK, begin + to - b);
+      for (int i = 0; i < n; ++i) {
+        acc[i] = static_cast<Mtype>(own[b + i]);
+      }
+      for (int r = 1; r < nranks; ++r) {
+        const Dtype* src = static_cast<const Dtype*>(buckets_[(rank + r) % nranks]) + b;
+        for (int i = 0; i < n; ++i) {
+          acc[i] += static_cast<Mtype>(src[i]);
+        }
+      }
+      for (int i = 0; i < n; ++i) {
+        own[b + i] = static_cast<Dtype>(acc[i]);
+      }
+    }
+  }, CACHE_BLOCK);
+  reduce_bar_.wait();
+
+  // All-gather: fetch the slices reduced by the other ranks. Nobody writes
+  // to its own slice here, so the reads do not race.
+  for (int r = 1; r < nranks; ++r) {
+    const int peer = (rank + r) % nranks;
+    const int pbegin = std::min(count, peer * slice);
+    const int pend = std::min(count, pbegin + slice);
+    if (pend > pbegin) {
+      std::memcpy(own + pbegin, static_cast<const Dtype*>(buckets_[peer]) + pbegin,
+          (pend - pbegin) * sizeof(Dtype));
+    }
+  }
+  // Buckets stay published until everybody is done reading them
+  reduce_bar_.wait();
+}
+
+CPUSync::CPUSync(CPUSyncManager* mgr, shared_ptr<Solver> root_solver,
+    int rank, int nranks, const SolverParameter& solver_param)
+    : InternalThread(-1, rank, 1, false),
+      mgr_(mgr),
+      rank_(rank),
+      nranks_(nranks),
+      solver_(),
+      root_solver_(root_solver),
+      solver_param_(solver_param) {
+  LOG(INFO) << "[" << rank << " - CPU] CPUSync adding callback";
+}
+
+CPUSync::~CPUSync() {}
+
+void CPUSync::InternalThreadEntry() {
+  // Kernels of this replica (and its reduction thread) run on its own cores
+  caffe_cpu_join_core_group(rank_);
+  if (rank_ == 0) {
+    Caffe::set_root_solver(true);
+    solver_ = root_solver_;
+  } else {
+    Caffe::set_root_solver(false);
+    solver_.reset(caffe::SolverRegistry::CreateSolver(solver_param_, rank_, root_solver_.get()));
+  }
+  solver_->root_add_callback(this);
+  solver_->set_callback(this);
+
+  CHECK_EQ(nranks_, Caffe::solver_count());
+
+  if (solver_->param().random_seed() >= 0) {
+    // Same reasoning as in P2PSync: replicas must not share the random state
+    Caffe::set_random_seed(solver_->param().random_seed() + static_cast<uint64_t>(rank_));
+  } else {
+    Caffe::set_random_seed(Caffe::SEED_NOT_SET);
+  }
+
+  if (solver_->Solve()) {
+    mgr_->EarlyCancel(this);
+  }
+}
+
+void CPUSync::soft_barrier() {
+  P2PManager::bar_wait();
+}
+
+void CPUSync::reduce_barrier() {
+  P2PManager::rbar_wait();
+}
+
+void CPUSync::on_start(const vector<shared_ptr<Blob>>& net) {
+  // Replicas start from the root weights. The root is parked between two
+  // soft barriers while this runs, so its data is safe to read.
+  if (rank_ == 0) {
+    return;
+  }
+  const vector<shared_ptr<Blob>>& root = root_solver_->net()->learnable_params();
+  CHECK_EQ(root.size(), net.size());
+  for (int i = 0; i < net.size(); ++i) {
+    CHECK_EQ(root[i]->count(), net[i]->count());
+    CHECK_EQ(root[i]->data_type(), net[i]->data_type());
+    std::memcpy(net[i]->current_mutable_data_memory(false),
+        root[i]->current_data_memory(false),
+        net[i]->count() * tsize(net[i]->data_type()));
+  }
+}
+
+void CPUSync::allreduce(int param_id) {
+  const shared_ptr<Blob>& param = solver_->net()->learnable_params()[param_id];
+  allreduce_bucket(param->count(), param->current_mutable_diff_memory(false),
+      param->diff_type());
+}
+
+void CPUSync::allreduce_bucket(int count, void* bucket, Type type) {
+  mgr_->Allreduce(rank_, count, bucket, type);
+}
+
+void CPUSync::allgather_bucket(const void* send, size_t bytes, void* recv) {
+  mgr_->Allgather(rank_, send, bytes, recv);
+}
+
+void CPUSync::aggregateTestResults(float* loss, vector<float>* scores) {
+  if (this->rank_ != 0) {
+    return;
+  }
+  *loss = 0.F;
+  for (size_t i = 0; i < scores->size(); ++i) {
+    (*scores)[i] = 0.F;
+  }
+  for (size_t i = 0; i < nranks_; ++i) {
+    vector<float>& shared_scr = shared_->rank_scores(i);
+    *loss += shared_scr[0];
+    for (size_t j = 0; j < scores->size(); ++j) {
+      (*scores)[j] += shared_scr[j+1];
+    }
+  }
+}
+
+void CPUSync::saveTestResults(float loss, const vector<float>& scores) {
+  vector<float>& shared_scr = shared_->rank_scores(this->rank_);
+  CHECK_GE(shared_scr.size(), scores.size() + 1);
+  shared_scr[0] = loss;
+  for (size_t i = 0; i < scores.size(); ++i) {
+    shared_scr[i+1] = scores[i];
+  }
+}
+
+DistSync::DistSync(shared_ptr<Solver> solver, shared_ptr<Transport> comm,
+    shared_ptr<Transport> reduce_comm)
+    : solver_(solver), comm_(comm), reduce_comm_(reduce_comm) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU) << "Distributed training runs in CPU mode";
+  CHECK_EQ(comm_->size(), Caffe::solver_count());
+  CHECK_EQ(reduce_comm_->size(), comm_->size());
+  CHECK_EQ(reduce_comm_->rank(), comm_->rank());
+}
+
+bool DistSync::Run() {
+  const int rank = comm_->rank();
+  // Logging and snapshots are left to rank 0
+  Caffe::set_root_solver(rank == 0);
+  solver_->root_add_callback(this);
+  solver_->set_callback(this);
+  if (solver_->param().random_seed() >= 0) {
+    // Same reasoning as in P2PSync: replicas must not share the random state
+    Caffe::set_random_seed(solver_->param().random_seed() + static_cast<uint64_t>(rank));
+  }
+  LOG(INFO) << "Starting Optimization on rank " << rank << " of " << comm_->size();
+  return solver_->Solve();
+}
+
+void DistSync::soft_barrier() {
+  comm_->Barrier();
+}
+
+void DistSync::reduce_barrier() {
+  reduce_comm_->Barrier();
+}
+
+void DistSync::on_start(const vector<shared_ptr<Blob>>& net) {
+  for (int i = 0; i < net.size(); ++i) {
+    comm_->Broadcast(net[i]->current_mutable_data_memory(false),
+        net[i]->count() * tsize(net[i]->data_type()), 0);
+  }
+}
+
+void DistSync::allreduce(int param_id) {
+  const shared_ptr<Blob>& param = solver_->net()->learnable_params()[param_id];
+  reduce_comm_->Allreduce(param->current_mutable_diff_memory(false), param->count(),
+      param->diff_type());
+}
+
+void DistSync::allreduce_bucket(int count, void* bucket, Type type) {
+  reduce_comm_->Allreduce(bucket, count, type);
+}
+
+void DistSync::allgather_bucket(const void* send, size_t bytes, void* recv) {
+  reduce_comm_->Allgather(send, bytes, recv);
+}
+
+void DistSync::saveTestResults(float loss, const vector<float>& scores) {
+  test_results_.resize(scores.size() + 1);
+  test_results_[0] = loss;
+  std::copy(scores.begin(), scores.end(), test_results_.begin() + 1);
+}
+
+void DistSync::aggregateTestResults(float* loss, vector<float>* scores) {
+  CHECK_EQ(test_results_.size(), scores->size() + 1);
+  comm_->Allreduce(test_results_.data(), test_results_.size(), tp<float>());
+  *loss = test_results_[0];
+  std::copy(test_results_.begin() + 1, test_results_.end(), scores->begin());
+}
+
 uint32_t batch_per_gpu(uint32_t total) {
   int solver_count = Caffe::solver_count();
   if (total == 0 || total % solver_count != 0) {
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstring>
 
 #include <string>
 #include <vector>
@@ -9,6 +10,7 @@
 #include "caffe/util/gpu_memory.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/parallel_for.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -28,7 +30,8 @@ SolverAction::Enum Solver::GetRequestedAction() {
 Solver::Solver(const SolverParameter& param, size_t rank, const Solver* root_solver)
     : param_(param), data_type_(param_.solver_data_type()), iter_(0), id_(0), net_(),
       callback_(nullptr), root_solver_(root_solver), rank_(rank), requested_early_exit_(false),
-      iteration_timer_(), test_timer_(), iterations_last_(0), iterations_restored_(0) {
+      iteration_timer_(), test_timer_(), iterations_last_(0), iterations_restored_(0),
+      snapshot_deltas_(0), snapshot_delta_(false) {
   Init();
 }
 
@@ -45,6 +48,9 @@ void Solver::Init() {
     << std::endl << param_.DebugString();
 
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  CHECK(param_.gradient_compression().method() == GradientCompressionParameter_Method_NONE
+      || Caffe::mode() == Caffe::CPU)
+      << "gradient_compression is only implemented for CPU solvers";
   CheckSnapshotWritePermissions();
   if (Caffe::root_solver()) {  // P2PSync does other solvers if they exist
     Caffe::set_root_seed(static_cast<uint64_t>(param_.random_seed()));
@@ -200,13 +206,15 @@ void Solver::Step(int iters) {
     init_flag_.set();
   }
 
-#ifndef CPU_ONLY
   for (const shared_ptr<Blob>& param : net_->learnable_params()) {
     // To prevent allocations inside on_start call:
     param->allocate_data(mode == Caffe::GPU);
   }
 
-  net_->InitializeLearnableDiffSpace();
+  // CPU replicas need contiguous diffs only to reduce them in buckets
+  if (mode == Caffe::GPU || solver_count > 1) {
+    net_->InitializeLearnableDiffSpace();
+  }
 
   if (solver_count > 1) {
     // we need to sync all threads before starting, otherwise some cuda init,
@@ -214,28 +222,32 @@ void Solver::Step(int iters) {
     // called in on_start.
     callback_soft_barrier();
     {
+#ifndef CPU_ONLY
       unique_ptr<unique_lock<shared_mutex>> lock;
-      if (root_solver) {
+      if (root_solver && mode == Caffe::GPU) {
         lock.reset(new unique_lock<shared_mutex>(GPUMemory::read_write_mutex()));
       }
+#endif
       callback_soft_barrier();
       callback_->on_start(net_->learnable_params());
     }
     callback_soft_barrier();
-    LOG(INFO) << "Starting Optimization on GPU " << Caffe::current_device();
+    if (mode == Caffe::GPU) {
+      LOG(INFO) << "Starting Optimization on GPU " << Caffe::current_device();
+    } else {
+      LOG(INFO) << "Starting Optimization on CPU solver " << rank_;
+    }
   }
-  const bool use_multi_gpu_testing = Caffe::solver_count() > 1;
-  const string mgpu_str = use_multi_gpu_testing ? "[MultiGPU] " : "";
-#else
-  const bool use_multi_gpu_testing = false;
-  const string mgpu_str;
-#endif
+  const bool use_multi_gpu_testing = solver_count > 1;
+  const string mgpu_str = !use_multi_gpu_testing ? "" :
+      mode == Caffe::GPU ? "[MultiGPU] " : "[MultiCPU] ";
 
   uint64_t random_seed = param_.random_seed() >= 0 ?
       static_cast<uint64_t>(param_.random_seed()) : Caffe::next_seed();
 
   reduce_thread_.reset(new boost::thread(&Solver::Reduce, this,
-      Caffe::current_device(), mode, random_seed, solver_count, root_solver));
+      Caffe::current_device(), mode, random_seed, solver_count, root_solver,
+      caffe_cpu_core_group()));
 
   while (iter_ < stop_iter) {
     if (param_.snapshot_diff()) {
@@ -366,8 +378,11 @@ void Solver::Finalize() {
 }
 
 void Solver::Reduce(int device, Caffe::Brew mode, uint64_t random_seed,
-    int solver_count, bool root_solver) {
+    int solver_count, bool root_solver, int cpu_core_group) {
   Caffe::set_mode(mode);
+  if (mode == Caffe::CPU) {
+    caffe_cpu_join_core_group(cpu_core_group);
+  }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaSetDevice(device));
@@ -411,6 +426,7 @@ bool Solver::Solve(const char* resume_file) {
       Snapshot();
     }
   }
+  WaitForSnapshots();
   Caffe::set_restored_iter(-1);
   iterations_restored_ = 0;
   iterations_last_ = 0;
@@ -525,7 +541,8 @@ bool Solver::Test(const int test_net_id, const int iters, bool use_multi_gpu) {
   }
 
   if (param_.test_compute_loss()) {
-    loss /= param_.test_iter(test_net_id);
+    // Aggregated losses are summed over the solvers, as the scores below
+    loss /= param_.test_iter(test_net_id) * (use_multi_gpu ? Caffe::solver_count() : 1);
     LOG(INFO) << "Test loss: " << loss;
   }
   for (int i = 0; i < test_score.size(); ++i) {
@@ -547,6 +564,16 @@ bool Solver::Test(const int test_net_id, const int iters, bool use_multi_gpu) {
 
 void Solver::Snapshot() {
   CHECK(Caffe::root_solver());
+  // Layers not run yet still hold the weights they were created with
+  net_->LoadDeferredLayers();
+  // Diffs change every iteration: snapshots holding them are always full
+  const bool delta_chain = param_.snapshot_delta_chain() > 0 && !param_.snapshot_diff() &&
+      param_.snapshot_format() == caffe::SolverParameter_SnapshotFormat_BINARYPROTO;
+  // A second snapshot at the same iteration (e.g. requested while testing)
+  // would overwrite the state it applies to: it is written in full instead
+  snapshot_delta_ = delta_chain && !snapshot_base_.empty() &&
+      snapshot_deltas_ < param_.snapshot_delta_chain() &&
+      SnapshotFilename(".solverstate") != snapshot_base_;
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -559,6 +586,11 @@ void Solver::Snapshot() {
     LOG(FATAL) << "Unsupported snapshot format.";
   }
   SnapshotSolverState(model_filename);
+  if (delta_chain) {
+    snapshot_base_ = SnapshotFilename(".solverstate");
+    snapshot_deltas_ = snapshot_delta_ ? snapshot_deltas_ + 1 : 0;
+  }
+  snapshot_delta_ = false;
 }
 
 void Solver::CheckSnapshotWritePermissions() {
@@ -585,12 +617,90 @@ string Solver::SnapshotFilename(const string extension) {
 string Solver::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  shared_ptr<NetParameter> net_param = make_shared<NetParameter>();
+  if (param_.snapshot_delta_chain() > 0 && !param_.snapshot_diff()) {
+    const vector<shared_ptr<LayerBase>>& layers = net_->layers();
+    if (!snapshot_delta_) {
+      net_->ToProto(net_param.get(), false);
+      snapshot_layer_hashes_.assign(layers.size(), 0ULL);
+    } else {
+      net_param->set_name(net_->name());
+    }
+    int changed = 0;
+    for (int i = 0; i < layers.size(); ++i) {
+      uint64_t hash = 0ULL;
+      for (const shared_ptr<Blob>& blob : layers[i]->blobs()) {
+        hash = DataHash(blob.get(), hash);
+      }
+      if (snapshot_delta_ && hash != snapshot_layer_hashes_[i]) {
+        layers[i]->ToProto(net_param->add_layer(), false);
+        ++changed;
+      }
+      snapshot_layer_hashes_[i] = hash;
+    }
+    LOG_IF(INFO, snapshot_delta_) << "Delta snapshot: " << changed << " of "
+        << layers.size() << " layers changed since " << snapshot_base_;
+  } else {
+    net_->ToProto(net_param.get(), param_.snapshot_diff());
+  }
+  WriteSnapshot(net_param, model_filename);
   return model_filename;
 }
 
+// MurmurHash64A
+uint64_t Solver::DataHash(Blob* blob, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const size_t bytes = blob->count() * tsize(blob->data_type());
+  uint64_t h = seed ^ (bytes * m);
+  if (bytes > 0UL) {
+    const unsigned char* data =
+        static_cast<const unsigned char*>(blob->current_data_memory(false));
+    const size_t words = bytes / 8UL;
+    for (size_t i = 0; i < words; ++i) {
+      uint64_t k;
+      std::memcpy(&k, data + i * 8UL, 8UL);
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+    const unsigned char* tail = data + words * 8UL;
+    switch (bytes & 7UL) {
+      case 7: h ^= uint64_t(tail[6]) << 48;  // fall through
+      case 6: h ^= uint64_t(tail[5]) << 40;  // fall through
+      case 5: h ^= uint64_t(tail[4]) << 32;  // fall through
+      case 4: h ^= uint64_t(tail[3]) << 24;  // fall through
+      case 3: h ^= uint64_t(tail[2]) << 16;  // fall through
+      case 2: h ^= uint64_t(tail[1]) << 8;  // fall through
+      case 1: h ^= uint64_t(tail[0]);
+        h *= m;
+    }
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+void Solver::WriteSnapshot(const shared_ptr<Message>& proto, const string& filename) {
+  if (!param_.snapshot_async()) {
+    WriteProtoToBinaryFile(*proto, filename);
+    return;
+  }
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new SnapshotWriter(param_.snapshot_async_pending()));
+  }
+  snapshot_writer_->Write(proto, filename);
+}
+
+void Solver::WaitForSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
+}
+
 string Solver::SnapshotToHDF5() {
   string model_filename = SnapshotFilename(".caffemodel.h5");
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
@@ -600,6 +710,7 @@ string Solver::SnapshotToHDF5() {
 
 void Solver::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
+  WaitForSnapshots();
   string state_filename(state_file);
   if (state_filename.size() >= 3 &&
       state_filename.compare(state_filename.size() - 3, 3, ".h5") == 0) {
@@ -607,6 +718,10 @@ void Solver::Restore(const char* state_file) {
   } else {
     RestoreSolverStateFromBinaryProto(state_filename);
   }
+  // Deltas are taken against the snapshots of this run, starting with a full one
+  snapshot_base_.clear();
+  snapshot_deltas_ = 0;
+  snapshot_layer_hashes_.clear();
 }
 
 void Solver::UpdateSmoothedLoss(float loss, int start_iter,
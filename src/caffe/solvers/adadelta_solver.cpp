@@ -30,58 +30,25 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, void* handle, float
   const vector<shared_ptr<Blob>>& net_params = this->net_->learnable_params();
   shared_ptr<Blob> param = net_params[param_id];
   shared_ptr<TBlob<Dtype>> history = this->history_[param_id];
-  shared_ptr<TBlob<Dtype>> update = this->update_[param_id];
-  shared_ptr<TBlob<Dtype>> temp = this->temp_[param_id];
   const vector<float>& net_params_lr = this->net_->params_lr();
   float delta =  std::max(this->param_.delta(), 0.001F);
   float momentum = this->param_.momentum();
   float local_rate = rate * net_params_lr[param_id];
   size_t update_history_offset = net_params.size();
   if (Caffe::mode() == Caffe::CPU) {
-    // compute square of gradient in update
-    caffe_powx<Dtype>(param->count(), param->cpu_diff<Dtype>(), Dtype(2.F),
-        update->mutable_cpu_data());
-
-    // update history of gradients
-    caffe_cpu_axpby<Dtype>(param->count(), Dtype(1.F - momentum), update->cpu_data(), momentum,
-        history->mutable_cpu_data());
-
-    // add delta to history to guard against dividing by zero later
-    caffe_set<Dtype>(param->count(), delta, temp->mutable_cpu_data());
-
-    caffe_add<Dtype>(param->count(), temp->cpu_data(),
-        this->history_[update_history_offset + param_id]->cpu_data(), update->mutable_cpu_data());
-
-    caffe_add<Dtype>(param->count(), temp->cpu_data(), history->cpu_data(),
-        temp->mutable_cpu_data());
-
-    // divide history of updates by history of gradients
-    caffe_div<Dtype>(param->count(), update->cpu_data(), temp->cpu_data(),
-        update->mutable_cpu_data());
-
-    // jointly compute the RMS of both for update and gradient history
-    caffe_powx<Dtype>(param->count(), update->cpu_data(), Dtype(0.5), update->mutable_cpu_data());
-
-    // compute the update
-    caffe_mul<Dtype>(param->count(), param->cpu_diff<Dtype>(), update->cpu_data(),
-        param->mutable_cpu_diff<Dtype>());
-
-    // compute square of update
-    caffe_powx<Dtype>(param->count(), param->cpu_diff<Dtype>(), Dtype(2.F),
-        update->mutable_cpu_data());
-
-    // update history of updates
-    caffe_cpu_axpby<Dtype>(param->count(), Dtype(1.F - momentum), update->cpu_data(), momentum,
-        this->history_[update_history_offset + param_id]->mutable_cpu_data());
-
-    // apply learning rate
-    caffe_cpu_scale<Dtype>(param->count(), local_rate, param->cpu_diff<Dtype>(),
-        param->mutable_cpu_diff<Dtype>());
-
-    param->Update();
-    if (clear_grads) {
-      param->set_diff(0.F);
-    }
+    typedef typename SGDSolver<Dtype>::Mtype Mtype;
+    Dtype* h = history->mutable_cpu_data();
+    Dtype* h_update = this->history_[update_history_offset + param_id]->mutable_cpu_data();
+    this->UpdateCpu(param_id, clear_grads, [&](int i, Mtype g) {
+      // history of gradients, then the RMS of both histories scales the gradient
+      const Mtype hi = (1.F - momentum) * g * g + momentum * static_cast<Mtype>(h[i]);
+      h[i] = static_cast<Dtype>(hi);
+      const Mtype u = g * std::sqrt((static_cast<Mtype>(h_update[i]) + delta) / (hi + delta));
+      // history of updates, before the learning rate
+      h_update[i] = static_cast<Dtype>((1.F - momentum) * u * u
+          + momentum * static_cast<Mtype>(h_update[i]));
+      return local_rate * u;
+    });
   } else if (Caffe::mode() == Caffe::GPU) {
 #ifndef CPU_ONLY
     const std::string& regularization_type = this->param_.regularization_type();
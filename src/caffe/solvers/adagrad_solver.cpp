@@ -17,31 +17,17 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, void *handle, float
     bool clear_grads) {
   shared_ptr<Blob> param = this->net_->learnable_params()[param_id];
   shared_ptr<TBlob<Dtype>> history = this->history_[param_id];
-  shared_ptr<TBlob<Dtype>> update = this->update_[param_id];
   const vector<float> &net_params_lr = this->net_->params_lr();
   float delta = std::max(this->param_.delta(), 0.001f);
   float local_rate = rate * net_params_lr[param_id];
   if (Caffe::mode() == Caffe::CPU) {
-    // compute square of gradient in update
-    caffe_powx<Dtype>(param->count(), param->cpu_diff<Dtype>(), Dtype(2.F),
-        update->mutable_cpu_data());
-    // update history
-    caffe_add<Dtype>(param->count(), update->cpu_data(), history->cpu_data(),
-        history->mutable_cpu_data());
-    // prepare update
-    caffe_powx<Dtype>(param->count(), history->cpu_data(), Dtype(0.5),
-        update->mutable_cpu_data());
-    caffe_add_scalar<Dtype>(param->count(), delta, update->mutable_cpu_data());
-    caffe_div<Dtype>(param->count(), param->cpu_diff<Dtype>(), update->cpu_data(),
-        update->mutable_cpu_data());
-    // scale and copy
-    caffe_cpu_axpby<Dtype>(param->count(), local_rate, update->cpu_data(), Dtype(0.),
-        param->mutable_cpu_diff<Dtype>());
-
-    param->Update();
-    if (clear_grads) {
-      param->set_diff(0.F);
-    }
+    typedef typename SGDSolver<Dtype>::Mtype Mtype;
+    Dtype* h = history->mutable_cpu_data();
+    this->UpdateCpu(param_id, clear_grads, [&](int i, Mtype g) {
+      const Mtype hi = static_cast<Mtype>(h[i]) + g * g;
+      h[i] = static_cast<Dtype>(hi);
+      return local_rate * g / (std::sqrt(hi) + delta);
+    });
   } else if (Caffe::mode() == Caffe::GPU) {
 #ifndef CPU_ONLY
     const std::string& regularization_type = this->param_.regularization_type();
@@ -37,38 +37,27 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, void* handle, float rat
   size_t update_history_offset = net_params.size();
   TBlob<Dtype>* val_m = this->history_[param_id].get();
   TBlob<Dtype>* val_v = this->history_[param_id + update_history_offset].get();
-  TBlob<Dtype>* val_t = this->temp_[param_id].get();
 
   const int t = this->iter_ + 1;
   const float correction = std::sqrt(1.F - pow(beta2, float(t))) / (1.F - pow(beta1, float(t)));
-  const int N = param->count();
   const float eps_hat = std::max(this->param_.delta(), 0.0001F);
 
   if (Caffe::mode() == Caffe::CPU) {
-    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
-    caffe_cpu_axpby<Dtype>(N, Dtype(1.F - beta1), param->cpu_diff<Dtype>(), beta1,
-        val_m->mutable_cpu_data());
-
-    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
-    caffe_mul<Dtype>(N, param->cpu_diff<Dtype>(), param->cpu_diff<Dtype>(),
-        val_t->mutable_cpu_data());
-    caffe_cpu_axpby<Dtype>(N, Dtype(1.F - beta2), val_t->cpu_data(), beta2,
-        val_v->mutable_cpu_data());
-
-    // set update
-    caffe_powx<Dtype>(N, val_v->cpu_data(), Dtype(0.5), val_t->mutable_cpu_data());
-    caffe_add_scalar<Dtype>(N, eps_hat, val_t->mutable_cpu_data());
-    caffe_div<Dtype>(N, val_m->cpu_data(), val_t->cpu_data(), val_t->mutable_cpu_data());
-
-    caffe_cpu_scale<Dtype>(N, Dtype(local_rate * correction), val_t->cpu_data(),
-        param->mutable_cpu_diff<Dtype>());
-
-    param->Update();
-    if (clear_grads) {
-      param->set_diff(0.F);
-    }
+    typedef typename SGDSolver<Dtype>::Mtype Mtype;
+    Dtype* m = val_m->mutable_cpu_data();
+    Dtype* v = val_v->mutable_cpu_data();
+    const float corrected_rate = local_rate * correction;
+    this->UpdateCpu(param_id, clear_grads, [&](int i, Mtype g) {
+      // m <- \beta_1 m_{t-1} + (1-\beta_1)g_t, v <- \beta_2 v_{t-1} + (1-\beta_2)g_t^2
+      const Mtype mi = (1.F - beta1) * g + beta1 * static_cast<Mtype>(m[i]);
+      const Mtype vi = (1.F - beta2) * g * g + beta2 * static_cast<Mtype>(v[i]);
+      m[i] = static_cast<Dtype>(mi);
+      v[i] = static_cast<Dtype>(vi);
+      return corrected_rate * mi / (std::sqrt(vi) + eps_hat);
+    });
   } else if (Caffe::mode() == Caffe::GPU) {
 #ifndef CPU_ONLY
+    const int N = param->count();
     const std::string& regularization_type = this->param_.regularization_type();
     float decay = this->local_decay(param_id);
     const Type gtype = param->diff_type();
@@ -17,29 +17,19 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, void *handle, float
     bool clear_grads) {
   shared_ptr<Blob> param = this->net_->learnable_params()[param_id];
   shared_ptr<TBlob<Dtype>> history = this->history_[param_id];
-  shared_ptr<TBlob<Dtype>> update = this->update_[param_id];
   const vector<float>& net_params_lr = this->net_->params_lr();
   float momentum = this->param_.momentum();
   float local_rate = rate * net_params_lr[param_id];
   if (Caffe::mode() == Caffe::CPU) {
-    // save history momentum for stepping back
-    caffe_copy<Dtype>(param->count(), history->cpu_data(), update->mutable_cpu_data());
-
-    // update history
-    caffe_cpu_axpby<Dtype>(param->count(), local_rate, param->cpu_diff<Dtype>(), momentum,
-        history->mutable_cpu_data());
-
-    // compute update: step back then over step
-    caffe_cpu_axpby<Dtype>(param->count(), Dtype(1.F + momentum), history->cpu_data(), -momentum,
-        update->mutable_cpu_data());
-
-    // copy
-    caffe_copy<Dtype>(param->count(), update->cpu_data(), param->mutable_cpu_diff<Dtype>());
-
-    param->Update();
-    if (clear_grads) {
-      param->set_diff(0.F);
-    }
+    typedef typename SGDSolver<Dtype>::Mtype Mtype;
+    Dtype* h = history->mutable_cpu_data();
+    this->UpdateCpu(param_id, clear_grads, [&](int i, Mtype g) {
+      const Mtype h_prev = static_cast<Mtype>(h[i]);
+      const Mtype hi = momentum * h_prev + local_rate * g;
+      h[i] = static_cast<Dtype>(hi);
+      // step back then over step
+      return (1.F + momentum) * hi - momentum * h_prev;
+    });
   } else if (Caffe::mode() == Caffe::GPU) {
 #ifndef CPU_ONLY
     const std::string& regularization_type = this->param_.regularization_type();
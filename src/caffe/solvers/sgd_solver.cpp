@@ -149,7 +149,8 @@ void SGDSolver<Dtype>::ApplyUpdate(int param_id, void* handle, bool clear_grads)
 
 template<typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id, void* handle) {
-  if (this->param_.iter_size() == 1) { return; }
+  // CPU update fuses it with ComputeUpdateValue
+  if (this->param_.iter_size() == 1 || Caffe::mode() == Caffe::CPU) { return; }
   // Scale gradient to counterbalance accumulation.
   const vector<shared_ptr<Blob>>& net_params = this->net_->learnable_params();
   const float accum_normalization = 1.F / this->param_.iter_size();
@@ -158,36 +159,7 @@ void SGDSolver<Dtype>::Normalize(int param_id, void* handle) {
 
 template<typename Dtype>
 void SGDSolver<Dtype>::Regularize(int param_id, void* handle) {
-  if (Caffe::mode() == Caffe::CPU) {
-    const vector<shared_ptr<Blob>>& net_params = this->net_->learnable_params();
-    const vector<float>& net_params_weight_decay = this->net_->params_weight_decay();
-    float weight_decay = this->param_.weight_decay();
-    string regularization_type = this->param_.regularization_type();
-    float local_decay = weight_decay * net_params_weight_decay[param_id];
-    if (local_decay) {
-      if (regularization_type == "L2") {
-        // add weight decay
-        caffe_axpy<Dtype>(net_params[param_id]->count(), local_decay,
-            net_params[param_id]->cpu_data<Dtype>(),
-            net_params[param_id]->mutable_cpu_diff<Dtype>());
-      } else if (regularization_type == "L1") {
-        caffe_cpu_sign<Dtype>(net_params[param_id]->count(),
-            net_params[param_id]->cpu_data<Dtype>(), temp_[param_id]->mutable_cpu_data());
-        caffe_axpy<Dtype>(net_params[param_id]->count(), local_decay, temp_[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff<Dtype>());
-      } else {
-        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
-      }
-    }
-  } else if (Caffe::mode() == Caffe::GPU) {
-#ifndef CPU_ONLY
-    //Fused with ComputeUpdateValue
-#else
-    NO_GPU;
-#endif
-  } else {
-    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
-  }
+  // Fused with ComputeUpdateValue on both CPU and GPU
 }
 
 #ifndef CPU_ONLY
@@ -211,13 +183,12 @@ SGDSolver<Dtype>::ComputeUpdateValue(int param_id, void* handle, float rate, boo
   float local_rate = rate * GetLocalRate(param_id);
   // Compute the update to history, then copy it to the parameter diff.
   if (Caffe::mode() == Caffe::CPU) {
-    caffe_cpu_axpby<Dtype>(param->count(), local_rate, param->cpu_diff<Dtype>(), momentum,
-        history->mutable_cpu_data());
-    caffe_copy<Dtype>(param->count(), history->cpu_data(), param->mutable_cpu_diff<Dtype>());
-    param->Update();
-    if (clear_grads) {
-      param->set_diff(0.F);
-    }
+    Dtype* h = history->mutable_cpu_data();
+    this->UpdateCpu(param_id, clear_grads, [&](int i, Mtype g) {
+      const Mtype hi = momentum * static_cast<Mtype>(h[i]) + local_rate * g;
+      h[i] = static_cast<Dtype>(hi);
+      return hi;
+    });
   } else if (Caffe::mode() == Caffe::GPU) {
 #ifndef CPU_ONLY
     const std::string& regularization_type = this->param_.regularization_type();
@@ -260,7 +231,9 @@ float SGDSolver<Dtype>::GetLocalRate(int param_id) const {
   if (this->param_.local_lr_auto()) {
     shared_ptr<Blob> param = this->net_->learnable_params()[param_id];
     const float w_norm = std::sqrt(param->sumsq_data());
-    const float wgrad_norm = std::sqrt(param->sumsq_diff());
+    // CPU normalizes the gradient in the fused update, after this
+    const float wgrad_norm = std::sqrt(param->sumsq_diff()) *
+        (Caffe::mode() == Caffe::CPU ? 1.F / this->param_.iter_size() : 1.F);
     const float gw_ratio = this->param_.local_gw_ratio();
     float rate = 1.F;
 
@@ -331,19 +304,37 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 
 template<typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+  shared_ptr<SolverState> state = make_shared<SolverState>();
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->clear_history();
+  const bool track = this->param_.snapshot_delta_chain() > 0 && !this->param_.snapshot_diff();
+  const bool delta = this->snapshot_delta();
+  if (delta) {
+    state->set_delta_base(this->snapshot_base());
+  } else if (track) {
+    history_hashes_.assign(history_.size(), 0ULL);
+  }
   for (int i = 0; i < history_.size(); ++i) {
+    if (track) {
+      const uint64_t hash = Solver::DataHash(history_[i].get());
+      const bool changed = hash != history_hashes_[i];
+      history_hashes_[i] = hash;
+      if (delta && !changed) {
+        continue;
+      }
+      if (delta) {
+        state->add_history_index(i);
+      }
+    }
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->template ToProto<Dtype>(history_blob, param().store_blobs_in_old_format());
   }
   string snapshot_filename = Solver::SnapshotFilename(".solverstate");
   LOG(INFO) << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSnapshot(state, snapshot_filename);
 }
 
 template<typename Dtype>
@@ -368,8 +359,23 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(const string& model_filename) {
 
 template<typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(const string& state_file) {
+  std::set<string> chain;
+  RestoreSolverStateChain(state_file, &chain);
+}
+
+template<typename Dtype>
+void SGDSolver<Dtype>::RestoreSolverStateChain(const string& state_file,
+    std::set<string>* chain) {
+  CHECK(chain->insert(state_file).second) << "Delta snapshot chain of " << state_file
+      << " has a cycle";
   SolverState state;
   ReadProtoFromBinaryFile(state_file, &state);
+  if (state.has_delta_base()) {
+    CHECK_NE(state.delta_base(), state_file) << state_file << " is a delta of itself";
+    // Restore the state this delta applies to first
+    LOG(INFO) << "SGDSolver: " << state_file << " is a delta of " << state.delta_base();
+    RestoreSolverStateChain(state.delta_base(), chain);
+  }
   this->iter_ = state.iter();
   Caffe::set_restored_iter(this->iter_);
   if (state.has_learned_net()) {
@@ -378,8 +384,19 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(const string& state_fil
     this->net_->CopyTrainedLayersFrom(net_param);
   }
   this->current_step_ = state.current_step();
-  CHECK_EQ(state.history_size(), history_.size()) << "Incorrect length of history blobs.";
   LOG(INFO) << "SGDSolver: restoring history";
+  if (state.has_delta_base()) {
+    CHECK_EQ(state.history_size(), state.history_index_size())
+        << "Incorrect length of history blobs.";
+    for (int k = 0; k < state.history_index_size(); ++k) {
+      const int i = state.history_index(k);
+      CHECK_GE(i, 0);
+      CHECK_LT(i, static_cast<int>(history_.size())) << "Incorrect history blob index";
+      history_[i]->FromProto(state.history(k));
+    }
+    return;
+  }
+  CHECK_EQ(state.history_size(), history_.size()) << "Incorrect length of history blobs.";
   for (int i = 0; i < history_.size(); ++i) {
     history_[i]->FromProto(state.history(i));
   }
@@ -2,6 +2,7 @@
 #include "caffe/syncedmem.hpp"
 #include "caffe/type.hpp"
 #include "caffe/util/gpu_memory.hpp"
+#include "caffe/util/host_memory.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -11,28 +12,22 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Both kinds come from HostMemory, which keeps freed buffers for reuse.
 void SyncedMemory::MallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     shared_lock<shared_mutex> lock(GPUMemory::read_write_mutex());
-    CUDA_CHECK(cudaMallocHost(ptr, size));
+    *ptr = HostMemory::allocate(size, true);
     *use_cuda = true;
     return;
   }
 #endif
-  *ptr = malloc(size);
+  *ptr = HostMemory::allocate(size, false);
   *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-void SyncedMemory::FreeHost(void* ptr, bool use_cuda) {
-#ifndef CPU_ONLY
-  if (use_cuda) {
-    CUDA_CHECK(cudaFreeHost(ptr));
-    return;
-  }
-#endif
-  free(ptr);
+void SyncedMemory::FreeHost(void* ptr) {
+  HostMemory::deallocate(ptr);
 }
 
 SyncedMemory::~SyncedMemory() {
@@ -40,7 +35,7 @@ SyncedMemory::~SyncedMemory() {
 #ifndef CPU_ONLY
     shared_lock<shared_mutex> lock(GPUMemory::read_write_mutex());
 #endif
-    FreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost(cpu_ptr_);
   }
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
@@ -119,7 +114,7 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    FreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost(cpu_ptr_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
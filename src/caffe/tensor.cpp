@@ -1,3 +1,4 @@
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -5,10 +6,16 @@
 
 namespace caffe {
 
+// Process-wide, so that a tensor never reuses the version of another one
+static uint64_t next_version() {
+  static std::atomic<uint64_t> version(0UL);
+  return version.fetch_add(1UL, std::memory_order_relaxed) + 1UL;
+}
+
 Tensor::Tensor(Type dtype)
     : type_(dtype),
       synced_arrays_(make_shared<vector<shared_ptr<SyncedMemory>>>(Type_ARRAYSIZE)),
-      count_(0) {}
+      count_(0), version_(next_version()) {}
 
 const shared_ptr<SyncedMemory>& Tensor::synced_mem() const {
   const shared_ptr<SyncedMemory>& mem = synced_arrays_->at(type_);
@@ -19,6 +26,7 @@ const shared_ptr<SyncedMemory>& Tensor::synced_mem() const {
 
 shared_ptr<SyncedMemory>& Tensor::mutable_synced_mem(bool flush) {
   shared_ptr<SyncedMemory>& mem = synced_arrays_->at(type_);
+  version_ = next_version();
   // We are about to assign something here, thus validate in advance:
   if (mem) {
     mem->validate();
@@ -43,14 +51,25 @@ void Tensor::invalidate_others() {
 
 void Tensor::Reshape(int count) {
   shared_ptr<SyncedMemory>& mem = mutable_synced_mem(false);
-  const std::size_t cur_size = even(count_) * tsize(type_);
   const std::size_t new_size = even(count) * tsize(type_);
-  if (!mem || new_size > cur_size) {
+  // Memory is kept as long as it is large enough: shrinking and growing back
+  // (e.g. batch size changing from call to call) allocates nothing
+  if (!mem || new_size > mem->size()) {
     mem = make_shared<SyncedMemory>(new_size);
   }
   count_ = count;
 }
 
+void Tensor::set_cpu_data(void* data) {
+  shared_ptr<SyncedMemory>& mem = mutable_synced_mem();
+  // Memory set from outside holds count_ entries, growing further reallocates
+  const std::size_t size = even(count_) * tsize(type_);
+  if (!mem || mem->size() != size) {
+    mem = make_shared<SyncedMemory>(size);
+  }
+  mem->set_cpu_data(data);
+}
+
 void Tensor::convert(Type new_type) {
   if (new_type == type_) {
     return;
@@ -0,0 +1,167 @@
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/text_format.h>
+#include "gtest/gtest.h"
+
+#include "caffe/batching_server.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class BatchingServerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  shared_ptr<Net> InitNet() {
+    const string proto =
+        "name: 'BatchingNetwork' "
+        "state: { phase: TEST } "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 1 dim: 3 dim: 4 dim: 4 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_default_forward_type(tp<Dtype>());
+    param.set_default_backward_type(tp<Dtype>());
+    param.set_default_forward_math(tp<Dtype>());
+    param.set_default_backward_math(tp<Dtype>());
+    return make_shared<Net>(param);
+  }
+
+  // Answers of a net of its own, one sample at a time
+  void Expected(const vector<shared_ptr<TBlob<float>>>& inputs,
+      vector<shared_ptr<TBlob<float>>>* outputs) {
+    shared_ptr<Net> net = InitNet();
+    net->ShareTrainedLayersWith(net_.get());
+    for (const shared_ptr<TBlob<float>>& input : inputs) {
+      net->input_blobs()[0]->CopyFrom(*input);
+      outputs->push_back(make_shared<TBlob<float>>());
+      outputs->back()->CopyFrom(*net->Forward()[0], false, true);
+    }
+  }
+
+  shared_ptr<Net> net_;
+};
+
+TYPED_TEST_CASE(BatchingServerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BatchingServerTest, TestFullBatch) {
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<float> filler(filler_param);
+  vector<shared_ptr<TBlob<float>>> inputs, outputs, expected;
+  for (int r = 0; r < 8; ++r) {
+    inputs.push_back(make_shared<TBlob<float>>(1, 3, 4, 4));
+    filler.Fill(inputs.back().get());
+    outputs.push_back(make_shared<TBlob<float>>());
+  }
+  this->net_ = this->InitNet();
+  this->Expected(inputs, &expected);
+  // Deadline far away: batches are closed by reaching max_batch only
+  BatchingServer server(this->net_, 4, 10000000);
+  vector<std::future<void>> done;
+  for (int r = 0; r < inputs.size(); ++r) {
+    done.push_back(server.Submit({inputs[r].get()}, {outputs[r].get()}));
+  }
+  for (std::future<void>& f : done) {
+    f.get();
+  }
+  EXPECT_EQ(server.batches(), 2);
+  EXPECT_EQ(server.requests(), 8);
+  for (int r = 0; r < inputs.size(); ++r) {
+    ASSERT_EQ(expected[r]->shape(), outputs[r]->shape());
+    for (int i = 0; i < outputs[r]->count(); ++i) {
+      EXPECT_NEAR(expected[r]->cpu_data()[i], outputs[r]->cpu_data()[i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(BatchingServerTest, TestDeadline) {
+  Caffe::set_mode(TypeParam::device);
+  this->net_ = this->InitNet();
+  BatchingServer server(this->net_, 16, 1000, 2);
+  TBlob<float> input(1, 3, 4, 4), output;
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&input);
+  // A lone request is answered once its deadline passes
+  server.Infer({&input}, {&output});
+  EXPECT_EQ(server.batches(), 1);
+  EXPECT_EQ(output.num(), 1);
+  EXPECT_EQ(output.count(), 5);
+}
+
+TYPED_TEST(BatchingServerTest, TestConcurrentClients) {
+  Caffe::set_mode(TypeParam::device);
+  const int kThreads = 8;
+  const int kRequests = 16;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<float> filler(filler_param);
+  vector<shared_ptr<TBlob<float>>> inputs, outputs, expected;
+  for (int r = 0; r < kThreads * kRequests; ++r) {
+    inputs.push_back(make_shared<TBlob<float>>(1, 3, 4, 4));
+    filler.Fill(inputs.back().get());
+    outputs.push_back(make_shared<TBlob<float>>());
+  }
+  this->net_ = this->InitNet();
+  this->Expected(inputs, &expected);
+  {
+    BatchingServer server(this->net_, 8, 500, 2);
+    vector<std::thread> clients;
+    for (int t = 0; t < kThreads; ++t) {
+      clients.emplace_back([&, t] {
+        for (int r = t * kRequests; r < (t + 1) * kRequests; ++r) {
+          server.Infer({inputs[r].get()}, {outputs[r].get()});
+        }
+      });
+    }
+    for (std::thread& client : clients) {
+      client.join();
+    }
+    EXPECT_EQ(server.requests(), kThreads * kRequests);
+    EXPECT_LE(server.batches(), kThreads * kRequests);
+  }
+  for (int r = 0; r < inputs.size(); ++r) {
+    ASSERT_EQ(expected[r]->shape(), outputs[r]->shape());
+    for (int i = 0; i < outputs[r]->count(); ++i) {
+      EXPECT_NEAR(expected[r]->cpu_data()[i], outputs[r]->cpu_data()[i], 1e-5);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -26,7 +26,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), snapshot_async_(false), snapshot_delta_(false), frozen_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -41,6 +41,10 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool snapshot_async_;
+  bool snapshot_delta_;
+  // Puts a layer with lr_mult: 0 (learnable params 0 and 1) before innerprod
+  bool frozen_;
   float delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -102,6 +106,28 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "    top: 'data' "
        "    top: 'targets' "
        "  } ";
+    if (frozen_) {
+      proto <<
+         "  layer { "
+         "    name: 'frozen' "
+         "    type: 'InnerProduct' "
+         "    param { lr_mult: 0 } "
+         "    param { lr_mult: 0 } "
+         "    inner_product_param { "
+         "      num_output: 3 "
+         "      weight_filler { "
+         "        type: 'gaussian' "
+         "        std: 1.0 "
+         "      } "
+         "      bias_filler { "
+         "        type: 'gaussian' "
+         "        std: 1.0 "
+         "      } "
+         "    } "
+         "    bottom: 'data' "
+         "    top: 'frozen' "
+         "  } ";
+    }
     if (share_) {
       proto <<
          "  layer { "
@@ -132,7 +158,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "        std: 1.0 "
        "      } "
        "    } "
-       "    bottom: '" << string(share_ ? "data1": "data") << "' "
+       "    bottom: '" << string(share_ ? "data1": (frozen_ ? "frozen" : "data")) << "' "
        "    top: '" << string(share_ ? "innerprod1": "innerprod") << "' "
        "  } ";
     if (share_) {
@@ -184,7 +210,15 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
-      proto << "snapshot: " << num_iters << " ";
+      if (snapshot_delta_) {
+        // Every iteration after the first one snapshots a delta
+        proto << "snapshot: 1 snapshot_delta_chain: " << num_iters << " ";
+      } else {
+        proto << "snapshot: " << num_iters << " ";
+      }
+      if (snapshot_async_) {
+        proto << "snapshot_async: true ";
+      }
     }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
@@ -545,11 +579,38 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     string snapshot_name = RunLeastSquaresSolver(learning_rate, weight_decay,
         momentum, num_iters, kIterSize, kDevices, snapshot);
 
-    // Reinitialize the solver and run for num_iters more iterations.
+    if (frozen_ && snapshot_delta_ && num_iters > 1) {
+      // The last snapshot is a delta: the frozen layer and its (zero)
+      // history never change, so only the base of the chain has them
+      SolverState state;
+      ASSERT_TRUE(ReadProtoFromBinaryFile(snapshot_name, &state));
+      EXPECT_TRUE(state.has_delta_base());
+      for (int index : state.history_index()) {
+        EXPECT_GE(index, 2) << "frozen history in " << snapshot_name;
+      }
+      NetParameter delta_net;
+      ASSERT_TRUE(ReadProtoFromBinaryFile(state.learned_net(), &delta_net));
+      bool has_innerprod = false;
+      for (const LayerParameter& layer : delta_net.layer()) {
+        EXPECT_NE("frozen", layer.name()) << "in " << state.learned_net();
+        has_innerprod = has_innerprod || layer.name() == "innerprod";
+      }
+      EXPECT_TRUE(has_innerprod);
+    }
+
+    // Reinitialize the solver and run for num_iters more iterations. With a
+    // frozen layer the fillers draw other values: its params match only if
+    // the snapshot chain restores them.
     snapshot = false;
+    if (frozen_) {
+      ++this->seed_;
+    }
     RunLeastSquaresSolver(learning_rate, weight_decay, momentum,
         total_num_iters, kIterSize, kDevices,
         snapshot, snapshot_name.c_str());
+    if (frozen_) {
+      --this->seed_;
+    }
 
     // Check that params now match.
     const vector<shared_ptr<Blob>>& params = solver_->net()->learnable_params();
@@ -711,6 +772,40 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  const float kLearningRate = 0.01;
+  const float kWeightDecay = 0.5;
+  const float kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotDelta) {
+  const float kLearningRate = 0.01;
+  const float kWeightDecay = 0.5;
+  const float kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_delta_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotDeltaFrozen) {
+  const float kLearningRate = 0.01;
+  const float kWeightDecay = 0.5;
+  const float kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_delta_ = true;
+  this->frozen_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -1252,4 +1347,34 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+TEST(RegUpdateAndClearCpuTest, TestL1NormalizedSgdStep) {
+  // w -= h = 0.5 * h + 0.1 * (g / 2 + 0.01 * sign(w))
+  float g[4] = {2.F, -2.F, 0.F, 4.F};
+  float w[4] = {1.F, -1.F, 0.F, -3.F};
+  float h[4] = {0.F, 1.F, -1.F, 2.F};
+  float expected_w[4], expected_h[4];
+  for (int i = 0; i < 4; ++i) {
+    const float sign = static_cast<float>((0.F < w[i]) - (w[i] < 0.F));
+    expected_h[i] = 0.5F * h[i] + 0.1F * (0.5F * g[i] + 0.01F * sign);
+    expected_w[i] = w[i] - expected_h[i];
+  }
+  reg_update_and_clear_cpu<float>(4, g, w, 0.5F, "L1", 0.01F, false, [&](int i, float gi) {
+    h[i] = 0.5F * h[i] + 0.1F * gi;
+    return h[i];
+  });
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FLOAT_EQ(expected_h[i], h[i]);
+    EXPECT_FLOAT_EQ(expected_w[i], w[i]);
+    // the step stays in the gradient unless it is cleared
+    EXPECT_FLOAT_EQ(expected_h[i], g[i]);
+  }
+  reg_update_and_clear_cpu<float>(4, g, w, 1.F, "L2", 0.F, true, [](int i, float gi) {
+    return 0.F;
+  });
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(0.F, g[i]);
+    EXPECT_FLOAT_EQ(expected_w[i], w[i]);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,61 @@
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/gradient_compression.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class GradientCompressionTest : public ::testing::Test {};
+
+TEST_F(GradientCompressionTest, TestTopKWithErrorFeedback) {
+  const float g[6] = {0.1F, -3.F, 0.2F, 2.F, -0.3F, 0.F};
+  std::vector<float> residual = {0.F, 0.F, 0.F, 0.F, -0.5F, 0.F};
+  std::vector<SparseGradient> sent(2);
+  caffe_cpu_topk_compress(6, g, residual.data(), 2, sent.data());
+
+  // -3 and 2 are sent, the rest (with -0.5 fed back) stays behind
+  std::vector<float> dense(6);
+  caffe_cpu_sparse_accumulate(6, 2, sent.data(), dense.data());
+  const float expected_dense[6] = {0.F, -3.F, 0.F, 2.F, 0.F, 0.F};
+  const float expected_residual[6] = {0.1F, 0.F, 0.2F, 0.F, -0.8F, 0.F};
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_FLOAT_EQ(expected_dense[i], dense[i]);
+    EXPECT_FLOAT_EQ(expected_residual[i], residual[i]);
+  }
+
+  // Next round: the residual -0.8 now outweighs the fresh gradients
+  const float g2[6] = {0.F, 0.F, 0.F, 0.F, 0.F, 0.4F};
+  caffe_cpu_topk_compress(6, g2, residual.data(), 1, sent.data());
+  EXPECT_EQ(4, sent[0].index);
+  EXPECT_FLOAT_EQ(-0.8F, sent[0].value);
+  EXPECT_FLOAT_EQ(0.F, residual[4]);
+  EXPECT_FLOAT_EQ(0.4F, residual[5]);
+}
+
+TEST_F(GradientCompressionTest, TestHalf) {
+  // Exact halves, ties to even, a subnormal, overflow
+  const float g[6] = {1.5F, -0.25F, 1.F + 1.F / 2048.F, 1.F + 3.F / 2048.F,
+      3.F / 16777216.F, 70000.F};
+  std::vector<uint16_t> halves(12);
+  caffe_cpu_half_compress(6, g, halves.data());
+  const uint16_t expected_halves[6] = {0x3e00, 0xb400, 0x3c00, 0x3c02, 0x0003, 0x7c00};
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected_halves[i], halves[i]);
+  }
+
+  // Two solvers' halves summed
+  caffe_cpu_half_compress(6, g, halves.data() + 6);
+  std::vector<float> sum(6);
+  caffe_cpu_half_accumulate(6, 2, halves.data(), sum.data());
+  const float expected_sum[6] = {3.F, -0.5F, 2.F, 2.F + 8.F / 2048.F, 6.F / 16777216.F,
+      std::numeric_limits<float>::infinity()};
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected_sum[i], sum[i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,189 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/text_format.h>
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_engine.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class InferenceEngineTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  shared_ptr<Net> InitNet() {
+    const string proto =
+        "name: 'InferenceNetwork' "
+        "state: { phase: TEST } "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'scale' "
+        "  type: 'Scale' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "  scale_param { "
+        "    filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "    bias_term: true "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_default_forward_type(tp<Dtype>());
+    param.set_default_backward_type(tp<Dtype>());
+    param.set_default_forward_math(tp<Dtype>());
+    param.set_default_backward_math(tp<Dtype>());
+    return make_shared<Net>(param);
+  }
+};
+
+TYPED_TEST_CASE(InferenceEngineTest, TestDtypesAndDevices);
+
+TYPED_TEST(InferenceEngineTest, TestConcurrentInfer) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  const int kThreads = 6;
+  const int kRequests = 10;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  // Requests of varying batch size, answered one at a time first
+  shared_ptr<Net> ref_net = this->InitNet();
+  vector<shared_ptr<TBlob<Dtype>>> inputs, expected;
+  for (int r = 0; r < kThreads * kRequests; ++r) {
+    inputs.push_back(make_shared<TBlob<Dtype>>(1 + r % 3, 3, 6, 6));
+    filler.Fill(inputs.back().get());
+    expected.push_back(make_shared<TBlob<Dtype>>());
+  }
+  InferenceEngine engine(ref_net, 3);
+  EXPECT_EQ(engine.instances(), 3);
+  for (int r = 0; r < inputs.size(); ++r) {
+    engine.Infer({inputs[r].get()}, {expected[r].get()});
+  }
+
+  vector<shared_ptr<TBlob<Dtype>>> outputs(inputs.size());
+  vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      Caffe::set_mode(TypeParam::device);
+      for (int r = t * kRequests; r < (t + 1) * kRequests; ++r) {
+        outputs[r] = make_shared<TBlob<Dtype>>();
+        engine.Infer({inputs[r].get()}, {outputs[r].get()});
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int r = 0; r < inputs.size(); ++r) {
+    ASSERT_EQ(expected[r]->shape(), outputs[r]->shape());
+    EXPECT_EQ(outputs[r]->num(), inputs[r]->num());
+    for (int i = 0; i < outputs[r]->count(); ++i) {
+      EXPECT_EQ(expected[r]->cpu_data()[i], outputs[r]->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(InferenceEngineTest, TestSharedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  shared_ptr<Net> net = this->InitNet();
+  InferenceEngine engine(net, 2);
+  EXPECT_EQ(&engine.net(), net.get());
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> input(2, 3, 6, 6);
+  filler.Fill(&input);
+  // The second request goes to the second instance: it answers like the net
+  // only if it runs with the net's weights
+  TBlob<Dtype> output;
+  for (int n = 0; n < 2; ++n) {
+    engine.Infer({&input}, {&output});
+  }
+  net->input_blobs()[0]->CopyFrom(input);
+  const Blob* expected = net->Forward()[0];
+  ASSERT_EQ(expected->count(), output.count());
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_EQ(expected->cpu_data<Dtype>()[i], output.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(InferenceEngineTest, TestInstanceSharesWeights) {
+  Caffe::set_mode(TypeParam::device);
+  shared_ptr<Net> net = this->InitNet();
+  // Every layer starts out with the net's blobs instead of filling its own
+  Net instance(net.get());
+  EXPECT_TRUE(instance.trained_layers_shared());
+  ASSERT_EQ(net->layers().size(), instance.layers().size());
+  for (int i = 0; i < net->layers().size(); ++i) {
+    const vector<shared_ptr<Blob>>& blobs = net->layers()[i]->blobs();
+    const vector<shared_ptr<Blob>>& instance_blobs = instance.layers()[i]->blobs();
+    ASSERT_EQ(blobs.size(), instance_blobs.size()) << net->layer_names()[i];
+    for (int j = 0; j < blobs.size(); ++j) {
+      EXPECT_TRUE(instance_blobs[j]->data_equals(*blobs[j]))
+          << net->layer_names()[i] << " blob " << j;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -201,6 +201,94 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    InnerProductParameter* inner_product_param = layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->mutable_weight_filler()->set_type("uniform");
+    inner_product_param->mutable_weight_filler()->set_min(-1);
+    inner_product_param->mutable_bias_filler()->set_type("uniform");
+    inner_product_param->set_transpose(transpose != 0);
+    shared_ptr<InnerProductLayer<Dtype, Dtype>> layer(
+        new InnerProductLayer<Dtype, Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    TBlob<Dtype> ref_top;
+    ref_top.CopyFrom(*this->blob_top_, false, true);
+    layer_param.mutable_quantization_param()->set_input_scale(
+        this->blob_bottom_->amax_data() / 127.F);
+    shared_ptr<InnerProductLayer<Dtype, Dtype>> layer_s8(
+        new InnerProductLayer<Dtype, Dtype>(layer_param));
+    layer_s8->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      layer_s8->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+    }
+    layer_s8->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const float tolerance = 2e-2F * ref_top.amax_data();
+    const Dtype* data = this->blob_top_->cpu_data();
+    const Dtype* ref_data = ref_top.cpu_data();
+    for (int i = 0; i < ref_top.count(); ++i) {
+      EXPECT_NEAR(data[i], ref_data[i], tolerance);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8Reload) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param = layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("uniform");
+  inner_product_param->mutable_weight_filler()->set_min(-1);
+  inner_product_param->mutable_bias_filler()->set_type("uniform");
+  // Two sets of weights, the second one reloaded in place between Forwards
+  shared_ptr<InnerProductLayer<Dtype, Dtype>> first(
+      new InnerProductLayer<Dtype, Dtype>(layer_param));
+  first->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  shared_ptr<InnerProductLayer<Dtype, Dtype>> second(
+      new InnerProductLayer<Dtype, Dtype>(layer_param));
+  second->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  second->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  TBlob<Dtype> ref_top;
+  ref_top.CopyFrom(*this->blob_top_, false, true);
+
+  layer_param.mutable_quantization_param()->set_input_scale(
+      this->blob_bottom_->amax_data() / 127.F);
+  shared_ptr<InnerProductLayer<Dtype, Dtype>> layer_s8(
+      new InnerProductLayer<Dtype, Dtype>(layer_param));
+  layer_s8->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < first->blobs().size(); ++i) {
+    layer_s8->blobs()[i]->CopyFrom(*first->blobs()[i]);
+  }
+  layer_s8->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const void* weights = layer_s8->blobs()[0]->current_data_memory(false);
+  for (int i = 0; i < second->blobs().size(); ++i) {
+    BlobProto proto;
+    second->blobs()[i]->template ToProto<Dtype>(&proto);
+    layer_s8->blobs()[i]->FromProto(proto);
+  }
+  ASSERT_EQ(weights, layer_s8->blobs()[0]->current_data_memory(false));
+  layer_s8->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const float tolerance = 2e-2F * ref_top.amax_data();
+  const Dtype* data = this->blob_top_->cpu_data();
+  const Dtype* ref_data = ref_top.cpu_data();
+  for (int i = 0; i < ref_top.count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], tolerance);
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
@@ -114,6 +114,17 @@ TYPED_TEST(MaxPoolingDropoutTest, TestBackward) {
   dropout_layer.Forward(this->blob_top_vec_, this->blob_top_vec_);
   dropout_layer.Backward(this->blob_top_vec_, propagate_down,
                          this->blob_top_vec_);
+  // Kept units pass the gradient scaled by 1 / (1 - p), dropped ones pass 0
+  Dtype scale = 1. / (1. - layer_param.dropout_param().dropout_ratio());
+  int num_kept = 0;
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    const Dtype top_diff = this->blob_top_->cpu_diff()[i];
+    if (top_diff != 0) {
+      EXPECT_EQ(top_diff, scale);
+      ++num_kept;
+    }
+  }
+  EXPECT_GT(num_kept, 0);
   layer.Backward(this->blob_top_vec_, propagate_down,
                  this->blob_bottom_vec_);
   Dtype sum_with_dropout = 0.;
@@ -121,7 +132,7 @@ TYPED_TEST(MaxPoolingDropoutTest, TestBackward) {
   for (int i = 0; i < this->blob_bottom_->count(); ++i) {
     sum_with_dropout += bottom_diff[i];
   }
-  EXPECT_GE(sum_with_dropout, sum);
+  EXPECT_EQ(sum_with_dropout, num_kept * scale);
 }
 
 }  // namespace caffe
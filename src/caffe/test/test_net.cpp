@@ -10,6 +10,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
 #include "caffe/type.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -704,6 +705,433 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitActivationSharingNet(const bool share_activation_memory) {
+    string proto =
+        "name: 'ActivationSharingNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 12 dim: 10 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2a' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2a' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2b' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2b' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv2a' "
+        "  bottom: 'conv2b' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'pool' "
+        "  type: 'Pooling' "
+        "  bottom: 'sum' "
+        "  top: 'pool' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'flatten' "
+        "  type: 'Flatten' "
+        "  bottom: 'pool' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    if (share_activation_memory) {
+      proto += "share_activation_memory: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitDiffSharingNet(const bool share_diff_memory) {
+    string proto =
+        "name: 'DiffSharingNetwork' "
+        "state: { phase: TRAIN } "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'label' "
+        "  input_param { "
+        "  shape: { dim: 4 dim: 3 dim: 6 dim: 5 } "
+        "  shape: { dim: 4 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'flatten' "
+        "  type: 'Flatten' "
+        "  bottom: 'conv1' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sig2' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sig2' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sig2' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} "
+        "layer { "
+        "  name: 'accuracy' "
+        "  type: 'Accuracy' "
+        "  bottom: 'ip3' "
+        "  bottom: 'label' "
+        "  top: 'accuracy' "
+        "} ";
+    if (share_diff_memory) {
+      proto += "share_diff_memory: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitRecomputeNet(const bool recompute) {
+    string proto =
+        "name: 'RecomputeNetwork' "
+        "state: { phase: TRAIN } "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'label' "
+        "  input_param { "
+        "  shape: { dim: 4 dim: 3 dim: 8 dim: 8 } "
+        "  shape: { dim: 4 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'bn1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'bn1' "
+        "  top: 'bn1' "
+        "} "
+        "layer { "
+        "  name: 'drop1' "
+        "  type: 'Dropout' "
+        "  bottom: 'bn1' "
+        "  top: 'drop1' "
+        "} "
+        "layer { "
+        "  name: 'scale2' "
+        "  type: 'Scale' "
+        "  bottom: 'drop1' "
+        "  top: 'drop1' "
+        "  scale_param { "
+        "    filler { "
+        "      type: 'constant' "
+        "      value: 1.5 "
+        "    } "
+        "    bias_term: true "
+        "    bias_filler { "
+        "      type: 'constant' "
+        "      value: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'drop1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'pool2' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv2' "
+        "  top: 'pool2' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'pool2' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    if (recompute) {
+      // The second segment opens with an in-place Scale of the first one's output
+      proto += "recompute_segment { first_layer: 'conv1' last_layer: 'drop1' } "
+          "recompute_segment { first_layer: 'scale2' last_layer: 'pool2' } ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitInterOpNet(const int inter_op_threads) {
+    std::ostringstream proto;
+    proto <<
+        "name: 'InterOpNetwork' "
+        "state: { phase: TRAIN } "
+        "inter_op_threads: " << inter_op_threads << " "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'label' "
+        "  input_param { "
+        "  shape: { dim: 4 dim: 3 dim: 8 dim: 8 } "
+        "  shape: { dim: 4 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3x3' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv3x3' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu3x3' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv3x3' "
+        "  top: 'conv3x3' "
+        "} "
+        "layer { "
+        "  name: 'drop3x3' "
+        "  type: 'Dropout' "
+        "  bottom: 'conv3x3' "
+        "  top: 'drop3x3' "
+        "} "
+        "layer { "
+        "  name: 'conv1x1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1x1' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'pool' "
+        "  type: 'Pooling' "
+        "  bottom: 'data' "
+        "  top: 'pool' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 3 "
+        "    stride: 1 "
+        "    pad: 1 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'drop3x3' "
+        "  bottom: 'conv1x1' "
+        "  bottom: 'pool' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'concat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1409,6 +1837,90 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedWeightsWeightFile) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  TBlob<Dtype> shared_params;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  shared_params.CopyFrom(*ip1_weights, kCopyDiff, kReshape);
+  const int count = ip1_weights->count();
+
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToWeightFile(filename);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  // Weights mapped from the file are still shared
+  EXPECT_EQ(ip1_weights->cpu_data<Dtype>(),
+      ip2_weights->cpu_data<Dtype>());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(shared_params.cpu_data()[i],
+        ip1_weights->cpu_data<Dtype>()[i]);
+  }
+  // and can be trained further
+  this->net_->ForwardBackward();
+  this->net_->Update();
+}
+
+TYPED_TEST(NetTest, TestDeferredLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  TBlob<Dtype> trained_weights;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  trained_weights.CopyFrom(*this->net_->layers()[2]->blobs()[0], kCopyDiff, kReshape);
+  const int count = trained_weights.count();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(net_param, filename);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  const bool kDefer = true;
+  this->net_->CopyTrainedLayersFrom(filename, kDefer);
+  Blob* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  // Still filled
+  EXPECT_TRUE(this->net_->has_deferred_layers());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(0.5, ip2_weights->cpu_data<Dtype>()[i]);
+  }
+  this->net_->Forward();
+  EXPECT_FALSE(this->net_->has_deferred_layers());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(trained_weights.cpu_data()[i], ip2_weights->cpu_data<Dtype>()[i]);
+  }
+
+  // Serialized only once read
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataUnsharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename, kDefer);
+  this->net_->LoadDeferredLayers();
+  NetParameter written;
+  this->net_->ToProto(&written);
+  TBlob<Dtype> written_weights;
+  written_weights.FromProto(written.layer(2).blobs(0));
+  ASSERT_EQ(count, written_weights.count());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_FLOAT_EQ(trained_weights.cpu_data()[i], written_weights.cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2529,6 +3041,304 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestShareActivationMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> blob1(2, 3, 12, 10);
+  TBlob<Dtype> blob2(5, 3, 12, 10);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationSharingNet(false);
+  shared_ptr<Net> ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationSharingNet(true);
+  shared_ptr<Net> net = this->net_;
+  // The plan is made at the start of the second full pass, after a Reshape.
+  // A plain Forward on a larger input grows blobs out of the arena.
+  const TBlob<Dtype>* inputs[] = {&blob2, &blob1, &blob2, &blob1};
+  for (int pass = 0; pass < 4; ++pass) {
+    const TBlob<Dtype>& input = *inputs[pass];
+    for (Net* n : {ref_net.get(), net.get()}) {
+      n->input_blobs()[0]->Reshape(input.shape());
+      caffe_copy<Dtype>(input.count(), input.cpu_data(),
+          n->input_blobs()[0]->mutable_cpu_data<Dtype>());
+      if (pass < 2) {
+        n->Reshape();
+      }
+      n->Forward();
+    }
+    if (pass == 0) {
+      EXPECT_EQ(net->activation_arena_size(), 0);
+    }
+    const Blob* ref_output = ref_net->blob_by_name("prob").get();
+    const Blob* output = net->blob_by_name("prob").get();
+    ASSERT_EQ(ref_output->count(), output->count());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_EQ(ref_output->cpu_data<Dtype>()[i], output->cpu_data<Dtype>()[i]);
+    }
+  }
+  EXPECT_EQ(ref_net->activation_arena_size(), 0);
+  if (Caffe::mode() == Caffe::CPU) {
+    size_t unshared_bytes = 0UL;
+    for (const shared_ptr<Blob>& blob : ref_net->blobs()) {
+      unshared_bytes += blob->count() * sizeof(Dtype);
+    }
+    EXPECT_GT(net->activation_arena_size(), 0);
+    EXPECT_LT(net->activation_arena_size(), unshared_bytes);
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapeBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> data(5, 3, 12, 10);
+  filler.Fill(&data);
+
+  for (bool share : {false, true}) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitActivationSharingNet(false);
+    shared_ptr<Net> ref_net = this->net_;
+    Caffe::set_random_seed(this->seed_);
+    this->InitActivationSharingNet(share);
+    shared_ptr<Net> net = this->net_;
+    // Set up for the largest batch, shared memory included
+    net->ReshapeBatch(data.num());
+    caffe_copy<Dtype>(data.count(), data.cpu_data(),
+        net->input_blobs()[0]->mutable_cpu_data<Dtype>());
+    net->Forward();
+    net->Forward();
+    const size_t arena_size = net->activation_arena_size();
+    if (share && Caffe::mode() == Caffe::CPU) {
+      EXPECT_GT(arena_size, 0);
+    }
+    vector<const Dtype*> memory;
+    for (const shared_ptr<Blob>& blob : net->blobs()) {
+      memory.push_back(blob->cpu_data<Dtype>());
+    }
+    for (int num : {3, 1, 5, 2}) {
+      net->ReshapeBatch(num);
+      ref_net->input_blobs()[0]->Reshape(num, 3, 12, 10);
+      ref_net->Reshape();
+      for (Net* n : {ref_net.get(), net.get()}) {
+        EXPECT_EQ(n->input_blobs()[0]->num(), num);
+        caffe_copy<Dtype>(n->input_blobs()[0]->count(), data.cpu_data(),
+            n->input_blobs()[0]->mutable_cpu_data<Dtype>());
+        n->Forward();
+      }
+      const Blob* ref_output = ref_net->blob_by_name("prob").get();
+      const Blob* output = net->blob_by_name("prob").get();
+      ASSERT_EQ(ref_output->count(), output->count());
+      for (int i = 0; i < output->count(); ++i) {
+        EXPECT_EQ(ref_output->cpu_data<Dtype>()[i], output->cpu_data<Dtype>()[i]);
+      }
+      // Nothing is reallocated or planned again
+      EXPECT_EQ(net->activation_arena_size(), arena_size);
+      for (int b = 0; b < memory.size(); ++b) {
+        EXPECT_EQ(net->blobs()[b]->cpu_data<Dtype>(), memory[b]) << net->blob_names()[b];
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareDiffMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> data1(4, 3, 6, 5);
+  TBlob<Dtype> data2(7, 3, 6, 5);
+  filler.Fill(&data1);
+  filler.Fill(&data2);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffSharingNet(false);
+  shared_ptr<Net> ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffSharingNet(true);
+  shared_ptr<Net> net = this->net_;
+  // The plan is made at the start of the second full pass, after a Reshape.
+  // A plain Forward on a larger input grows blobs out of the arena.
+  const TBlob<Dtype>* inputs[] = {&data2, &data1, &data2, &data1};
+  for (int pass = 0; pass < 4; ++pass) {
+    const TBlob<Dtype>& input = *inputs[pass];
+    for (Net* n : {ref_net.get(), net.get()}) {
+      n->input_blobs()[0]->Reshape(input.shape());
+      n->input_blobs()[1]->Reshape(vector<int>(1, input.num()));
+      caffe_copy<Dtype>(input.count(), input.cpu_data(),
+          n->input_blobs()[0]->mutable_cpu_data<Dtype>());
+      Dtype* label = n->input_blobs()[1]->mutable_cpu_data<Dtype>();
+      for (int i = 0; i < input.num(); ++i) {
+        label[i] = i % 5;
+      }
+      if (pass < 2) {
+        n->Reshape();
+      }
+      n->ClearParamDiffs();
+      n->Forward();
+      n->Backward();
+    }
+    if (pass == 0) {
+      EXPECT_EQ(net->diff_arena_size(), 0);
+    }
+    const vector<shared_ptr<Blob>>& ref_params = ref_net->params();
+    const vector<shared_ptr<Blob>>& params = net->params();
+    ASSERT_EQ(ref_params.size(), params.size());
+    for (int p = 0; p < params.size(); ++p) {
+      ASSERT_EQ(ref_params[p]->count(), params[p]->count());
+      for (int i = 0; i < params[p]->count(); ++i) {
+        EXPECT_EQ(ref_params[p]->cpu_diff<Dtype>()[i], params[p]->cpu_diff<Dtype>()[i]);
+      }
+    }
+  }
+  EXPECT_EQ(ref_net->diff_arena_size(), 0);
+  if (Caffe::mode() == Caffe::CPU) {
+    size_t unshared_bytes = 0UL;
+    for (const shared_ptr<Blob>& blob : ref_net->blobs()) {
+      unshared_bytes += blob->count() * sizeof(Dtype);
+    }
+    EXPECT_GT(net->diff_arena_size(), 0);
+    EXPECT_LT(net->diff_arena_size(), unshared_bytes);
+  }
+}
+
+TYPED_TEST(NetTest, TestRecomputeSegments) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> data(4, 3, 8, 8);
+  filler.Fill(&data);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecomputeNet(false);
+  shared_ptr<Net> ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecomputeNet(true);
+  shared_ptr<Net> net = this->net_;
+  for (int pass = 0; pass < 3; ++pass) {
+    float loss[2];
+    for (int n = 0; n < 2; ++n) {
+      Net* net_n = n == 0 ? ref_net.get() : net.get();
+      caffe_copy<Dtype>(data.count(), data.cpu_data(),
+          net_n->input_blobs()[0]->mutable_cpu_data<Dtype>());
+      Dtype* label = net_n->input_blobs()[1]->mutable_cpu_data<Dtype>();
+      for (int i = 0; i < data.num(); ++i) {
+        label[i] = (i + pass) % 5;
+      }
+      // Same dropout masks in both nets
+      Caffe::set_random_seed(this->seed_ + pass);
+      net_n->ClearParamDiffs();
+      net_n->Forward(&loss[n]);
+      net_n->Backward();
+    }
+    EXPECT_EQ(loss[0], loss[1]);
+    // Gradients and BatchNorm statistics match: recomputing forward
+    // replays the dropout masks, does not update the statistics twice and
+    // does not scale drop1 again.
+    const vector<shared_ptr<Blob>>& ref_params = ref_net->params();
+    const vector<shared_ptr<Blob>>& params = net->params();
+    ASSERT_EQ(ref_params.size(), params.size());
+    for (int p = 0; p < params.size(); ++p) {
+      ASSERT_EQ(ref_params[p]->count(), params[p]->count());
+      for (int i = 0; i < params[p]->count(); ++i) {
+        EXPECT_EQ(ref_params[p]->cpu_data<Dtype>()[i], params[p]->cpu_data<Dtype>()[i]);
+        EXPECT_EQ(ref_params[p]->cpu_diff<Dtype>()[i], params[p]->cpu_diff<Dtype>()[i]);
+      }
+    }
+  }
+  EXPECT_EQ(ref_net->recompute_arena_size(), 0);
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_GT(net->recompute_arena_size(), 0);
+    // Inner activations of both segments share memory
+    const Blob* conv1 = net->blob_by_name("conv1").get();
+    const Blob* conv2 = net->blob_by_name("conv2").get();
+    EXPECT_EQ(conv1->cpu_data<Dtype>(), conv2->cpu_data<Dtype>());
+  }
+}
+
+TYPED_TEST(NetTest, TestInterOpThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> data(4, 3, 8, 8);
+  filler.Fill(&data);
+
+  const int threads[3] = {2, 3, 4};
+  shared_ptr<Net> nets[3];
+  for (int n = 0; n < 3; ++n) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitInterOpNet(threads[n]);
+    nets[n] = this->net_;
+  }
+  for (int pass = 0; pass < 3; ++pass) {
+    float loss[3];
+    for (int n = 0; n < 3; ++n) {
+      caffe_copy<Dtype>(data.count(), data.cpu_data(),
+          nets[n]->input_blobs()[0]->mutable_cpu_data<Dtype>());
+      Dtype* label = nets[n]->input_blobs()[1]->mutable_cpu_data<Dtype>();
+      for (int i = 0; i < data.num(); ++i) {
+        label[i] = (i + pass) % 5;
+      }
+      Caffe::set_random_seed(this->seed_ + pass);
+      nets[n]->Forward(&loss[n]);
+    }
+    // Dropout masks depend on the seed only: the nets match whatever the
+    // number of threads
+    EXPECT_EQ(loss[0], loss[1]);
+    EXPECT_EQ(loss[0], loss[2]);
+    const char* names[5] = {"conv1x1", "pool", "drop3x3", "concat", "ip"};
+    for (int n = 1; n < 3; ++n) {
+      for (int k = 0; k < 5; ++k) {
+        const Blob* blob = nets[n]->blob_by_name(names[k]).get();
+        const Blob* expected = nets[0]->blob_by_name(names[k]).get();
+        ASSERT_EQ(expected->count(), blob->count());
+        for (int i = 0; i < blob->count(); ++i) {
+          EXPECT_EQ(expected->cpu_data<Dtype>()[i], blob->cpu_data<Dtype>()[i])
+              << names[k] << " differs with " << threads[n] << " threads";
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCost) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  const double t = tsize(tp<Dtype>());
+  // 5 x 24 inputs to 1000 outputs with bias
+  const Net::Cost ip = this->net_->layer_cost(1);
+  EXPECT_EQ((2. * 24 + 1) * 5 * 1000, ip.forward_flops);
+  EXPECT_EQ((4. * 24 + 1) * 5 * 1000, ip.backward_flops);
+  EXPECT_EQ((5 * 24 + 5 * 1000 + 24 * 1000 + 1000) * t, ip.forward_bytes);
+  EXPECT_GT(ip.backward_bytes, ip.forward_bytes);
+  // The data layer is never back-propagated through
+  const Net::Cost data = this->net_->layer_cost(0);
+  EXPECT_EQ(0., data.backward_flops);
+  EXPECT_EQ(0., data.backward_bytes);
+  const Net::Cost loss = this->net_->layer_cost(2);
+  EXPECT_EQ(5. * 5 * 1000 + 5, loss.forward_flops);
+  const Net::Cost total = this->net_->total_cost();
+  EXPECT_EQ(data.forward_flops + ip.forward_flops + loss.forward_flops, total.forward_flops);
+  EXPECT_EQ(ip.backward_flops + loss.backward_flops, total.backward_flops);
+  EXPECT_EQ(data.forward_bytes + ip.forward_bytes + loss.forward_bytes, total.forward_bytes);
+  EXPECT_EQ((24 * 1000 + 1000) * t, this->net_->param_bytes());
+  // Data of all blobs, diff of the inner product's top at least
+  EXPECT_GE(this->net_->activation_bytes(), (120 + 5 + 5000 + 1 + 5000) * t);
+  EXPECT_LE(this->net_->activation_bytes(), (120 + 5 + 5000 + 1 + 5000 + 1) * t);
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
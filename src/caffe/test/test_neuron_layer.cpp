@@ -567,6 +567,35 @@ TYPED_TEST(NeuronLayerTest, TestDropoutThreeQuarters) {
   this->TestDropoutForward(kDropoutRatio);
 }
 
+TYPED_TEST(NeuronLayerTest, TestDropoutReproducible) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  TBlob<Dtype> first_top;
+  vector<Blob*> first_top_vec(1, &first_top);
+  Caffe::set_random_seed(1702);
+  DropoutLayer<Dtype, Dtype> first(layer_param);
+  first.SetUp(this->blob_bottom_vec_, first_top_vec);
+  first.Forward(this->blob_bottom_vec_, first_top_vec);
+  Caffe::set_random_seed(1702);
+  DropoutLayer<Dtype, Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int count = this->blob_bottom_->count();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(first_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+  // Backward must drop exactly the units dropped in forward
+  caffe_set(count, Dtype(1), this->blob_top_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true), this->blob_bottom_vec_);
+  const float scale = 1. / (1. - layer_param.dropout_param().dropout_ratio());
+  for (int i = 0; i < count; ++i) {
+    const bool kept = this->blob_top_->cpu_data()[i] != Dtype(0);
+    EXPECT_FLOAT_EQ(static_cast<float>(this->blob_bottom_->cpu_diff()[i]),
+        kept ? scale : 0.F);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestDropoutTestPhase) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
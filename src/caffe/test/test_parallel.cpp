@@ -0,0 +1,50 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/parallel.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPUSyncManagerTest : public ::testing::Test {
+ protected:
+  CPUSyncManagerTest() : solver_count_(Caffe::solver_count()) {}
+  virtual ~CPUSyncManagerTest() {
+    Caffe::set_solver_count(solver_count_);
+  }
+
+  const int solver_count_;
+};
+
+TEST_F(CPUSyncManagerTest, TestAllreduceSums) {
+  const int nranks = 3;
+  // Not divisible by the ranks and longer than one cache block per slice
+  const int count = 3 * 2048 + 5;
+  Caffe::set_solver_count(nranks);
+  CPUSyncManager mgr(shared_ptr<Solver>(), nranks, SolverParameter());
+
+  vector<vector<float>> buckets(nranks, vector<float>(count));
+  for (int r = 0; r < nranks; ++r) {
+    for (int i = 0; i < count; ++i) {
+      buckets[r][i] = static_cast<float>((r + 1) * (i % 17));
+    }
+  }
+  boost::thread_group threads;
+  for (int r = 0; r < nranks; ++r) {
+    threads.create_thread([&mgr, &buckets, r, count] {
+      mgr.Allreduce(r, count, buckets[r].data(), tp<float>());
+    });
+  }
+  threads.join_all();
+
+  for (int r = 0; r < nranks; ++r) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(6.F * (i % 17), buckets[r][i]) << "rank " << r << " at " << i;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -544,6 +544,62 @@ TYPED_TEST(PoolingLayerTest, TestGradientMaxTopMask) {
   }
 }
 
+// Inference path (no argmax mask, specialized 2x2/s2 and 3x3/s2 kernels)
+// has to agree with the masked path used for training.
+TYPED_TEST(PoolingLayerTest, TestForwardMaxNoMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kernels[] = {2, 3, 3, 3, 2};
+  const int strides[] = {2, 2, 2, 1, 1};
+  const int pads[] = {0, 0, 1, 1, 0};
+  this->blob_bottom_->Reshape(2, 3, 9, 11);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int i = 0; i < 6; ++i) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    if (i < 5) {
+      pooling_param->set_kernel_size(kernels[i]);
+      pooling_param->set_stride(strides[i]);
+      pooling_param->set_pad(pads[i]);
+    } else {
+      pooling_param->set_global_pooling(true);
+    }
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype, Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    TBlob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+    PoolingLayer<Dtype, Dtype> inference_layer(layer_param);
+    inference_layer.set_need_backward(false);
+    inference_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    inference_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], this->blob_top_->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardAveGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_global_pooling(true);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  PoolingLayer<Dtype, Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int plane = this->blob_bottom_->height() * this->blob_bottom_->width();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    double sum = 0.;
+    for (int j = 0; j < plane; ++j) {
+      sum += this->blob_bottom_->cpu_data()[i * plane + j];
+    }
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], sum / plane, tol<Dtype>(1e-5, 2e-3));
+  }
+}
+
 TYPED_TEST(PoolingLayerTest, TestForwardAve) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,178 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/text_format.h>
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ProfilerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void TearDown() {
+    Profiler::Get().Stop();
+  }
+
+  void InitNet() {
+    const string proto =
+        "name: 'ProfiledNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'label' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "    shape: { dim: 2 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_default_forward_type(tp<Dtype>());
+    param.set_default_backward_type(tp<Dtype>());
+    param.set_default_forward_math(tp<Dtype>());
+    param.set_default_backward_math(tp<Dtype>());
+    net_.reset(new Net(param));
+    caffe_set(2, Dtype(1), net_->blob_by_name("label")->template mutable_cpu_data<Dtype>());
+  }
+
+  shared_ptr<Net> net_;
+};
+
+TYPED_TEST_CASE(ProfilerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ProfilerTest, TestLayerEvents) {
+  this->InitNet();
+  Profiler& profiler = Profiler::Get();
+  this->net_->Forward();
+  profiler.Start();
+  this->net_->Forward();
+  this->net_->Backward(false);
+  profiler.Stop();
+  this->net_->Forward();
+  const vector<Profiler::Event> events = profiler.Events();
+  const vector<string>& names = this->net_->layer_names();
+  vector<string> forward, backward;
+  for (const Profiler::Event& e : events) {
+    EXPECT_LE(e.begin_us, e.end_us);
+    // Inputs are filled from outside, everything else moves data
+    if (e.name != "input") {
+      EXPECT_GT(e.bytes, 0.);
+    }
+    if (e.category == "forward") {
+      forward.push_back(e.name);
+    } else if (e.category == "backward") {
+      backward.push_back(e.name);
+    }
+    if (e.category == "forward" && e.name == "conv") {
+      // 4 outputs of 4x4 per image, 3x3x3 multiply-adds each, plus bias
+      EXPECT_EQ(e.flops, 2. * 2 * 4 * 16 * 27 + 2 * 4 * 16);
+    }
+    if (e.category == "backward" && e.name == "ip") {
+      EXPECT_EQ(e.flops, (4. * 64 + 1) * 2 * 5);
+    }
+  }
+  // Every layer once, in order, only while the profiler was on
+  EXPECT_EQ(names, forward);
+  EXPECT_EQ(vector<string>(names.rbegin(), names.rend()), backward);
+}
+
+TYPED_TEST(ProfilerTest, TestRingBuffer) {
+  Profiler& profiler = Profiler::Get();
+  profiler.Start(4);
+  for (int i = 0; i < 10; ++i) {
+    std::ostringstream name;
+    name << i;
+    profiler.Record("test", name.str(), i, i + 1);
+  }
+  const vector<Profiler::Event> events = profiler.Events();
+  ASSERT_EQ(events.size(), 4);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(events[i].begin_us, 6 + i);
+    EXPECT_EQ(events[i].thread, Profiler::thread_id());
+  }
+  // Restarting drops what was recorded
+  profiler.Start();
+  EXPECT_TRUE(profiler.Events().empty());
+}
+
+TYPED_TEST(ProfilerTest, TestChromeTrace) {
+  this->InitNet();
+  Profiler& profiler = Profiler::Get();
+  profiler.Start();
+  this->net_->ForwardBackward(false);
+  {
+    ProfileScope scope("update", "quoted \"name\"");
+  }
+  profiler.Stop();
+  string filename;
+  MakeTempFilename(&filename);
+  profiler.WriteChromeTrace(filename);
+  std::ifstream in(filename.c_str());
+  std::stringstream trace;
+  trace << in.rdbuf();
+  EXPECT_NE(trace.str().find("\"traceEvents\":["), string::npos);
+  EXPECT_NE(trace.str().find("{\"name\":\"conv\",\"cat\":\"forward\",\"ph\":\"X\""),
+      string::npos);
+  EXPECT_NE(trace.str().find("\"name\":\"quoted \\\"name\\\"\""), string::npos);
+  const string summary = profiler.Summary();
+  for (const string& name : this->net_->layer_names()) {
+    EXPECT_NE(summary.find(name), string::npos) << name;
+  }
+  EXPECT_NE(summary.find("GFLOP/s"), string::npos);
+}
+
+}  // namespace caffe
@@ -0,0 +1,104 @@
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class GemmS8Test : public ::testing::Test {
+ protected:
+  static vector<int8_t> Random(int n) {
+    vector<int> values(n);
+    caffe_rng_uniform<int>(n, -127.F, 127.F, values.data());
+    return vector<int8_t>(values.begin(), values.end());
+  }
+
+  static vector<int32_t> Reference(bool trans_b, int M, int N, int K,
+      const vector<int8_t>& A, const vector<int8_t>& B) {
+    vector<int32_t> C(static_cast<size_t>(M) * N, 0);
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        for (int k = 0; k < K; ++k) {
+          const int8_t b = trans_b ? B[static_cast<size_t>(j) * K + k]
+                                   : B[static_cast<size_t>(k) * N + j];
+          C[static_cast<size_t>(i) * N + j] += A[static_cast<size_t>(i) * K + k] * b;
+        }
+      }
+    }
+    return C;
+  }
+};
+
+TEST_F(GemmS8Test, TestExact) {
+  Caffe::set_random_seed(1701);
+  // Tiles, panels and groups of 4 k, whole and partial
+  const int shapes[][3] = {{1, 1, 1}, {3, 5, 7}, {7, 17, 13}, {6, 16, 4}, {13, 40, 33},
+      {5, 1000, 9}, {64, 300, 576}};
+  for (const auto& shape : shapes) {
+    const int M = shape[0], N = shape[1], K = shape[2];
+    const vector<int8_t> A = Random(M * K), B = Random(K * N);
+    for (bool trans_b : {false, true}) {
+      vector<int32_t> C(static_cast<size_t>(M) * N);
+      caffe_cpu_gemm_s8(trans_b ? CblasTrans : CblasNoTrans, M, N, K, A.data(), B.data(),
+          C.data());
+      EXPECT_TRUE(C == Reference(trans_b, M, N, K, A, B))
+          << M << "x" << N << "x" << K << (trans_b ? " B^T" : "");
+    }
+  }
+}
+
+TEST_F(GemmS8Test, TestExtremes) {
+  // Largest products of equal sign sum to 2 * 127 * 127 per pair of k,
+  // the most the 16 bit intermediates of the kernels hold
+  const int M = 7, N = 33, K = 64;
+  for (int8_t b : {int8_t(127), int8_t(-127)}) {
+    const vector<int8_t> A(M * K, 127), B(K * N, b);
+    for (bool trans_b : {false, true}) {
+      vector<int32_t> C(M * N);
+      caffe_cpu_gemm_s8(trans_b ? CblasTrans : CblasNoTrans, M, N, K, A.data(), B.data(),
+          C.data());
+      for (int i = 0; i < M * N; ++i) {
+        EXPECT_EQ(C[i], 127 * b * K);
+      }
+    }
+  }
+}
+
+// A 3x3 convolution of 64 channels to 64 over 56x56: the int8 kernels are to
+// beat the float gemm they replace
+TEST_F(GemmS8Test, TestSpeed) {
+  const int M = 64, N = 3136, K = 576, iterations = 10;
+  const vector<int8_t> A = Random(M * K), B = Random(K * N);
+  vector<int32_t> C(static_cast<size_t>(M) * N);
+  vector<float> Af(A.begin(), A.end()), Bf(B.begin(), B.end()), Cf(C.size());
+  CPUTimer timer;
+  caffe_cpu_gemm_s8(CblasNoTrans, M, N, K, A.data(), B.data(), C.data());
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    caffe_cpu_gemm_s8(CblasNoTrans, M, N, K, A.data(), B.data(), C.data());
+  }
+  const float int8_ms = timer.MilliSeconds() / iterations;
+  caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M, N, K, 1.F, Af.data(), Bf.data(), 0.F,
+      Cf.data());
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M, N, K, 1.F, Af.data(), Bf.data(), 0.F,
+        Cf.data());
+  }
+  const float float_ms = timer.MilliSeconds() / iterations;
+  LOG(INFO) << "gemm " << M << "x" << N << "x" << K << ": int8 (" << caffe_cpu_gemm_s8_kernel()
+            << ") " << int8_ms << " ms, float " << float_ms << " ms, "
+            << float_ms / int8_ms << "x";
+  if (strcmp(caffe_cpu_gemm_s8_kernel(), "generic") != 0) {
+    EXPECT_LT(int8_ms, float_ms);
+  }
+}
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -6,7 +7,10 @@
 #include "caffe/syncedmem.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/type.hpp"
+#include "caffe/util/counter_rng.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/philox.hpp"
 
 
 namespace caffe {
@@ -420,6 +424,65 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestCounterRngThreadInvariant) {
+  TypeParam* data_1 = static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  TypeParam* data_2 = static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  caffe_set_cpu_threads(1);
+  CounterRNG(this->seed_).Gaussian(this->sample_size_, 0.F, 1.F, data_1);
+  caffe_set_cpu_threads(4);
+  CounterRNG(this->seed_).Gaussian(this->sample_size_, 0.F, 1.F, data_2);
+  caffe_set_cpu_threads(0);
+  for (int i = 0; i < this->sample_size_; ++i) {
+    EXPECT_EQ(data_1[i], data_2[i]);
+  }
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestCounterRngSplitAndSeek) {
+  const int n = 100;
+  vector<TypeParam> a(n), b(n), c(n);
+  CounterRNG root(this->seed_);
+  CounterRNG stream = root.Split(3);
+  stream.Uniform(n, 0.F, 1.F, a.data());
+  const uint64_t offset = stream.offset();
+  stream.Uniform(n, 0.F, 1.F, b.data());
+  // Same child id gives the same stream, seeking resumes it
+  CounterRNG again = root.Split(3);
+  again.set_offset(offset);
+  again.Uniform(n, 0.F, 1.F, c.data());
+  EXPECT_EQ(b, c);
+  // Different child ids and successive draws are different streams
+  root.Split(4).Uniform(n, 0.F, 1.F, c.data());
+  EXPECT_NE(a, c);
+  EXPECT_NE(a, b);
+  EXPECT_NE(root.Split(3).stream(), root.Split(3).Split(3).stream());
+}
+
+// Known answers of philox4x32_10 from the Random123 distribution (kat_vectors).
+// Counter words are lo (low, high) then hi (low, high), key words low then high.
+TEST(PhiloxTest, TestKnownAnswers) {
+  struct {
+    uint64_t key, hi, lo;
+    uint32_t expected[4];
+  } kat[3] = {
+    {0ULL, 0ULL, 0ULL, {0x6627e8d5U, 0xe169c58dU, 0xbc57ac4cU, 0x9b00dbd8U}},
+    {~0ULL, ~0ULL, ~0ULL, {0x408f276dU, 0x41c83b0eU, 0xa20bc7c6U, 0x6d5451fdU}},
+    {0x299f31d0a4093822ULL, 0x0370734413198a2eULL, 0x85a308d3243f6a88ULL,
+        {0xd16cfe09U, 0x94fdccebU, 0x5001e420U, 0x24126ea1U}},
+  };
+  for (int k = 0; k < 3; ++k) {
+    const Philox4x32 philox(kat[k].key);
+    uint32_t out[4];
+    philox(kat[k].hi, kat[k].lo, out);
+    // The batched path must agree on its first counter
+    uint32_t batch[4 * Philox4x32::kBatch];
+    philox.Batch(kat[k].hi, kat[k].lo, batch);
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(kat[k].expected[i], out[i]) << "vector " << k << " word " << i;
+      EXPECT_EQ(kat[k].expected[i], batch[i]) << "vector " << k << " word " << i;
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
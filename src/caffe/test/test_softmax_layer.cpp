@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -81,6 +82,55 @@ TYPED_TEST(SoftmaxLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardWideRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_forward_type(tp<Dtype>());
+  layer_param.set_backward_type(tp<Dtype>());
+  layer_param.set_forward_math(tp<Dtype>());
+  layer_param.set_backward_math(tp<Dtype>());
+  // Classifier head with large logits, then a spatial map wider than one block
+  const int shapes[2][3] = {{3, 2000, 1}, {2, 5, 300}};
+  for (int s = 0; s < 2; ++s) {
+    vector<int> shape(shapes[s], shapes[s] + 3);
+    this->blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    filler_param.set_std(4);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      bottom_data[i] += Dtype(50);
+    }
+    SoftmaxLayer<Dtype, Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int channels = shape[1];
+    const int inner = shape[2];
+    for (int i = 0; i < shape[0]; ++i) {
+      for (int k = 0; k < inner; ++k) {
+        const Dtype* x = this->blob_bottom_->cpu_data() + i * channels * inner + k;
+        const Dtype* y = this->blob_top_->cpu_data() + i * channels * inner + k;
+        double max_val = x[0];
+        for (int j = 1; j < channels; ++j) {
+          max_val = std::max(max_val, static_cast<double>(x[j * inner]));
+        }
+        double scale = 0.;
+        for (int j = 0; j < channels; ++j) {
+          scale += std::exp(x[j * inner] - max_val);
+        }
+        double sum = 0.;
+        for (int j = 0; j < channels; ++j) {
+          sum += y[j * inner];
+          EXPECT_NEAR(y[j * inner], std::exp(x[j * inner] - max_val) / scale,
+              tol<Dtype>(1e-5, 1e-2));
+        }
+        EXPECT_NEAR(sum, 1., tol<Dtype>(1e-3, 1e-1));
+      }
+    }
+  }
+}
+
 TYPED_TEST(SoftmaxLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
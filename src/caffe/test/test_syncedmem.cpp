@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/device_alternate.hpp"
+#include "caffe/util/host_memory.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -67,6 +69,75 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestHostSizeClasses) {
+  size_t last = 0UL;
+  for (size_t size = 0UL; size < (1UL << 24); size += size < 4096UL ? 1UL : 4093UL) {
+    const size_t bytes = HostMemory::size_class(size);
+    EXPECT_GE(bytes, size);
+    EXPECT_GE(bytes, last);
+    EXPECT_LE(bytes, std::max(64UL, size + size / 4UL + 64UL));
+    last = bytes;
+  }
+}
+
+TEST_F(SyncedMemoryTest, TestHostAlignment) {
+  void* small = HostMemory::allocate(10);
+  void* large = HostMemory::allocate(3 * HostMemory::HUGE_PAGE_SIZE);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(small) % HostMemory::ALIGNMENT, 0UL);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(large) % HostMemory::HUGE_PAGE_SIZE, 0UL);
+  HostMemory::deallocate(small);
+  HostMemory::deallocate(large);
+}
+
+TEST_F(SyncedMemoryTest, TestHostReuse) {
+  Caffe::set_mode(Caffe::CPU);
+  const size_t kSize = 1000;
+  const int node = HostMemory::current_numa_node();
+  const void* first;
+  {
+    SyncedMemory mem(kSize);
+    first = mem.mutable_cpu_data();
+    caffe_memset(mem.size(), 1, mem.mutable_cpu_data());
+  }
+  const HostMemory::Stats before = HostMemory::stats();
+  SyncedMemory mem(kSize - 10);
+  const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+  // A buffer of the same class comes back from the cache, cleared
+  if (HostMemory::current_numa_node() == node) {
+    EXPECT_EQ(cpu_data, first);
+    EXPECT_EQ(HostMemory::stats().reuses, before.reuses + 1);
+  }
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(cpu_data[i], 0);
+  }
+}
+
+TEST_F(SyncedMemoryTest, TestHostCacheLimit) {
+  const size_t limit = HostMemory::cache_limit();
+  HostMemory::set_cache_limit(0UL);
+  EXPECT_EQ(HostMemory::stats().cached, 0UL);
+  const HostMemory::Stats before = HostMemory::stats();
+  HostMemory::deallocate(HostMemory::allocate(100));
+  EXPECT_EQ(HostMemory::stats().cached, 0UL);
+  EXPECT_EQ(HostMemory::stats().releases, before.releases + 1);
+  HostMemory::set_cache_limit(limit);
+}
+
+TEST_F(SyncedMemoryTest, TestHostOversizeRelease) {
+  const size_t limit = HostMemory::cache_limit();
+  const size_t small = HostMemory::size_class(1000);
+  HostMemory::set_cache_limit(0UL);
+  HostMemory::set_cache_limit(2UL * small);
+  HostMemory::deallocate(HostMemory::allocate(1000));
+  EXPECT_EQ(HostMemory::stats().cached, small);
+  // A buffer over the limit goes back alone, the cached one stays
+  const HostMemory::Stats before = HostMemory::stats();
+  HostMemory::deallocate(HostMemory::allocate(4UL * small));
+  EXPECT_EQ(HostMemory::stats().cached, small);
+  EXPECT_EQ(HostMemory::stats().releases, before.releases + 1);
+  HostMemory::set_cache_limit(limit);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,63 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/transport.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SocketTransportTest : public ::testing::Test {
+ protected:
+  SocketTransportTest() {
+    MakeTempFilename(&address_);
+    address_ = "unix://" + address_;
+  }
+
+  string address_;
+};
+
+TEST_F(SocketTransportTest, TestCollectives) {
+  const int size = 4;
+  // Not divisible by the ranks and larger than the socket buffers
+  const int count = 1000003;
+  vector<vector<float>> data(size, vector<float>(count));
+  vector<float> broadcast(size, 0.F);
+  vector<vector<int>> gathered(size, vector<int>(2 * size));
+  const string address = address_;
+  boost::thread_group ranks;
+  for (int r = 0; r < size; ++r) {
+    ranks.create_thread([&data, &broadcast, &gathered, address, r, size, count] {
+      SocketTransport comm(address, r, size);
+      for (int i = 0; i < count; ++i) {
+        data[r][i] = static_cast<float>((r + 1) * (i % 13));
+      }
+      comm.Barrier();
+      comm.Allreduce(data[r].data(), count, tp<float>());
+      float value = r == 2 ? 42.F : 0.F;
+      comm.Broadcast(&value, sizeof(value), 2);
+      broadcast[r] = value;
+      const int mine[2] = {r, -r};
+      comm.Allgather(mine, sizeof(mine), gathered[r].data());
+      comm.Barrier();
+    });
+  }
+  ranks.join_all();
+
+  for (int r = 0; r < size; ++r) {
+    EXPECT_EQ(42.F, broadcast[r]);
+    for (int p = 0; p < size; ++p) {
+      EXPECT_EQ(p, gathered[r][2 * p]);
+      EXPECT_EQ(-p, gathered[r][2 * p + 1]);
+    }
+    for (int i = 0; i < count; ++i) {
+      ASSERT_EQ(10.F * (i % 13), data[r][i]) << "rank " << r << " at " << i;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -99,5 +99,6 @@ template class BlockingQueue<shared_ptr<Batch<float16>>>;
 #endif
 template class BlockingQueue<shared_ptr<Datum>>;
 template class BlockingQueue<P2PSync*>;
+template class BlockingQueue<Net*>;
 
 }  // namespace caffe
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe/common.hpp"
+#include "caffe/util/counter_rng.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+// SplitMix64 finalizer, used to derive stream ids
+static uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Blocks of 32 outputs handed to one pool task at a time
+const int kCounterRNGGrain = 256;
+
+CounterRNG::CounterRNG(uint64_t seed, uint64_t stream)
+    : seed_(seed), stream_(stream), offset_(0UL), philox_(seed) {}
+
+CounterRNG CounterRNG::Split(uint64_t id) const {
+  return CounterRNG(seed_, mix64(stream_ ^ mix64(id)));
+}
+
+uint64_t CounterRNG::Next64() {
+  uint32_t words[4];
+  philox_(stream_, offset_++, words);
+  return (static_cast<uint64_t>(words[1]) << 32) | words[0];
+}
+
+template <typename Fn>
+void CounterRNG::ForBlocks(int n, const Fn& fn) {
+  CHECK_GE(n, 0);
+  const int blocks = (n + kBlock - 1) / kBlock;
+  const uint64_t base = offset_;
+  offset_ += static_cast<uint64_t>(blocks) * Philox4x32::kBatch;
+  caffe_cpu_parallel_for(blocks, [&](int begin, int end) {
+    uint32_t words[kBlock];
+    for (int b = begin; b < end; ++b) {
+      philox_.Batch(stream_, base + static_cast<uint64_t>(b) * Philox4x32::kBatch, words);
+      const int first = b * kBlock;
+      fn(words, first, std::min(kBlock, n - first));
+    }
+  }, kCounterRNGGrain);
+}
+
+template <typename Dtype>
+void CounterRNG::Uniform(int n, float a, float b, Dtype* r) {
+  CHECK(r);
+  CHECK_LE(a, b);
+  const float range = b - a;
+  ForBlocks(n, [=](const uint32_t* words, int first, int count) {
+    for (int i = 0; i < count; ++i) {
+      // 24 random bits over [0, 1], both ends included as with the boost
+      // uniform_real on [a, nextafter(b)) used before; b is returned as is
+      // rather than as a + (b - a), which may round below it
+      const uint32_t bits = words[i] >> 8;
+      r[first + i] = bits == 0xFFFFFFU ? b :
+          std::min(a + range * (static_cast<float>(bits) * (1.F / 16777215.F)), b);
+    }
+  });
+}
+
+void CounterRNG::UniformInt(int n, int a, int b, int* r) {
+  CHECK(r);
+  CHECK_LE(a, b);
+  const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(b) - a + 1);
+  ForBlocks(n, [=](const uint32_t* words, int first, int count) {
+    for (int i = 0; i < count; ++i) {
+      r[first + i] = static_cast<int>(a + static_cast<int64_t>((words[i] * range) >> 32));
+    }
+  });
+}
+
+template <typename Dtype>
+void CounterRNG::Gaussian(int n, float mu, float sigma, Dtype* r) {
+  CHECK(r);
+  CHECK_GT(sigma, 0);
+  ForBlocks(n, [=](const uint32_t* words, int first, int count) {
+    for (int i = 0; i < count; i += 2) {
+      // u1 in (0, 1] keeps log finite, u2 in [0, 1)
+      const float u1 = (static_cast<float>(words[i] >> 8) + 1.F) * (1.F / 16777216.F);
+      const float u2 = static_cast<float>(words[i + 1] >> 8) * (1.F / 16777216.F);
+      const float radius = sigma * std::sqrt(-2.F * std::log(u1));
+      const float theta = 6.2831853071795864F * u2;
+      r[first + i] = mu + radius * std::cos(theta);
+      if (i + 1 < count) {
+        r[first + i + 1] = mu + radius * std::sin(theta);
+      }
+    }
+  });
+}
+
+template <typename Itype>
+void CounterRNG::Bernoulli(int n, double p, Itype* r) {
+  CHECK(r);
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  const uint64_t threshold = static_cast<uint64_t>(p * 4294967296.);
+  ForBlocks(n, [=](const uint32_t* words, int first, int count) {
+    for (int i = 0; i < count; ++i) {
+      r[first + i] = static_cast<Itype>(words[i] < threshold);
+    }
+  });
+}
+
+template void CounterRNG::Uniform<float>(int n, float a, float b, float* r);
+template void CounterRNG::Uniform<double>(int n, float a, float b, double* r);
+template void CounterRNG::Gaussian<float>(int n, float mu, float sigma, float* r);
+template void CounterRNG::Gaussian<double>(int n, float mu, float sigma, double* r);
+#ifndef CPU_ONLY
+template void CounterRNG::Uniform<float16>(int n, float a, float b, float16* r);
+template void CounterRNG::Gaussian<float16>(int n, float mu, float sigma, float16* r);
+#endif
+template void CounterRNG::Bernoulli<int>(int n, double p, int* r);
+template void CounterRNG::Bernoulli<unsigned int>(int n, double p, unsigned int* r);
+
+}  // namespace caffe
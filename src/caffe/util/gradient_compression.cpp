@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/gradient_compression.hpp"
+
+namespace caffe {
+
+void caffe_cpu_topk_compress(int n, const float* g, float* residual, int k,
+    SparseGradient* out) {
+  CHECK_GT(k, 0);
+  CHECK_LE(k, n);
+  for (int i = 0; i < n; ++i) {
+    residual[i] += g[i];
+  }
+  static thread_local std::vector<int32_t> idx;
+  idx.resize(n);
+  std::iota(idx.begin(), idx.end(), 0);
+  std::nth_element(idx.begin(), idx.begin() + (k - 1), idx.end(),
+      [residual](int32_t a, int32_t b) {
+        return std::fabs(residual[a]) > std::fabs(residual[b]);
+      });
+  for (int j = 0; j < k; ++j) {
+    out[j].index = idx[j];
+    out[j].value = residual[idx[j]];
+    residual[idx[j]] = 0.F;
+  }
+}
+
+namespace {
+
+// Round to nearest even, overflow to infinity, NaN kept quiet
+uint16_t float_to_half(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000U);
+  const uint32_t abs = x & 0x7fffffffU;
+  if (abs >= 0x7f800000U) {
+    return sign | 0x7c00U | (abs > 0x7f800000U ? 0x200U : 0U);
+  }
+  if (abs >= 0x477ff000U) {  // 65520 and above round past the largest half
+    return sign | 0x7c00U;
+  }
+  if (abs < 0x38800000U) {  // below 2^-14: subnormal steps of 2^-24
+    float a;
+    std::memcpy(&a, &abs, sizeof(a));
+    return sign | static_cast<uint16_t>(std::nearbyint(a * 16777216.F));
+  }
+  return sign | static_cast<uint16_t>((abs + 0xfffU + ((abs >> 13) & 1U) - 0x38000000U) >> 13);
+}
+
+float half_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000U) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1fU, mantissa = h & 0x3ffU;
+  if (exponent == 0U) {
+    const float a = mantissa * (1.F / 16777216.F);
+    return sign ? -a : a;
+  }
+  const uint32_t x = sign | (exponent == 0x1fU ? 0x7f800000U : (exponent + 112U) << 23)
+      | (mantissa << 13);
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+}  // namespace
+
+void caffe_cpu_half_compress(int n, const float* g, uint16_t* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = float_to_half(g[i]);
+  }
+}
+
+void caffe_cpu_half_accumulate(int n, int m, const uint16_t* in, float* g) {
+  std::memset(g, 0, n * sizeof(float));
+  for (int j = 0; j < m; ++j) {
+    const uint16_t* h = in + static_cast<size_t>(j) * n;
+    for (int i = 0; i < n; ++i) {
+      g[i] += half_to_float(h[i]);
+    }
+  }
+}
+
+void caffe_cpu_sparse_accumulate(int n, int m, const SparseGradient* in, float* g) {
+  std::memset(g, 0, n * sizeof(float));
+  for (int j = 0; j < m; ++j) {
+    DCHECK_GE(in[j].index, 0);
+    DCHECK_LT(in[j].index, n);
+    g[in[j].index] += in[j].value;
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,314 @@
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/host_memory.hpp"
+
+namespace caffe {
+
+const size_t HostMemory::ALIGNMENT = 64UL;
+const size_t HostMemory::HUGE_PAGE_SIZE = 2UL << 20;  // 2M
+const size_t HostMemory::DEFAULT_CACHE_LIMIT = 1UL << 30;  // 1G
+
+namespace {
+
+// Size of the class of @p size and its index: 64 bytes, then four classes
+// per power of two
+size_t class_of(size_t size, int* index) {
+  if (size <= 64UL) {
+    *index = 0;
+    return 64UL;
+  }
+  const int p = 63 - __builtin_clzll(size - 1UL);  // 2^p < size <= 2^(p+1)
+  const size_t base = 1UL << p, step = base >> 2;
+  const size_t sub = (size - base + step - 1UL) / step;  // 1..4
+  *index = (p - 6) * 4 + static_cast<int>(sub);
+  return base + sub * step;
+}
+
+void* system_allocate(size_t bytes, bool pinned) {
+  void* ptr = nullptr;
+  if (pinned) {
+#ifndef CPU_ONLY
+    if (cudaMallocHost(&ptr, bytes) != cudaSuccess) {
+      cudaGetLastError();  // clear it, the caller retries
+      return nullptr;
+    }
+#else
+    NO_GPU;
+#endif
+    return ptr;
+  }
+  const bool huge = bytes >= HostMemory::HUGE_PAGE_SIZE;
+  if (posix_memalign(&ptr, huge ? HostMemory::HUGE_PAGE_SIZE : HostMemory::ALIGNMENT,
+      bytes) != 0) {
+    return nullptr;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    madvise(ptr, bytes & ~(HostMemory::HUGE_PAGE_SIZE - 1UL), MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void system_free(void* ptr, bool pinned) {
+#ifndef CPU_ONLY
+  if (pinned) {
+    CUDA_CHECK(cudaFreeHost(ptr));
+    return;
+  }
+#endif
+  free(ptr);
+}
+
+// CPU to NUMA node map read from sysfs, empty if there is none
+vector<int> read_cpu_nodes() {
+  vector<int> cpu_nodes;
+  for (int node = 0; node < 1024; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!file) {
+      if (node > 0) {
+        break;
+      }
+      continue;
+    }
+    // Comma separated CPUs and ranges: 0-3,8-11
+    string range;
+    while (std::getline(file, range, ',')) {
+      int first = -1, last = -1;
+      char dash;
+      std::istringstream is(range);
+      if (!(is >> first)) {
+        continue;
+      }
+      if (!(is >> dash >> last)) {
+        last = first;
+      }
+      if (last >= static_cast<int>(cpu_nodes.size())) {
+        cpu_nodes.resize(last + 1, 0);
+      }
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpu_nodes[cpu] = node;
+      }
+    }
+  }
+  return cpu_nodes;
+}
+
+class HostPool {
+ public:
+  HostPool() : limit_(HostMemory::DEFAULT_CACHE_LIMIT), stats_() {
+    const char* limit_env = getenv("CAFFE_HOST_CACHE_MB");
+    if (limit_env != nullptr) {
+      limit_ = static_cast<size_t>(std::atoll(limit_env)) << 20;
+    }
+  }
+
+  void* allocate(size_t size, bool pinned) {
+    int index;
+    const size_t bytes = class_of(size, &index);
+    const int node = HostMemory::current_numa_node();
+    const uint64_t key = make_key(index, node, pinned);
+    void* ptr = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = cache_.find(key);
+      if (it != cache_.end() && !it->second.empty()) {
+        ptr = it->second.back();
+        it->second.pop_back();
+        stats_.cached -= bytes;
+        ++stats_.reuses;
+      }
+    }
+    if (ptr == nullptr) {
+      ptr = system_allocate(bytes, pinned);
+      if (ptr == nullptr) {
+        release_cached();
+        ptr = system_allocate(bytes, pinned);
+      }
+      CHECK(ptr) << "host allocation of size " << size << " failed";
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_.emplace(ptr, key);
+    stats_.in_use += bytes;
+    stats_.peak = std::max(stats_.peak, stats_.in_use);
+    ++stats_.allocations;
+    return ptr;
+  }
+
+  void deallocate(void* ptr) {
+    vector<std::pair<void*, bool>> released;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = live_.find(ptr);
+      CHECK(it != live_.end()) << "host buffer " << ptr << " was not allocated by HostMemory";
+      const uint64_t key = it->second;
+      live_.erase(it);
+      const size_t bytes = key_bytes(key);
+      stats_.in_use -= bytes;
+      if (bytes > limit_) {
+        // Never fits: the cached buffers are kept
+        released.emplace_back(ptr, key_pinned(key));
+      } else {
+        // Make room by dropping the largest cached buffers
+        while (stats_.cached + bytes > limit_) {
+          auto largest = std::prev(cache_.end());
+          if (largest->second.empty()) {
+            cache_.erase(largest);
+            continue;
+          }
+          released.emplace_back(largest->second.back(), key_pinned(largest->first));
+          largest->second.pop_back();
+          stats_.cached -= key_bytes(largest->first);
+        }
+        cache_[key].push_back(ptr);
+        stats_.cached += bytes;
+      }
+      stats_.releases += released.size();
+    }
+    for (const std::pair<void*, bool>& buffer : released) {
+      system_free(buffer.first, buffer.second);
+    }
+  }
+
+  void release_cached() {
+    std::map<uint64_t, vector<void*>> cache;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cache.swap(cache_);
+      for (const auto& buffers : cache) {
+        stats_.releases += buffers.second.size();
+      }
+      stats_.cached = 0UL;
+    }
+    for (const auto& buffers : cache) {
+      for (void* ptr : buffers.second) {
+        system_free(ptr, key_pinned(buffers.first));
+      }
+    }
+  }
+
+  void set_limit(size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      limit_ = bytes;
+      if (stats_.cached <= limit_) {
+        return;
+      }
+    }
+    release_cached();
+  }
+
+  size_t limit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+  }
+
+  HostMemory::Stats stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  // Ordered by size class first, so that the largest buffers are dropped first
+  static uint64_t make_key(int index, int node, bool pinned) {
+    return (static_cast<uint64_t>(index) << 32) | (static_cast<uint64_t>(node) << 1) |
+        (pinned ? 1ULL : 0ULL);
+  }
+  static size_t key_bytes(uint64_t key) {
+    const int index = static_cast<int>(key >> 32);
+    if (index == 0) {
+      return 64UL;
+    }
+    const int p = (index - 1) / 4 + 6;
+    const size_t base = 1UL << p;
+    return base + static_cast<size_t>((index - 1) % 4 + 1) * (base >> 2);
+  }
+  static bool key_pinned(uint64_t key) {
+    return (key & 1ULL) != 0ULL;
+  }
+
+  std::mutex mutex_;
+  size_t limit_;
+  HostMemory::Stats stats_;
+  std::map<uint64_t, vector<void*>> cache_;
+  std::unordered_map<void*, uint64_t> live_;
+};
+
+// Never destroyed: SyncedMemory objects with static storage may outlive it
+HostPool& host_pool() {
+  static HostPool* pool = new HostPool();
+  return *pool;
+}
+
+}  // namespace
+
+void* HostMemory::allocate(size_t size, bool pinned) {
+  return host_pool().allocate(size, pinned);
+}
+
+void HostMemory::deallocate(void* ptr) {
+  host_pool().deallocate(ptr);
+}
+
+size_t HostMemory::size_class(size_t size) {
+  int index;
+  return class_of(size, &index);
+}
+
+void HostMemory::set_cache_limit(size_t bytes) {
+  host_pool().set_limit(bytes);
+}
+
+size_t HostMemory::cache_limit() {
+  return host_pool().limit();
+}
+
+void HostMemory::release_cached() {
+  host_pool().release_cached();
+}
+
+HostMemory::Stats HostMemory::stats() {
+  return host_pool().stats();
+}
+
+std::string HostMemory::report() {
+  const Stats s = stats();
+  std::ostringstream os;
+  os << "Host memory: " << (s.in_use >> 20) << "M in use (peak " << (s.peak >> 20)
+     << "M), " << (s.cached >> 20) << "M cached; " << s.allocations << " allocations, "
+     << s.reuses << " reused, " << s.releases << " released";
+  return os.str();
+}
+
+const vector<int>& HostMemory::cpu_numa_nodes() {
+  static const vector<int> cpu_nodes = read_cpu_nodes();
+  return cpu_nodes;
+}
+
+int HostMemory::current_numa_node() {
+#ifdef __linux__
+  const vector<int>& cpu_nodes = cpu_numa_nodes();
+  const int cpu = sched_getcpu();
+  if (cpu >= 0 && cpu < static_cast<int>(cpu_nodes.size())) {
+    return cpu_nodes[cpu];
+  }
+#endif
+  return 0;
+}
+
+}  // namespace caffe
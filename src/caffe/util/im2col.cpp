@@ -65,6 +65,11 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
+template void im2col_cpu<int8_t>(const int8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    int8_t* data_col);
 #ifndef CPU_ONLY
 template void im2col_cpu<float16>(const float16* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -165,6 +170,11 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* im_shape, const int* col_shape,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_col);
+template void im2col_nd_cpu<int8_t>(const int8_t* data_im,
+    const int num_spatial_axes,
+    const int* im_shape, const int* col_shape,
+    const int* kernel_shape, const int* pad, const int* stride,
+    const int* dilation, int8_t* data_col);
 #ifndef CPU_ONLY
 template void im2col_nd_cpu<float16>(const float16* data_im,
     const int num_spatial_axes,
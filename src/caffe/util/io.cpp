@@ -1,6 +1,7 @@
 #include <fcntl.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <google/protobuf/text_format.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
@@ -9,8 +10,12 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -30,6 +35,7 @@ using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
 using google::protobuf::Message;
+using google::protobuf::internal::WireFormatLite;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
@@ -64,12 +70,91 @@ bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   return success;
 }
 
+bool IndexLayersInBinaryFile(const string& filename, vector<SerializedLayer>* layers) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  FileInputStream raw_input(fd);
+  CodedInputStream coded_input(&raw_input);
+  coded_input.SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
+  layers->clear();
+  bool current = true;
+  while (uint32_t tag = coded_input.ReadTag()) {
+    const int field = WireFormatLite::GetTagFieldNumber(tag);
+    if (field == NetParameter::kLayersFieldNumber) {
+      current = false;
+      break;
+    }
+    if (field != NetParameter::kLayerFieldNumber ||
+        WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      CHECK(WireFormatLite::SkipField(&coded_input, tag)) << "Corrupted " << filename;
+      continue;
+    }
+    uint32_t length;
+    CHECK(coded_input.ReadVarint32(&length)) << "Corrupted " << filename;
+    SerializedLayer layer;
+    layer.offset = coded_input.CurrentPosition();
+    layer.length = length;
+    CodedInputStream::Limit limit = coded_input.PushLimit(length);
+    while (uint32_t layer_tag = coded_input.ReadTag()) {
+      if (WireFormatLite::GetTagFieldNumber(layer_tag) == LayerParameter::kNameFieldNumber) {
+        CHECK(WireFormatLite::ReadString(&coded_input, &layer.name)) << "Corrupted " << filename;
+        break;
+      }
+      CHECK(WireFormatLite::SkipField(&coded_input, layer_tag)) << "Corrupted " << filename;
+    }
+    // Blobs are not read here: FileInputStream seeks over them
+    CHECK(coded_input.Skip(coded_input.BytesUntilLimit())) << "Corrupted " << filename;
+    coded_input.PopLimit(limit);
+    layers->push_back(layer);
+  }
+  close(fd);
+  return current;
+}
+
+void ReadLayerFromBinaryFile(const string& filename, const SerializedLayer& range,
+    LayerParameter* layer) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  string buffer(range.length, '\0');
+  size_t done = 0UL;
+  while (done < buffer.size()) {
+    ssize_t n = pread(fd, &buffer[done], buffer.size() - done, range.offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Cannot read layer " << range.name << " from " << filename;
+    done += n;
+  }
+  close(fd);
+  CHECK(layer->ParseFromString(buffer)) << "Failed to parse layer " << range.name
+      << " of " << filename;
+}
+
 void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   fstream output(filename, ios::out | ios::trunc | ios::binary);
   CHECK(proto.SerializeToOstream(&output)) << "Possible reasons: no disk space, "
       "no write permissions, the destination folder doesn't exist";
 }
 
+void WriteProtoToBinaryFileAtomic(const Message& proto, const char* filename) {
+  const string tmp_filename = string(filename) + ".tmp";
+  int fd = open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Cannot create " << tmp_filename << ": " << std::strerror(errno);
+  CHECK(proto.SerializeToFileDescriptor(fd)) << "Possible reasons: no disk space, "
+      "no write permissions, the destination folder doesn't exist";
+  CHECK_EQ(fsync(fd), 0) << "Cannot sync " << tmp_filename << ": " << std::strerror(errno);
+  CHECK_EQ(close(fd), 0);
+  CHECK_EQ(std::rename(tmp_filename.c_str(), filename), 0)
+      << "Cannot rename " << tmp_filename << ": " << std::strerror(errno);
+  // Make the rename itself durable
+  string dir = path(filename).parent_path().string();
+  int dir_fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+  if (dir_fd != -1) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
@@ -1,12 +1,15 @@
 #include <boost/math/special_functions/next.hpp>
-#include <boost/random.hpp>
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
+#include <type_traits>
 #include <vector>
 
 #include "caffe/common.hpp"
+#include "caffe/util/counter_rng.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/parallel_for.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -413,12 +416,7 @@ void caffe_rng_uniform(int n, float a, float b, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  boost::uniform_real<float> random_distribution(a, caffe_nextafter<float>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<float> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  Caffe::counter_rng().Uniform(n, a, b, r);
 }
 
 template <>
@@ -426,15 +424,8 @@ void caffe_rng_uniform<int>(int n, float a, float b, int* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  // NOTE: `boost::uniform_int` uses an inclusive (closed) interval.
-  const int lower = static_cast<int>(a);
-  const int upper = static_cast<int>(b);
-  boost::uniform_int<> incl_range(lower, upper);
-  boost::variate_generator<caffe::rng_t*, boost::uniform_int<> >
-       variate_generator(caffe_rng(), incl_range);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  // NOTE: the integer range is inclusive (closed) like `boost::uniform_int`.
+  Caffe::counter_rng().UniformInt(n, static_cast<int>(a), static_cast<int>(b), r);
 }
 
 template
@@ -453,12 +444,7 @@ void caffe_rng_gaussian(int n, float a, float sigma, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_GT(sigma, 0);
-  boost::normal_distribution<float> random_distribution(a, sigma);
-  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<float> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  Caffe::counter_rng().Gaussian(n, a, sigma, r);
 }
 
 template
@@ -478,12 +464,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<int>(variate_generator());
-  }
+  Caffe::counter_rng().Bernoulli(n, static_cast<double>(p), r);
 }
 
 template
@@ -505,12 +486,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
+  Caffe::counter_rng().Bernoulli(n, static_cast<double>(p), r);
 }
 
 template
@@ -702,5 +678,141 @@ template void caffe_cpu_eltwise_min<float16>(const int N,
     const float16 alpha, const float16* x, const float16 beta, float16* y);
 #endif
 
+// Inner positions handled together by one softmax task: the per-position
+// running max and sum live in a small scratch while channels are swept.
+const int kSoftmaxInnerBlock = 256;
+// Rough number of elements worth handing to a pool thread.
+const int kSoftmaxGrainSize = 16384;
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y) {
+  // float16 is accumulated in float, float and double in their own precision
+  typedef typename std::conditional<std::is_same<Dtype, double>::value,
+      double, float>::type Mtype;
+  if (outer_num <= 0 || channels <= 0 || inner_num <= 0) {
+    return;
+  }
+  const int dim = channels * inner_num;
+  const int block = std::min(inner_num, kSoftmaxInnerBlock);
+  const int blocks = (inner_num + block - 1) / block;
+  const int grain = std::max(1, kSoftmaxGrainSize / (channels * block));
+  caffe_cpu_parallel_for(outer_num * blocks, [&](int begin, int end) {
+    vector<Mtype> scratch(2 * block);
+    Mtype* vmax = scratch.data();
+    Mtype* vsum = vmax + block;
+    for (int task = begin; task < end; ++task) {
+      const int offset = (task / blocks) * dim + (task % blocks) * block;
+      const Dtype* src = x + offset;
+      Dtype* dst = y + offset;
+      if (inner_num == 1) {
+        // Contiguous row, e.g. classifier head
+        Mtype m = src[0];
+        for (int c = 1; c < channels; ++c) {
+          m = std::max(m, static_cast<Mtype>(src[c]));
+        }
+        Mtype sum = 0;
+        for (int c = 0; c < channels; ++c) {
+          const Mtype e = std::exp(static_cast<Mtype>(src[c]) - m);
+          dst[c] = e;
+          sum += e;
+        }
+        const Mtype inv = Mtype(1) / sum;
+        for (int c = 0; c < channels; ++c) {
+          dst[c] = static_cast<Mtype>(dst[c]) * inv;
+        }
+        continue;
+      }
+      const int len = std::min(block, inner_num - (task % blocks) * block);
+      for (int k = 0; k < len; ++k) {
+        vmax[k] = src[k];
+        vsum[k] = 0;
+      }
+      for (int c = 1; c < channels; ++c) {
+        const Dtype* row = src + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          vmax[k] = std::max(vmax[k], static_cast<Mtype>(row[k]));
+        }
+      }
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* row = src + c * inner_num;
+        Dtype* out = dst + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          const Mtype e = std::exp(static_cast<Mtype>(row[k]) - vmax[k]);
+          out[k] = e;
+          vsum[k] += e;
+        }
+      }
+      for (int k = 0; k < len; ++k) {
+        vsum[k] = Mtype(1) / vsum[k];
+      }
+      for (int c = 0; c < channels; ++c) {
+        Dtype* out = dst + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          out[k] = static_cast<Mtype>(out[k]) * vsum[k];
+        }
+      }
+    }
+  }, grain);
+}
+
+template void caffe_cpu_softmax<float>(const int outer_num, const int channels,
+    const int inner_num, const float* x, float* y);
+template void caffe_cpu_softmax<double>(const int outer_num, const int channels,
+    const int inner_num, const double* x, double* y);
+#ifndef CPU_ONLY
+template void caffe_cpu_softmax<float16>(const int outer_num,
+    const int channels, const int inner_num, const float16* x, float16* y);
+#endif
+
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* top_data, const Dtype* top_diff,
+    Dtype* bottom_diff) {
+  typedef typename std::conditional<std::is_same<Dtype, double>::value,
+      double, float>::type Mtype;
+  if (outer_num <= 0 || channels <= 0 || inner_num <= 0) {
+    return;
+  }
+  const int dim = channels * inner_num;
+  const int block = std::min(inner_num, kSoftmaxInnerBlock);
+  const int blocks = (inner_num + block - 1) / block;
+  const int grain = std::max(1, kSoftmaxGrainSize / (channels * block));
+  caffe_cpu_parallel_for(outer_num * blocks, [&](int begin, int end) {
+    vector<Mtype> vdot(block);
+    for (int task = begin; task < end; ++task) {
+      const int offset = (task / blocks) * dim + (task % blocks) * block;
+      const int len = std::min(block, inner_num - (task % blocks) * block);
+      std::fill(vdot.begin(), vdot.begin() + len, Mtype(0));
+      for (int c = 0; c < channels; ++c) {
+        const int row = offset + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          vdot[k] += static_cast<Mtype>(top_diff[row + k]) *
+              static_cast<Mtype>(top_data[row + k]);
+        }
+      }
+      for (int c = 0; c < channels; ++c) {
+        const int row = offset + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          bottom_diff[row + k] = (static_cast<Mtype>(top_diff[row + k]) -
+              vdot[k]) * static_cast<Mtype>(top_data[row + k]);
+        }
+      }
+    }
+  }, grain);
+}
+
+template void caffe_cpu_softmax_backward<float>(const int outer_num,
+    const int channels, const int inner_num, const float* top_data,
+    const float* top_diff, float* bottom_diff);
+template void caffe_cpu_softmax_backward<double>(const int outer_num,
+    const int channels, const int inner_num, const double* top_data,
+    const double* top_diff, double* bottom_diff);
+#ifndef CPU_ONLY
+template void caffe_cpu_softmax_backward<float16>(const int outer_num,
+    const int channels, const int inner_num, const float16* top_data,
+    const float16* top_diff, float16* bottom_diff);
+#endif
+
 
 }  // namespace caffe
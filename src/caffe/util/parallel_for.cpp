@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_memory.hpp"
+#include "caffe/util/parallel_for.hpp"
+
+namespace caffe {
+
+namespace {
+
+thread_local bool tl_in_cpu_worker = false;
+
+void pin_current_thread(const std::vector<int>& cores) {
+#ifdef __linux__
+  if (cores.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int core : cores) {
+    CPU_SET(core, &set);
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    LOG(WARNING) << "Failed to pin thread to " << cores.size() << " core(s)";
+  }
+#endif
+}
+
+// Fork-join pool: one job at a time, the caller participates in the work.
+// A pool built over a core list pins worker i to cores[i], cores[0] being
+// left for the caller.
+class CpuWorkerPool {
+ public:
+  explicit CpuWorkerPool(const std::vector<int>& cores = std::vector<int>())
+      : cores_(cores), fn_(nullptr), n_(0), chunk_(1), next_(0), busy_(0),
+        generation_(0UL), stop_(false) {
+    resize(0);
+  }
+
+  ~CpuWorkerPool() {
+    stop_workers();
+  }
+
+  int threads() const {
+    return static_cast<int>(workers_.size()) + 1;
+  }
+
+  const std::vector<int>& cores() const {
+    return cores_;
+  }
+
+  void resize(int threads) {
+    if (threads <= 0) {
+      threads = cores_.empty() ? std::max(1U, std::thread::hardware_concurrency())
+                               : static_cast<int>(cores_.size());
+    }
+    std::lock_guard<std::mutex> caller_lock(caller_mutex_);
+    stop_workers();
+    stop_ = false;
+    for (int i = 1; i < threads; ++i) {
+      workers_.emplace_back(&CpuWorkerPool::worker_loop, this, i);
+    }
+  }
+
+  void run(int n, const std::function<void(int, int)>& fn, int grain) {
+    if (n <= 0) {
+      return;
+    }
+    grain = std::max(grain, 1);
+    std::unique_lock<std::mutex> caller_lock(caller_mutex_, std::try_to_lock);
+    if (tl_in_cpu_worker || !caller_lock.owns_lock() || workers_.empty() || n <= grain) {
+      fn(0, n);
+      return;
+    }
+    const int nthreads = threads();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      fn_ = &fn;
+      n_ = n;
+      chunk_ = std::max(grain, (n + nthreads - 1) / nthreads);
+      next_.store(0);
+      busy_ = static_cast<int>(workers_.size());
+      ++generation_;
+    }
+    cv_.notify_all();
+    run_chunks();
+    std::unique_lock<std::mutex> lock(m_);
+    done_cv_.wait(lock, [this] { return busy_ == 0; });
+    fn_ = nullptr;
+  }
+
+ private:
+  void run_chunks() {
+    while (true) {
+      const int begin = next_.fetch_add(chunk_);
+      if (begin >= n_) {
+        break;
+      }
+      (*fn_)(begin, std::min(begin + chunk_, n_));
+    }
+  }
+
+  void worker_loop(int id) {
+    tl_in_cpu_worker = true;
+    if (!cores_.empty()) {
+      pin_current_thread(std::vector<int>(1, cores_[id % cores_.size()]));
+    }
+    uint64_t seen = 0UL;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+      run_chunks();
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        --busy_;
+      }
+      done_cv_.notify_one();
+    }
+  }
+
+  void stop_workers() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : workers_) {
+      t.join();
+    }
+    workers_.clear();
+  }
+
+  const std::vector<int> cores_;
+  std::mutex caller_mutex_;
+  std::mutex m_;
+  std::condition_variable cv_, done_cv_;
+  std::vector<std::thread> workers_;
+  const std::function<void(int, int)>* fn_;
+  int n_, chunk_;
+  std::atomic<int> next_;
+  int busy_;
+  uint64_t generation_;
+  bool stop_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(CpuWorkerPool);
+};
+
+// CPUs the process may run on, in increasing order
+std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    const int hw = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+    for (int cpu = 0; cpu < hw; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Splits @p cpus into @p groups so that no NUMA node (as in @p cpu_nodes,
+// 0 for CPUs it does not list) is shared by two groups while there are at
+// least as many groups as nodes. Nodes get groups in proportion to their
+// CPUs and every group a contiguous share of its node. Fewer groups than
+// nodes take whole nodes each; more groups than CPUs share CPUs.
+std::vector<std::vector<int>> split_core_groups(int groups, const std::vector<int>& cpus,
+    const std::vector<int>& cpu_nodes) {
+  std::vector<std::vector<int>> nodes;
+  std::vector<int> node_index;
+  for (int cpu : cpus) {
+    const int node = cpu < static_cast<int>(cpu_nodes.size()) ? cpu_nodes[cpu] : 0;
+    if (node >= static_cast<int>(node_index.size())) {
+      node_index.resize(node + 1, -1);
+    }
+    if (node_index[node] < 0) {
+      node_index[node] = static_cast<int>(nodes.size());
+      nodes.emplace_back();
+    }
+    nodes[node_index[node]].push_back(cpu);
+  }
+  std::vector<std::vector<int>> result(groups);
+  const int num_nodes = static_cast<int>(nodes.size());
+  if (groups < num_nodes) {
+    for (int n = 0; n < num_nodes; ++n) {
+      std::vector<int>& group = result[n % groups];
+      group.insert(group.end(), nodes[n].begin(), nodes[n].end());
+    }
+    return result;
+  }
+  // One group per node, the rest by largest remainder of the CPU share
+  std::vector<int> node_groups(num_nodes, 1);
+  std::vector<double> remainder(num_nodes);
+  int assigned = num_nodes;
+  const double spare = groups - num_nodes;
+  for (int n = 0; n < num_nodes; ++n) {
+    const double share = spare * nodes[n].size() / cpus.size();
+    node_groups[n] += static_cast<int>(share);
+    assigned += static_cast<int>(share);
+    remainder[n] = share - static_cast<int>(share);
+  }
+  for (; assigned < groups; ++assigned) {
+    const int n = static_cast<int>(std::max_element(remainder.begin(), remainder.end())
+        - remainder.begin());
+    ++node_groups[n];
+    remainder[n] = -1.;
+  }
+  int g = 0;
+  for (int n = 0; n < num_nodes; ++n) {
+    const int size = static_cast<int>(nodes[n].size());
+    for (int i = 0; i < node_groups[n]; ++i, ++g) {
+      const int begin = i * size / node_groups[n], end = (i + 1) * size / node_groups[n];
+      result[g].assign(nodes[n].begin() + begin, nodes[n].begin() + std::max(begin + 1, end));
+    }
+  }
+  return result;
+}
+
+// Pool and index of the core group the calling thread joined, if any
+thread_local CpuWorkerPool* tl_group_pool = nullptr;
+thread_local int tl_group = -1;
+
+std::mutex& core_groups_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+std::vector<std::unique_ptr<CpuWorkerPool>>& core_group_pools() {
+  static std::vector<std::unique_ptr<CpuWorkerPool>> pools;
+  return pools;
+}
+
+CpuWorkerPool& cpu_worker_pool() {
+  if (tl_group_pool != nullptr) {
+    return *tl_group_pool;
+  }
+  static CpuWorkerPool pool;
+  return pool;
+}
+
+}  // namespace
+
+void caffe_cpu_parallel_for(int n, const std::function<void(int, int)>& fn, int grain) {
+  cpu_worker_pool().run(n, fn, grain);
+}
+
+int caffe_cpu_threads() {
+  return cpu_worker_pool().threads();
+}
+
+void caffe_set_cpu_threads(int threads) {
+  cpu_worker_pool().resize(threads);
+}
+
+void caffe_set_cpu_core_groups(int groups) {
+  std::lock_guard<std::mutex> lock(core_groups_mutex());
+  std::vector<std::unique_ptr<CpuWorkerPool>>& pools = core_group_pools();
+  pools.clear();
+  if (groups <= 1) {
+    return;
+  }
+  for (const std::vector<int>& cores :
+       split_core_groups(groups, allowed_cpus(), HostMemory::cpu_numa_nodes())) {
+    pools.emplace_back(new CpuWorkerPool(cores));
+  }
+}
+
+int caffe_cpu_core_groups() {
+  std::lock_guard<std::mutex> lock(core_groups_mutex());
+  return std::max(1, static_cast<int>(core_group_pools().size()));
+}
+
+void caffe_cpu_join_core_group(int group) {
+  std::lock_guard<std::mutex> lock(core_groups_mutex());
+  std::vector<std::unique_ptr<CpuWorkerPool>>& pools = core_group_pools();
+  if (group < 0 || pools.empty()) {
+    tl_group_pool = nullptr;
+    tl_group = -1;
+    return;
+  }
+  CHECK_LT(group, static_cast<int>(pools.size()));
+  tl_group_pool = pools[group].get();
+  tl_group = group;
+  pin_current_thread(tl_group_pool->cores());
+}
+
+int caffe_cpu_core_group() {
+  return tl_group;
+}
+
+}  // namespace caffe
@@ -0,0 +1,158 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <utility>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+static int64_t steady_micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler& Profiler::Get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler() : enabled_(false), recorded_(0UL), origin_us_(steady_micros()) {}
+
+int Profiler::thread_id() {
+  static std::atomic<int> next_id(0);
+  static thread_local const int id = next_id++;
+  return id;
+}
+
+void Profiler::Start(size_t capacity) {
+  CHECK_GT(capacity, 0UL);
+  std::lock_guard<std::mutex> lock(m_);
+  events_.clear();
+  events_.resize(capacity);
+  recorded_ = 0UL;
+  enabled_ = true;
+}
+
+void Profiler::Stop() {
+  enabled_ = false;
+}
+
+int64_t Profiler::Now() const {
+  return steady_micros() - origin_us_;
+}
+
+void Profiler::Record(const char* category, const string& name, int64_t begin_us,
+    int64_t end_us, double flops, double bytes) {
+  const int thread = thread_id();
+  std::lock_guard<std::mutex> lock(m_);
+  if (events_.empty()) {
+    return;
+  }
+  Event& event = events_[recorded_++ % events_.size()];
+  event.category = category;
+  event.name = name;
+  event.thread = thread;
+  event.begin_us = begin_us;
+  event.end_us = end_us;
+  event.flops = flops;
+  event.bytes = bytes;
+}
+
+vector<Profiler::Event> Profiler::Events() const {
+  std::lock_guard<std::mutex> lock(m_);
+  const size_t capacity = events_.size();
+  const size_t held = std::min(recorded_, capacity);
+  vector<Event> events;
+  events.reserve(held);
+  for (size_t i = recorded_ - held; i < recorded_; ++i) {
+    events.push_back(events_[i % capacity]);
+  }
+  return events;
+}
+
+static string json_escape(const string& s) {
+  std::ostringstream os;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+         << std::dec;
+    } else {
+      os << c;
+    }
+  }
+  return os.str();
+}
+
+void Profiler::WriteChromeTrace(const string& filename) const {
+  const vector<Event> events = Events();
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Failed to open " << filename;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Event& e = events[i];
+    out << (i == 0 ? "\n" : ",\n")
+        << "{\"name\":\"" << json_escape(e.name) << "\",\"cat\":\"" << json_escape(e.category)
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+        << ",\"ts\":" << e.begin_us << ",\"dur\":" << (e.end_us - e.begin_us);
+    if (e.flops > 0. || e.bytes > 0.) {
+      out << ",\"args\":{\"flops\":" << e.flops << ",\"bytes\":" << e.bytes << "}";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+  CHECK(out) << "Failed to write " << filename;
+}
+
+string Profiler::Summary() const {
+  struct Totals {
+    size_t calls = 0UL;
+    int64_t us = 0L;
+    double flops = 0., bytes = 0.;
+  };
+  const vector<Event> events = Events();
+  // Groups in order of first appearance
+  vector<pair<string, string>> keys;
+  std::map<pair<string, string>, Totals> totals;
+  for (const Event& e : events) {
+    const pair<string, string> key(e.category, e.name);
+    if (totals.find(key) == totals.end()) {
+      keys.push_back(key);
+    }
+    Totals& t = totals[key];
+    ++t.calls;
+    t.us += e.end_us - e.begin_us;
+    t.flops += e.flops;
+    t.bytes += e.bytes;
+  }
+  std::ostringstream os;
+  os << std::left << std::setw(10) << "category" << std::setw(24) << "name" << std::right
+     << std::setw(8) << "calls" << std::setw(12) << "total ms" << std::setw(10) << "avg ms"
+     << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s" << "\n";
+  os << std::fixed << std::setprecision(3);
+  for (const pair<string, string>& key : keys) {
+    const Totals& t = totals[key];
+    const double seconds = t.us * 1e-6;
+    os << std::left << std::setw(10) << key.first << std::setw(24) << key.second << std::right
+       << std::setw(8) << t.calls << std::setw(12) << t.us * 1e-3
+       << std::setw(10) << t.us * 1e-3 / t.calls;
+    if (seconds > 0. && t.flops > 0.) {
+      os << std::setw(10) << t.flops / seconds * 1e-9;
+    } else {
+      os << std::setw(10) << "-";
+    }
+    if (seconds > 0. && t.bytes > 0.) {
+      os << std::setw(10) << t.bytes / seconds * 1e-9;
+    } else {
+      os << std::setw(10) << "-";
+    }
+    os << "\n";
+  }
+  return os.str();
+}
+
+}  // namespace caffe
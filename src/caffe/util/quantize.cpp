@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ >= 8)
+#define CAFFE_GEMM_S8_X86
+#include <immintrin.h>
+#endif
+
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_quantize_s8(const int n, const Dtype* x, const float scale, int8_t* y) {
+  CHECK_GT(scale, 0.F);
+  const float inv_scale = 1.F / scale;
+  caffe_cpu_parallel_for(n, [&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      const float q = std::nearbyint(static_cast<float>(x[i]) * inv_scale);
+      y[i] = static_cast<int8_t>(std::max(-127.F, std::min(127.F, q)));
+    }
+  }, 16384);
+}
+
+template void caffe_cpu_quantize_s8<float>(const int n, const float* x, const float scale,
+    int8_t* y);
+template void caffe_cpu_quantize_s8<double>(const int n, const double* x, const float scale,
+    int8_t* y);
+#ifndef CPU_ONLY
+template void caffe_cpu_quantize_s8<float16>(const int n, const float16* x, const float scale,
+    int8_t* y);
+#endif
+
+namespace {
+
+// Columns of op(B) per panel: two vectors of 8 int32 lanes
+const int kGemmS8NR = 16;
+// Columns per task: K x kGemmS8NC bytes of packed B stay in L2
+const int kGemmS8NC = 256;
+// Most rows of A a kernel tiles
+const int kGemmS8MaxRows = 6;
+
+inline int round_up(int x, int m) {
+  return (x + m - 1) / m * m;
+}
+
+// Packs columns [j0, j0 + nc) of op(B) in panels of kGemmS8NR columns. Each
+// group of 4 k takes 64 bytes of a panel: the 4 values of every column sit in
+// one int32 lane, as the multiply-add instructions sum them. Missing k and
+// columns are zero; @p flip is xor-ed into every byte.
+void pack_b_s8(bool trans_b, int N, int K, int Kp, const int8_t* B, int j0, int nc,
+    uint8_t flip, int8_t* Bp) {
+  for (int p = 0; p < nc; p += kGemmS8NR) {
+    int8_t* panel = Bp + static_cast<size_t>(p) * Kp;
+    const int cols = std::min(kGemmS8NR, N - j0 - p);
+    for (int k = 0; k < Kp; k += 4) {
+      int8_t* dst = panel + k * kGemmS8NR;
+      if (cols == kGemmS8NR && k + 4 <= K) {
+        if (trans_b) {
+          const int8_t* src = B + static_cast<size_t>(j0 + p) * K + k;
+          for (int c = 0; c < kGemmS8NR; ++c) {
+            uint32_t v;
+            memcpy(&v, src + static_cast<size_t>(c) * K, 4);
+            v ^= flip * 0x01010101U;
+            memcpy(dst + 4 * c, &v, 4);
+          }
+        } else {
+          const int8_t* src = B + static_cast<size_t>(k) * N + j0 + p;
+#ifdef CAFFE_GEMM_S8_X86
+          // 4 x 16 byte transpose: interleave rows by bytes, then pairs by words
+          const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+          const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + N));
+          const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * N));
+          const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * N));
+          const __m128i lo01 = _mm_unpacklo_epi8(r0, r1), hi01 = _mm_unpackhi_epi8(r0, r1);
+          const __m128i lo23 = _mm_unpacklo_epi8(r2, r3), hi23 = _mm_unpackhi_epi8(r2, r3);
+          const __m128i x = _mm_set1_epi8(static_cast<char>(flip));
+          __m128i* out = reinterpret_cast<__m128i*>(dst);
+          _mm_storeu_si128(out, _mm_xor_si128(_mm_unpacklo_epi16(lo01, lo23), x));
+          _mm_storeu_si128(out + 1, _mm_xor_si128(_mm_unpackhi_epi16(lo01, lo23), x));
+          _mm_storeu_si128(out + 2, _mm_xor_si128(_mm_unpacklo_epi16(hi01, hi23), x));
+          _mm_storeu_si128(out + 3, _mm_xor_si128(_mm_unpackhi_epi16(hi01, hi23), x));
+#else
+          for (int c = 0; c < kGemmS8NR; ++c) {
+            for (int r = 0; r < 4; ++r) {
+              dst[4 * c + r] = static_cast<int8_t>(src[static_cast<size_t>(r) * N + c] ^ flip);
+            }
+          }
+#endif
+        }
+        continue;
+      }
+      for (int c = 0; c < kGemmS8NR; ++c) {
+        for (int r = 0; r < 4; ++r) {
+          int8_t v = 0;
+          if (c < cols && k + r < K) {
+            v = trans_b ? B[static_cast<size_t>(j0 + p + c) * K + k + r]
+                        : B[static_cast<size_t>(k + r) * N + j0 + p + c];
+          }
+          dst[4 * c + r] = static_cast<int8_t>(v ^ flip);
+        }
+      }
+    }
+  }
+}
+
+#ifdef CAFFE_GEMM_S8_X86
+// Products of int8 in [-127, 127]: |a| times b with the sign of a is exact
+// in u8 x s8 and pairs of them fit in int16 without saturating.
+#define CAFFE_GEMM_S8_AVX2_ROW(r) { \
+    const __m256i a = _mm256_set1_epi32(*reinterpret_cast<const int32_t*>(A + (r) * Kp + k)); \
+    acc##r##0 = _mm256_add_epi32(acc##r##0, _mm256_madd_epi16( \
+        _mm256_maddubs_epi16(u0, _mm256_sign_epi8(a, b0)), ones)); \
+    acc##r##1 = _mm256_add_epi32(acc##r##1, _mm256_madd_epi16( \
+        _mm256_maddubs_epi16(u1, _mm256_sign_epi8(a, b1)), ones)); \
+  }
+
+__attribute__((target("avx2")))
+void kernel_s8_avx2(int Kp, const int8_t* A, const int8_t* Bp, int32_t* tile) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc00 = _mm256_setzero_si256(), acc01 = _mm256_setzero_si256();
+  __m256i acc10 = _mm256_setzero_si256(), acc11 = _mm256_setzero_si256();
+  __m256i acc20 = _mm256_setzero_si256(), acc21 = _mm256_setzero_si256();
+  __m256i acc30 = _mm256_setzero_si256(), acc31 = _mm256_setzero_si256();
+  for (int k = 0; k < Kp; k += 4, Bp += 64) {
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp));
+    const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + 32));
+    const __m256i u0 = _mm256_abs_epi8(b0), u1 = _mm256_abs_epi8(b1);
+    CAFFE_GEMM_S8_AVX2_ROW(0)
+    CAFFE_GEMM_S8_AVX2_ROW(1)
+    CAFFE_GEMM_S8_AVX2_ROW(2)
+    CAFFE_GEMM_S8_AVX2_ROW(3)
+  }
+  __m256i* out = reinterpret_cast<__m256i*>(tile);
+  _mm256_storeu_si256(out + 0, acc00); _mm256_storeu_si256(out + 1, acc01);
+  _mm256_storeu_si256(out + 2, acc10); _mm256_storeu_si256(out + 3, acc11);
+  _mm256_storeu_si256(out + 4, acc20); _mm256_storeu_si256(out + 5, acc21);
+  _mm256_storeu_si256(out + 6, acc30); _mm256_storeu_si256(out + 7, acc31);
+}
+#undef CAFFE_GEMM_S8_AVX2_ROW
+
+// B is packed as u8 b + 128, the caller takes 128 * sum(a) off afterwards.
+#define CAFFE_GEMM_S8_VNNI_ROW(r) { \
+    const __m256i a = _mm256_set1_epi32(*reinterpret_cast<const int32_t*>(A + (r) * Kp + k)); \
+    acc##r##0 = _mm256_dpbusd_epi32(acc##r##0, b0, a); \
+    acc##r##1 = _mm256_dpbusd_epi32(acc##r##1, b1, a); \
+  }
+
+__attribute__((target("avx2,avx512vl,avx512vnni")))
+void kernel_s8_vnni(int Kp, const int8_t* A, const int8_t* Bp, int32_t* tile) {
+  __m256i acc00 = _mm256_setzero_si256(), acc01 = _mm256_setzero_si256();
+  __m256i acc10 = _mm256_setzero_si256(), acc11 = _mm256_setzero_si256();
+  __m256i acc20 = _mm256_setzero_si256(), acc21 = _mm256_setzero_si256();
+  __m256i acc30 = _mm256_setzero_si256(), acc31 = _mm256_setzero_si256();
+  __m256i acc40 = _mm256_setzero_si256(), acc41 = _mm256_setzero_si256();
+  __m256i acc50 = _mm256_setzero_si256(), acc51 = _mm256_setzero_si256();
+  for (int k = 0; k < Kp; k += 4, Bp += 64) {
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp));
+    const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Bp + 32));
+    CAFFE_GEMM_S8_VNNI_ROW(0)
+    CAFFE_GEMM_S8_VNNI_ROW(1)
+    CAFFE_GEMM_S8_VNNI_ROW(2)
+    CAFFE_GEMM_S8_VNNI_ROW(3)
+    CAFFE_GEMM_S8_VNNI_ROW(4)
+    CAFFE_GEMM_S8_VNNI_ROW(5)
+  }
+  __m256i* out = reinterpret_cast<__m256i*>(tile);
+  _mm256_storeu_si256(out + 0, acc00); _mm256_storeu_si256(out + 1, acc01);
+  _mm256_storeu_si256(out + 2, acc10); _mm256_storeu_si256(out + 3, acc11);
+  _mm256_storeu_si256(out + 4, acc20); _mm256_storeu_si256(out + 5, acc21);
+  _mm256_storeu_si256(out + 6, acc30); _mm256_storeu_si256(out + 7, acc31);
+  _mm256_storeu_si256(out + 8, acc40); _mm256_storeu_si256(out + 9, acc41);
+  _mm256_storeu_si256(out + 10, acc50); _mm256_storeu_si256(out + 11, acc51);
+}
+#undef CAFFE_GEMM_S8_VNNI_ROW
+#endif  // CAFFE_GEMM_S8_X86
+
+// Kernel computing a rows x kGemmS8NR int32 tile: rows of A (Kp each) by a
+// packed panel. B is packed with flip xor-ed in, the driver takes flip times
+// the row sums of A off.
+struct GemmS8Kernel {
+  const char* name;
+  int rows;
+  uint8_t flip;
+  void (*fn)(int Kp, const int8_t* A, const int8_t* Bp, int32_t* tile);
+};
+
+GemmS8Kernel select_gemm_s8_kernel() {
+#ifdef CAFFE_GEMM_S8_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) {
+    return GemmS8Kernel{"avx512-vnni", 6, 0x80, kernel_s8_vnni};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return GemmS8Kernel{"avx2", 4, 0, kernel_s8_avx2};
+  }
+#endif
+  return GemmS8Kernel{"generic", 0, 0, nullptr};
+}
+
+const GemmS8Kernel& gemm_s8_kernel() {
+  static const GemmS8Kernel kernel = select_gemm_s8_kernel();
+  return kernel;
+}
+
+}  // namespace
+
+const char* caffe_cpu_gemm_s8_kernel() {
+  return gemm_s8_kernel().name;
+}
+
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C) {
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  const bool trans_b = TransB == CblasTrans;
+  const GemmS8Kernel& kernel = gemm_s8_kernel();
+  if (kernel.fn == nullptr) {
+    caffe_cpu_parallel_for(M, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        const int8_t* a = A + static_cast<size_t>(i) * K;
+        int32_t* c = C + static_cast<size_t>(i) * N;
+        if (trans_b) {
+          for (int j = 0; j < N; ++j) {
+            const int8_t* b = B + static_cast<size_t>(j) * K;
+            int32_t sum = 0;
+            for (int k = 0; k < K; ++k) {
+              sum += static_cast<int16_t>(a[k]) * static_cast<int16_t>(b[k]);
+            }
+            c[j] = sum;
+          }
+          continue;
+        }
+        std::fill(c, c + N, 0);
+        for (int k = 0; k < K; ++k) {
+          const int8_t* b = B + static_cast<size_t>(k) * N;
+          const int16_t a_k = a[k];
+          for (int j = 0; j < N; ++j) {
+            c[j] += a_k * static_cast<int16_t>(b[j]);
+          }
+        }
+      }
+    }, 1);
+    return;
+  }
+  // Rows of A padded to groups of 4 k and to whole register tiles
+  const int Kp = round_up(std::max(K, 1), 4);
+  const int Mp = round_up(M, kernel.rows);
+  std::vector<int8_t> Ap(static_cast<size_t>(Mp) * Kp, 0);
+  std::vector<int32_t> offset(Mp, 0);
+  for (int i = 0; i < M; ++i) {
+    const int8_t* a = A + static_cast<size_t>(i) * K;
+    std::copy(a, a + K, Ap.begin() + static_cast<size_t>(i) * Kp);
+    if (kernel.flip) {
+      int32_t sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += a[k];
+      }
+      offset[i] = sum * kernel.flip;
+    }
+  }
+  const int tasks = (N + kGemmS8NC - 1) / kGemmS8NC;
+  caffe_cpu_parallel_for(tasks, [&](int begin, int end) {
+    // Reused by the thread for every call
+    static thread_local std::vector<int8_t> Bp;
+    Bp.resize(static_cast<size_t>(Kp) * kGemmS8NC);
+    int32_t tile[kGemmS8MaxRows * kGemmS8NR];
+    for (int t = begin; t < end; ++t) {
+      const int j0 = t * kGemmS8NC;
+      const int nc = std::min(kGemmS8NC, N - j0);
+      pack_b_s8(trans_b, N, K, Kp, B, j0, nc, kernel.flip, Bp.data());
+      for (int p = 0; p < nc; p += kGemmS8NR) {
+        const int8_t* panel = Bp.data() + static_cast<size_t>(p) * Kp;
+        const int cols = std::min(kGemmS8NR, nc - p);
+        for (int i0 = 0; i0 < M; i0 += kernel.rows) {
+          kernel.fn(Kp, Ap.data() + static_cast<size_t>(i0) * Kp, panel, tile);
+          const int rows = std::min(kernel.rows, M - i0);
+          for (int r = 0; r < rows; ++r) {
+            int32_t* c = C + static_cast<size_t>(i0 + r) * N + j0 + p;
+            const int32_t* t_r = tile + r * kGemmS8NR;
+            for (int j = 0; j < cols; ++j) {
+              c[j] = t_r[j] - offset[i0 + r];
+            }
+          }
+        }
+      }
+    }
+  }, 1);
+}
+
+template <typename Dtype>
+void QuantizedWeights::Update(int rows, int cols, const Dtype* weights, uint64_t version,
+    int iter, bool transposed) {
+  const size_t count = static_cast<size_t>(rows) * cols;
+  if (source_ == weights && version_ == version && iter_ == iter && data_.size() == count) {
+    return;
+  }
+  data_.resize(count);
+  scales_.resize(rows);
+  for (int r = 0; r < rows; ++r) {
+    float amax = 0.F;
+    for (int c = 0; c < cols; ++c) {
+      const size_t idx = transposed ? static_cast<size_t>(c) * rows + r
+                                    : static_cast<size_t>(r) * cols + c;
+      amax = std::max(amax, std::fabs(static_cast<float>(weights[idx])));
+    }
+    // All zero channel: any scale gives zeros
+    const float scale = amax > 0.F ? amax / 127.F : 1.F;
+    scales_[r] = scale;
+    for (int c = 0; c < cols; ++c) {
+      const size_t idx = transposed ? static_cast<size_t>(c) * rows + r
+                                    : static_cast<size_t>(r) * cols + c;
+      const float q = std::nearbyint(static_cast<float>(weights[idx]) / scale);
+      data_[static_cast<size_t>(r) * cols + c] =
+          static_cast<int8_t>(std::max(-127.F, std::min(127.F, q)));
+    }
+  }
+  source_ = weights;
+  version_ = version;
+  iter_ = iter;
+}
+
+template void QuantizedWeights::Update<float>(int rows, int cols, const float* weights,
+    uint64_t version, int iter, bool transposed);
+template void QuantizedWeights::Update<double>(int rows, int cols, const double* weights,
+    uint64_t version, int iter, bool transposed);
+#ifndef CPU_ONLY
+template void QuantizedWeights::Update<float16>(int rows, int cols, const float16* weights,
+    uint64_t version, int iter, bool transposed);
+#endif
+
+}  // namespace caffe
@@ -0,0 +1,75 @@
+#include <string>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+namespace caffe {
+
+SnapshotWriter::SnapshotWriter(int max_pending)
+    : max_pending_(max_pending), pending_(0), stop_(false) {
+  CHECK_GT(max_pending_, 0);
+  thread_ = boost::thread(&SnapshotWriter::Entry, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  queued_.notify_one();
+  thread_.join();
+}
+
+void SnapshotWriter::Write(const shared_ptr<google::protobuf::Message>& proto,
+    const string& filename) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (pending_ >= max_pending_) {
+      LOG(INFO) << "Waiting for " << pending_ << " snapshot file(s) to be written";
+      while (pending_ >= max_pending_) {
+        written_.wait(lock);
+      }
+    }
+    queue_.emplace_back(proto, filename);
+    ++pending_;
+  }
+  queued_.notify_one();
+}
+
+void SnapshotWriter::Wait() {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (pending_ > 0) {
+    written_.wait(lock);
+  }
+}
+
+void SnapshotWriter::Entry() {
+  while (true) {
+    std::pair<shared_ptr<google::protobuf::Message>, string> job;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (queue_.empty() && !stop_) {
+        queued_.wait(lock);
+      }
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    CPUTimer timer;
+    timer.Start();
+    WriteProtoToBinaryFileAtomic(*job.first, job.second);
+    LOG(INFO) << "Snapshot " << job.second << " written in " << timer.Seconds() << "s";
+    // Release the copy before waking up a blocked writer
+    job.first.reset();
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      --pending_;
+    }
+    written_.notify_all();
+  }
+}
+
+}  // namespace caffe
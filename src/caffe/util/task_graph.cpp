@@ -0,0 +1,107 @@
+#include "caffe/util/task_graph.hpp"
+
+namespace caffe {
+
+TaskGraph::TaskGraph(int threads)
+    : successors_(nullptr), fn_(nullptr), remaining_(0), busy_(0), generation_(0UL),
+      stop_(false) {
+  for (int i = 1; i < threads; ++i) {
+    workers_.emplace_back(&TaskGraph::WorkerLoop, this);
+  }
+}
+
+TaskGraph::~TaskGraph() {
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& t : workers_) {
+    t.join();
+  }
+}
+
+void TaskGraph::Run(const vector<vector<int>>& successors, const vector<bool>& active,
+    const std::function<void(int)>& fn) {
+  const int n = successors.size();
+  CHECK_EQ(active.size(), n);
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    successors_ = &successors;
+    fn_ = &fn;
+    pending_.assign(n, 0);
+    for (int t = 0; t < n; ++t) {
+      if (active[t]) {
+        for (int s : successors[t]) {
+          ++pending_[s];
+        }
+      }
+    }
+    ready_.clear();
+    remaining_ = 0;
+    for (int t = 0; t < n; ++t) {
+      if (active[t]) {
+        ++remaining_;
+        if (pending_[t] == 0) {
+          ready_.push_back(t);
+        }
+      }
+    }
+    busy_ = static_cast<int>(workers_.size());
+    ++generation_;
+  }
+  cv_.notify_all();
+  Work();
+  std::unique_lock<std::mutex> lock(m_);
+  done_cv_.wait(lock, [this] { return busy_ == 0; });
+  successors_ = nullptr;
+  fn_ = nullptr;
+}
+
+void TaskGraph::Work() {
+  std::unique_lock<std::mutex> lock(m_);
+  while (true) {
+    ready_cv_.wait(lock, [this] { return !ready_.empty() || remaining_ == 0; });
+    if (remaining_ == 0) {
+      break;
+    }
+    const int t = ready_.front();
+    ready_.pop_front();
+    lock.unlock();
+    (*fn_)(t);
+    lock.lock();
+    int released = 0;
+    for (int s : (*successors_)[t]) {
+      if (--pending_[s] == 0) {
+        ready_.push_back(s);
+        ++released;
+      }
+    }
+    // This thread takes the first released task itself
+    if (--remaining_ == 0 || released > 1) {
+      ready_cv_.notify_all();
+    }
+  }
+}
+
+void TaskGraph::WorkerLoop() {
+  uint64_t seen = 0UL;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      cv_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    Work();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      --busy_;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,370 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "caffe/util/transport.hpp"
+
+namespace caffe {
+
+Transport::Transport(int rank, int size) : rank_(rank), size_(size) {
+  CHECK_GT(size_, 0);
+  CHECK_GE(rank_, 0);
+  CHECK_LT(rank_, size_);
+}
+
+void Transport::SendRecv(const void* send_data, size_t send_bytes,
+    void* recv_data, size_t recv_bytes) {
+  // Every rank sends before it receives: a blocking send of more than the
+  // socket buffers would deadlock the ring, so it runs on its own thread.
+  std::thread sender([this, send_data, send_bytes] { SendNext(send_data, send_bytes); });
+  RecvPrev(recv_data, recv_bytes);
+  sender.join();
+}
+
+void Transport::Barrier() {
+  if (size_ == 1) {
+    return;
+  }
+  // Two laps of a token: after the first one rank 0 knows that everybody
+  // arrived, after the second one everybody knows it.
+  char token = 0;
+  for (int lap = 0; lap < 2; ++lap) {
+    if (rank_ == 0) {
+      SendNext(&token, 1UL);
+      RecvPrev(&token, 1UL);
+    } else {
+      RecvPrev(&token, 1UL);
+      SendNext(&token, 1UL);
+    }
+  }
+}
+
+void Transport::Broadcast(void* data, size_t bytes, int root) {
+  if (size_ == 1 || bytes == 0UL) {
+    return;
+  }
+  CHECK_GE(root, 0);
+  CHECK_LT(root, size_);
+  if (rank_ != root) {
+    RecvPrev(data, bytes);
+  }
+  if ((rank_ + 1) % size_ != root) {
+    SendNext(data, bytes);
+  }
+}
+
+void Transport::Allreduce(void* data, int count, Type type) {
+  if (size_ == 1 || count <= 0) {
+    return;
+  }
+  if (is_type<float>(type)) {
+    RingAllreduce(static_cast<float*>(data), count);
+#ifndef CPU_ONLY
+  } else if (is_type<float16>(type)) {
+    RingAllreduce(static_cast<float16*>(data), count);
+#endif
+  } else if (is_type<double>(type)) {
+    RingAllreduce(static_cast<double*>(data), count);
+  } else {
+    LOG(FATAL) << "Unsupported data type: " << Type_Name(type);
+  }
+}
+
+void Transport::Allgather(const void* send, size_t bytes, void* recv) {
+  char* blocks = static_cast<char*>(recv);
+  std::memcpy(blocks + rank_ * bytes, send, bytes);
+  // After step s rank r holds the blocks of ranks r - s - 1 ... r
+  for (int step = 0; step < size_ - 1; ++step) {
+    const int send_block = (rank_ - step + size_) % size_;
+    const int recv_block = (rank_ - step - 1 + size_) % size_;
+    SendRecv(blocks + send_block * bytes, bytes, blocks + recv_block * bytes, bytes);
+  }
+}
+
+template<typename Dtype>
+void Transport::RingAllreduce(Dtype* data, int count) {
+  typedef typename std::conditional<std::is_same<Dtype, double>::value,
+      double, float>::type Mtype;
+  const int slice = (count + size_ - 1) / size_;
+  auto begin = [slice, count](int chunk) { return std::min(count, chunk * slice); };
+  auto length = [slice, count, &begin](int chunk) {
+    return std::min(count, begin(chunk) + slice) - begin(chunk);
+  };
+  recv_buffer_.resize(slice * sizeof(Dtype));
+  Dtype* recv = reinterpret_cast<Dtype*>(recv_buffer_.data());
+
+  // Reduce-scatter: after size - 1 steps rank r holds the sum of chunk (r + 1) % size
+  for (int step = 0; step < size_ - 1; ++step) {
+    const int send_chunk = (rank_ - step + size_) % size_;
+    const int recv_chunk = (rank_ - step - 1 + size_) % size_;
+    SendRecv(data + begin(send_chunk), length(send_chunk) * sizeof(Dtype),
+        recv, length(recv_chunk) * sizeof(Dtype));
+    Dtype* dst = data + begin(recv_chunk);
+    for (int i = 0; i < length(recv_chunk); ++i) {
+      dst[i] = static_cast<Dtype>(static_cast<Mtype>(dst[i]) + static_cast<Mtype>(recv[i]));
+    }
+  }
+  // All-gather: pass the reduced chunks around the ring
+  for (int step = 0; step < size_ - 1; ++step) {
+    const int send_chunk = (rank_ - step + 1 + size_) % size_;
+    const int recv_chunk = (rank_ - step + size_) % size_;
+    SendRecv(data + begin(send_chunk), length(send_chunk) * sizeof(Dtype),
+        data + begin(recv_chunk), length(recv_chunk) * sizeof(Dtype));
+  }
+}
+
+namespace {
+
+void write_all(int fd, const void* data, size_t bytes) {
+  const char* ptr = static_cast<const char*>(data);
+  while (bytes > 0UL) {
+    const ssize_t n = send(fd, ptr, bytes, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Transport send failed: " << std::strerror(errno);
+    ptr += n;
+    bytes -= n;
+  }
+}
+
+void read_all(int fd, void* data, size_t bytes) {
+  char* ptr = static_cast<char*>(data);
+  while (bytes > 0UL) {
+    const ssize_t n = recv(fd, ptr, bytes, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Transport receive failed: "
+        << (n == 0 ? "connection closed by peer" : std::strerror(errno));
+    ptr += n;
+    bytes -= n;
+  }
+}
+
+}  // namespace
+
+SocketTransport::SocketTransport(const string& address, int rank, int size, int channel,
+    int timeout_sec)
+    : Transport(rank, size), unix_(false), port_(0), channel_(channel),
+      timeout_sec_(timeout_sec), next_fd_(-1), prev_fd_(-1) {
+  const string unix_prefix("unix://"), tcp_prefix("tcp://");
+  if (address.compare(0, unix_prefix.size(), unix_prefix) == 0) {
+    unix_ = true;
+    path_ = address.substr(unix_prefix.size());
+    CHECK(!path_.empty()) << "No socket path in " << address;
+  } else {
+    CHECK_EQ(address.compare(0, tcp_prefix.size(), tcp_prefix), 0)
+        << "Transport address must start with tcp:// or unix://, got " << address;
+    const string host_port = address.substr(tcp_prefix.size());
+    const size_t colon = host_port.rfind(':');
+    CHECK_NE(colon, string::npos) << "No port in " << address;
+    port_ = std::stoi(host_port.substr(colon + 1));
+    std::stringstream hosts(host_port.substr(0, colon));
+    string host;
+    while (std::getline(hosts, host, ',')) {
+      hosts_.push_back(host);
+    }
+    CHECK(hosts_.size() == 1UL || hosts_.size() == static_cast<size_t>(size_))
+        << "Give one host or one per rank in " << address;
+  }
+  if (size_ == 1) {
+    return;
+  }
+  const int listen_fd = Listen();
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_sec_);
+  next_fd_ = Connect((rank_ + 1) % size_);
+  // Bounded like Connect: the previous rank may never show up
+  pollfd listener;
+  listener.fd = listen_fd;
+  listener.events = POLLIN;
+  while (true) {
+    const int64_t left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    const int ready = poll(&listener, 1, static_cast<int>(std::max<int64_t>(left_ms, 0L)));
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GE(ready, 0) << "Transport poll failed: " << std::strerror(errno);
+    if (ready == 0) {
+      LOG(FATAL) << "Transport rank " << rank_ << " timed out after " << timeout_sec_
+          << "s waiting for rank " << (rank_ + size_ - 1) % size_ << " to connect on channel "
+          << channel_;
+    }
+    break;
+  }
+  prev_fd_ = accept(listen_fd, nullptr, nullptr);
+  CHECK_GE(prev_fd_, 0) << "Transport accept failed: " << std::strerror(errno);
+  close(listen_fd);
+  if (unix_) {
+    unlink((path_ + "." + std::to_string(channel_) + "." + std::to_string(rank_)).c_str());
+  } else {
+    int one = 1;
+    setsockopt(prev_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  int prev = -1;
+  read_all(prev_fd_, &prev, sizeof(prev));
+  CHECK_EQ(prev, (rank_ + size_ - 1) % size_) << "Unexpected peer on channel " << channel_;
+  LOG(INFO) << "Transport rank " << rank_ << " of " << size_ << " connected on channel "
+            << channel_;
+}
+
+SocketTransport::~SocketTransport() {
+  if (next_fd_ >= 0) {
+    close(next_fd_);
+  }
+  if (prev_fd_ >= 0) {
+    close(prev_fd_);
+  }
+}
+
+int SocketTransport::Listen() {
+  int fd = -1;
+  if (unix_) {
+    const string path = path_ + "." + std::to_string(channel_) + "." + std::to_string(rank_);
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    CHECK_LT(path.size(), sizeof(addr.sun_path)) << "Socket path too long: " << path;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "Transport socket failed: " << std::strerror(errno);
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+        << "Transport bind to " << path << " failed: " << std::strerror(errno);
+  } else {
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port_ + channel_ * size_ + rank_));
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "Transport socket failed: " << std::strerror(errno);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+        << "Transport bind to port " << ntohs(addr.sin_port) << " failed: "
+        << std::strerror(errno);
+  }
+  CHECK_EQ(listen(fd, 1), 0) << "Transport listen failed: " << std::strerror(errno);
+  return fd;
+}
+
+int SocketTransport::Connect(int peer) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_sec_);
+  while (true) {
+    int fd = -1;
+    bool connected = false;
+    if (unix_) {
+      const string path = path_ + "." + std::to_string(channel_) + "." + std::to_string(peer);
+      sockaddr_un addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      CHECK_GE(fd, 0) << "Transport socket failed: " << std::strerror(errno);
+      connected = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    } else {
+      const string& host = hosts_.size() == 1UL ? hosts_[0] : hosts_[peer];
+      const string port = std::to_string(port_ + channel_ * size_ + peer);
+      addrinfo hints, *res = nullptr;
+      std::memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0) {
+        fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        CHECK_GE(fd, 0) << "Transport socket failed: " << std::strerror(errno);
+        connected = connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+        freeaddrinfo(res);
+      }
+    }
+    if (connected) {
+      if (!unix_) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      }
+      write_all(fd, &rank_, sizeof(rank_));
+      return fd;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    CHECK(std::chrono::steady_clock::now() < deadline) << "Transport rank " << rank_
+        << " timed out connecting to rank " << peer << " on channel " << channel_;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
+void SocketTransport::SendRecv(const void* send_data, size_t send_bytes,
+    void* recv_data, size_t recv_bytes) {
+  // Both directions progress in one loop: sends never block, so a send of
+  // more than the socket buffers can't deadlock the ring
+  const char* send_ptr = static_cast<const char*>(send_data);
+  char* recv_ptr = static_cast<char*>(recv_data);
+  while (send_bytes > 0UL || recv_bytes > 0UL) {
+    pollfd fds[2];
+    int nfds = 0;
+    if (send_bytes > 0UL) {
+      fds[nfds].fd = next_fd_;
+      fds[nfds].events = POLLOUT;
+      ++nfds;
+    }
+    if (recv_bytes > 0UL) {
+      fds[nfds].fd = prev_fd_;
+      fds[nfds].events = POLLIN;
+      ++nfds;
+    }
+    const int ready = poll(fds, nfds, -1);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(ready, 0) << "Transport poll failed: " << std::strerror(errno);
+    for (int i = 0; i < nfds; ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if (fds[i].fd == next_fd_ && send_bytes > 0UL) {
+        const ssize_t n = send(next_fd_, send_ptr, send_bytes, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+          continue;
+        }
+        CHECK_GT(n, 0) << "Transport send failed: " << std::strerror(errno);
+        send_ptr += n;
+        send_bytes -= n;
+      } else if (fds[i].fd == prev_fd_ && recv_bytes > 0UL) {
+        const ssize_t n = recv(prev_fd_, recv_ptr, recv_bytes, MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+          continue;
+        }
+        CHECK_GT(n, 0) << "Transport receive failed: "
+            << (n == 0 ? "connection closed by peer" : std::strerror(errno));
+        recv_ptr += n;
+        recv_bytes -= n;
+      }
+    }
+  }
+}
+
+void SocketTransport::SendNext(const void* data, size_t bytes) {
+  write_all(next_fd_, data, bytes);
+}
+
+void SocketTransport::RecvPrev(void* data, size_t bytes) {
+  read_all(prev_fd_, data, bytes);
+}
+
+}  // namespace caffe
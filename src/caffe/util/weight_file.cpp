@@ -0,0 +1,161 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/weight_file.hpp"
+
+namespace caffe {
+
+static const char kWeightFileMagic[8] = {'C', 'A', 'F', 'F', 'E', 'W', 'T', 'S'};
+static const uint32_t kWeightFileVersion = 1U;
+
+WeightFileWriter::WeightFileWriter(const string& filename)
+    : filename_(filename), tmp_filename_(filename + ".tmp"), offset_(0ULL) {
+  fd_ = open(tmp_filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd_, -1) << "Cannot create " << tmp_filename_ << ": " << std::strerror(errno);
+  // The header is rewritten on Close
+  WeightFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  WriteBytes(&header, sizeof(header));
+  Pad();
+}
+
+WeightFileWriter::~WeightFileWriter() {
+  if (fd_ != -1) {
+    // Not closed: drop the partial file
+    close(fd_);
+    std::remove(tmp_filename_.c_str());
+  }
+}
+
+void WeightFileWriter::WriteBytes(const void* data, size_t bytes) {
+  const char* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    ssize_t n = write(fd_, p, bytes);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Cannot write " << tmp_filename_ << ": " << std::strerror(errno);
+    p += n;
+    bytes -= n;
+    offset_ += n;
+  }
+}
+
+void WeightFileWriter::Pad() {
+  static const char zeros[kWeightFileAlignment] = {};
+  const size_t rem = offset_ % kWeightFileAlignment;
+  if (rem > 0) {
+    WriteBytes(zeros, kWeightFileAlignment - rem);
+  }
+}
+
+void WeightFileWriter::Add(const string& layer, const string& layer_type, int blob_id,
+    Blob* blob) {
+  CHECK_NE(fd_, -1) << "Weight file " << filename_ << " is closed";
+  const Type type = blob->data_type();
+  const size_t bytes = blob->count() * tsize(type);
+  WeightFileIndex::Entry* entry = index_.add_entry();
+  entry->set_layer(layer);
+  entry->set_layer_type(layer_type);
+  entry->set_blob(blob_id);
+  for (int d : blob->shape()) {
+    entry->mutable_shape()->add_dim(d);
+  }
+  entry->set_type(type);
+  entry->set_offset(offset_);
+  entry->set_bytes(bytes);
+  if (bytes == 0UL) {
+    return;
+  }
+  WriteBytes(blob->current_data_memory(false), bytes);
+  // Blobs hold an even number of elements: keep the odd one's pair in the file
+  // so that tensors can be used in place
+  if (!is_even(blob->count())) {
+    static const char zeros[8] = {};
+    WriteBytes(zeros, tsize(type));
+  }
+  Pad();
+}
+
+void WeightFileWriter::Close() {
+  CHECK_NE(fd_, -1) << "Weight file " << filename_ << " is closed";
+  string index;
+  CHECK(index_.SerializeToString(&index));
+  WeightFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kWeightFileMagic, sizeof(header.magic));
+  header.version = kWeightFileVersion;
+  header.alignment = kWeightFileAlignment;
+  header.index_offset = offset_;
+  header.index_bytes = index.size();
+  WriteBytes(index.data(), index.size());
+  CHECK_EQ(pwrite(fd_, &header, sizeof(header), 0), static_cast<ssize_t>(sizeof(header)))
+      << "Cannot write " << tmp_filename_ << ": " << std::strerror(errno);
+  CHECK_EQ(fsync(fd_), 0) << "Cannot sync " << tmp_filename_ << ": " << std::strerror(errno);
+  CHECK_EQ(close(fd_), 0);
+  fd_ = -1;
+  CHECK_EQ(std::rename(tmp_filename_.c_str(), filename_.c_str()), 0)
+      << "Cannot rename " << tmp_filename_ << ": " << std::strerror(errno);
+  LOG(INFO) << "Wrote " << index_.entry_size() << " tensors (" << offset_
+            << " bytes) to " << filename_;
+}
+
+bool WeightFile::Check(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  char magic[sizeof(kWeightFileMagic)];
+  const bool ret = read(fd, magic, sizeof(magic)) == static_cast<ssize_t>(sizeof(magic)) &&
+      std::memcmp(magic, kWeightFileMagic, sizeof(magic)) == 0;
+  close(fd);
+  return ret;
+}
+
+WeightFile::WeightFile(const string& filename)
+    : filename_(filename), map_(nullptr), size_(0UL) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Cannot stat " << filename << ": " << std::strerror(errno);
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(WeightFileHeader)) << filename << " is not a weight file";
+  map_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  CHECK(map_ != MAP_FAILED) << "Cannot map " << filename << ": " << std::strerror(errno);
+  close(fd);
+
+  const WeightFileHeader* header = static_cast<const WeightFileHeader*>(map_);
+  CHECK_EQ(std::memcmp(header->magic, kWeightFileMagic, sizeof(header->magic)), 0)
+      << filename << " is not a weight file";
+  CHECK_EQ(header->version, kWeightFileVersion) << "Unsupported version of " << filename;
+  CHECK_LE(header->index_offset + header->index_bytes, size_) << filename << " is truncated";
+  CHECK_LT(header->index_bytes, static_cast<uint64_t>(INT_MAX));
+  CHECK(index_.ParseFromArray(static_cast<const char*>(map_) + header->index_offset,
+      static_cast<int>(header->index_bytes))) << "Corrupted index in " << filename;
+  for (const WeightFileIndex::Entry& entry : index_.entry()) {
+    size_t count = 1UL;
+    for (int64_t d : entry.shape().dim()) {
+      count *= d;
+    }
+    CHECK_EQ(entry.bytes(), count * tsize(entry.type()))
+        << "Corrupted tensor " << entry.layer() << "/" << entry.blob() << " in " << filename;
+    CHECK_EQ(entry.offset() % header->alignment, 0UL);
+    CHECK_LE(entry.offset() + even(count) * tsize(entry.type()), header->index_offset)
+        << "Corrupted tensor " << entry.layer() << "/" << entry.blob() << " in " << filename;
+  }
+}
+
+WeightFile::~WeightFile() {
+  munmap(map_, size_);
+}
+
+}  // namespace caffe
@@ -5,10 +5,14 @@ namespace bp = boost::python;
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <algorithm>
 #include <map>
 #include <boost/algorithm/string.hpp>
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/host_memory.hpp"
+#include "caffe/util/parallel_for.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/signal_handler.h"
 
 
@@ -45,6 +49,35 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_int32(cpu_threads, 0,
+    "Optional; the number of threads used by multi-threaded CPU kernels. "
+    "Defaults to the number of hardware threads.");
+DEFINE_int32(cpu_solvers, 1,
+    "Optional; in CPU mode, the number of solver replicas trained data-parallel "
+    "on disjoint core groups. The batch size is split among them.");
+DEFINE_string(dist_address, "",
+    "Optional; in CPU mode, train data-parallel with -dist_size processes "
+    "connected at tcp://host[,host...]:port or unix:///path.");
+DEFINE_int32(dist_rank, 0,
+    "Optional; the rank of this process in distributed training.");
+DEFINE_int32(dist_size, 1,
+    "Optional; the number of processes in distributed training.");
+DEFINE_double(peak_gflops, 0.,
+    "Optional; peak GFLOP/s of the target for the roofline estimate of 'cost'.");
+DEFINE_double(peak_gbps, 0.,
+    "Optional; peak memory bandwidth in GB/s of the target for the roofline "
+    "estimate of 'cost'.");
+DEFINE_string(phase, "TEST",
+    "Optional; the network phase (TRAIN or TEST) 'cost' builds the model in. "
+    "Backward is only estimated in TRAIN.");
+DEFINE_string(profile, "",
+    "Optional; record layer, data and update timings of the run and write "
+    "them to this file as a Chrome trace (chrome://tracing).");
+DEFINE_int32(profile_events, 65536,
+    "Optional; the number of most recent events kept by --profile.");
+DEFINE_string(output, "",
+    "Optional; the model definition 'calibrate' writes with int8 quantization "
+    "parameters. Defaults to the model with suffix .int8.prototxt.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -183,6 +216,17 @@ int train() {
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    if (FLAGS_cpu_solvers > 1) {
+      Caffe::set_solver_count(FLAGS_cpu_solvers);
+      LOG(INFO) << "Using " << FLAGS_cpu_solvers << " CPU solvers";
+    }
+    if (FLAGS_dist_size > 1) {
+      CHECK(!FLAGS_dist_address.empty()) << "Distributed training needs -dist_address";
+      CHECK_EQ(FLAGS_cpu_solvers, 1) << "Use either -cpu_solvers or -dist_size";
+      Caffe::set_solver_count(FLAGS_dist_size);
+      LOG(INFO) << "Using rank " << FLAGS_dist_rank << " of " << FLAGS_dist_size
+                << " processes at " << FLAGS_dist_address;
+    }
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -209,7 +253,9 @@ int train() {
         GetRequestedAction(FLAGS_sigint_effect),
         GetRequestedAction(FLAGS_sighup_effect));
 
-  shared_ptr<caffe::Solver> solver(caffe::SolverRegistry::CreateSolver(solver_param));
+  const bool distributed = gpus.size() == 0 && FLAGS_dist_size > 1;
+  shared_ptr<caffe::Solver> solver(caffe::SolverRegistry::CreateSolver(solver_param,
+      distributed ? FLAGS_dist_rank : 0));
   solver->SetActionFunction(signal_handler.GetActionFunction());
 
   if (FLAGS_snapshot.size()) {
@@ -222,6 +268,16 @@ int train() {
   if (gpus.size() > 1) {
     caffe::P2PManager p2p_mgr(solver, gpus.size(), solver->param());
     p2p_mgr.Run(gpus);
+  } else if (gpus.size() == 0 && FLAGS_cpu_solvers > 1) {
+    caffe::CPUSyncManager cpu_mgr(solver, FLAGS_cpu_solvers, solver->param());
+    cpu_mgr.Run();
+  } else if (distributed) {
+    shared_ptr<caffe::Transport> comm = caffe::make_shared<caffe::SocketTransport>(
+        FLAGS_dist_address, FLAGS_dist_rank, FLAGS_dist_size, 0);
+    shared_ptr<caffe::Transport> reduce_comm = caffe::make_shared<caffe::SocketTransport>(
+        FLAGS_dist_address, FLAGS_dist_rank, FLAGS_dist_size, 1);
+    caffe::DistSync dist_sync(solver, comm, reduce_comm);
+    dist_sync.Run();
   } else {
     LOG(INFO) << "Starting Optimization";
 
@@ -235,6 +291,7 @@ int train() {
     }
   }
   LOG(INFO) << "Optimization Done in " << Caffe::time_from_init();
+  LOG(INFO) << caffe::HostMemory::report();
   return 0;
 }
 RegisterBrewFunction(train);
@@ -443,6 +500,137 @@ int time() {
 }
 RegisterBrewFunction(time);
 
+// Cost: static FLOP and memory traffic estimates of a model.
+int cost() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to estimate.";
+  Caffe::set_mode(Caffe::CPU);
+  caffe::Phase phase;
+  CHECK(caffe::Phase_Parse(FLAGS_phase, &phase))
+      << "Invalid phase '" << FLAGS_phase << "', use TRAIN or TEST";
+  Net caffe_net(FLAGS_model, phase);
+  const bool roofline = FLAGS_peak_gflops > 0. && FLAGS_peak_gbps > 0.;
+  // Time a layer takes when it runs at the roof: the slower of compute and memory
+  auto roof_ms = [](double flops, double bytes) {
+    return std::max(flops / FLAGS_peak_gflops, bytes / FLAGS_peak_gbps) * 1e-6;
+  };
+  const Net::Cost total = caffe_net.total_cost();
+  const double total_ms = roof_ms(total.forward_flops + total.backward_flops,
+      total.forward_bytes + total.backward_bytes);
+  ostringstream header;
+  header << std::left << std::setw(20) << "layer" << std::setw(16) << "type" << std::right
+         << std::setw(12) << "fwd MFLOP" << std::setw(12) << "bwd MFLOP"
+         << std::setw(10) << "fwd MB" << std::setw(10) << "bwd MB" << std::setw(10) << "FLOP/B";
+  if (roofline) {
+    header << std::setw(10) << "bound" << std::setw(10) << "est ms" << std::setw(8) << "%";
+  }
+  LOG(INFO) << header.str();
+  for (int i = 0; i < caffe_net.layers().size(); ++i) {
+    const Net::Cost c = caffe_net.layer_cost(i);
+    const double flops = c.forward_flops + c.backward_flops;
+    const double bytes = c.forward_bytes + c.backward_bytes;
+    ostringstream row;
+    row << std::fixed << std::setprecision(2) << std::left << std::setw(20)
+        << caffe_net.layer_names()[i] << std::setw(16) << caffe_net.layers()[i]->type()
+        << std::right << std::setw(12) << c.forward_flops * 1e-6
+        << std::setw(12) << c.backward_flops * 1e-6 << std::setw(10) << c.forward_bytes * 1e-6
+        << std::setw(10) << c.backward_bytes * 1e-6
+        << std::setw(10) << (bytes > 0. ? flops / bytes : 0.);
+    if (roofline) {
+      const double ms = roof_ms(flops, bytes);
+      row << std::setw(10)
+          << (flops / FLAGS_peak_gflops >= bytes / FLAGS_peak_gbps ? "compute" : "memory")
+          << std::setw(10) << ms << std::setw(8) << (total_ms > 0. ? 100. * ms / total_ms : 0.);
+    }
+    LOG(INFO) << row.str();
+  }
+  LOG(INFO) << "Forward: " << total.forward_flops * 1e-9 << " GFLOP, "
+            << total.forward_bytes * 1e-6 << " MB moved";
+  LOG(INFO) << "Backward: " << total.backward_flops * 1e-9 << " GFLOP, "
+            << total.backward_bytes * 1e-6 << " MB moved";
+  LOG(INFO) << "Parameter memory: " << caffe_net.param_bytes() * 1e-6 << " MB";
+  LOG(INFO) << "Activation memory: " << caffe_net.activation_bytes() * 1e-6 << " MB";
+  if (roofline) {
+    LOG(INFO) << "Ridge point: " << FLAGS_peak_gflops / FLAGS_peak_gbps
+              << " FLOP/B, estimated Forward-Backward: " << total_ms << " ms";
+  }
+  return 0;
+}
+RegisterBrewFunction(cost);
+
+// Calibrate: collect activation ranges of a model on representative batches
+// and write it with int8 quantization parameters for CPU inference.
+int calibrate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+
+  caffe::NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  // Ranges are collected on the model running in its own types
+  caffe::NetParameter float_param(net_param);
+  for (int i = 0; i < float_param.layer_size(); ++i) {
+    float_param.mutable_layer(i)->clear_quantization_param();
+  }
+  float_param.mutable_state()->set_phase(caffe::TEST);
+  Net caffe_net(float_param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  const vector<shared_ptr<LayerBase> >& layers = caffe_net.layers();
+  const vector<vector<Blob*> >& bottom_vecs = caffe_net.bottom_vecs();
+  std::map<string, float> amax;
+  for (int i = 0; i < layers.size(); ++i) {
+    const string type = layers[i]->type();
+    if (type == "Convolution" || type == "InnerProduct") {
+      amax[caffe_net.layer_names()[i]] = 0.F;
+    }
+  }
+  LOG(INFO) << "Calibrating " << amax.size() << " layers on " << FLAGS_iterations
+            << " batches.";
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    // Layer by layer, bottoms may share memory with later tops
+    for (int i = 0; i < layers.size(); ++i) {
+      auto it = amax.find(caffe_net.layer_names()[i]);
+      if (it != amax.end()) {
+        // One input scale serves all bottoms
+        for (Blob* bottom : bottom_vecs[i]) {
+          it->second = std::max(it->second, bottom->amax_data());
+        }
+      }
+      caffe_net.ForwardFromTo(i, i);
+    }
+  }
+
+  int quantized = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    caffe::LayerParameter* layer_param = net_param.mutable_layer(i);
+    auto it = amax.find(layer_param->name());
+    if (it == amax.end()) {
+      continue;
+    }
+    if (it->second > 0.F) {
+      layer_param->mutable_quantization_param()->set_input_scale(it->second / 127.F);
+      ++quantized;
+    } else {
+      LOG(WARNING) << "Layer " << it->first << " saw only zero inputs, left unquantized";
+      layer_param->clear_quantization_param();
+    }
+    LOG(INFO) << std::left << std::setw(20) << it->first << " input range " << it->second;
+  }
+  string output = FLAGS_output;
+  if (output.empty()) {
+    output = FLAGS_model;
+    if (boost::algorithm::ends_with(output, ".prototxt")) {
+      output.resize(output.size() - 9);
+    }
+    output += ".int8.prototxt";
+  }
+  caffe::WriteProtoToTextFile(net_param, output);
+  LOG(INFO) << "Wrote " << quantized << " int8 layers to " << output;
+  return 0;
+}
+RegisterBrewFunction(calibrate);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -455,9 +643,12 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  cost            estimate model FLOPs and memory traffic\n"
+      "  calibrate       write a model with int8 quantization parameters");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  caffe::caffe_set_cpu_threads(FLAGS_cpu_threads);
 
   vector<int> gpus;
   get_gpus(&gpus);
@@ -480,7 +671,18 @@ int main(int argc, char** argv) {
 #ifdef WITH_PYTHON_LAYER
     try {
 #endif
-      return GetBrewFunction(caffe::string(argv[1]))();
+      BrewFunction brew = GetBrewFunction(caffe::string(argv[1]));
+      caffe::Profiler& profiler = caffe::Profiler::Get();
+      if (!FLAGS_profile.empty()) {
+        profiler.Start(FLAGS_profile_events);
+      }
+      const int ret = brew();
+      if (!FLAGS_profile.empty()) {
+        profiler.Stop();
+        profiler.WriteChromeTrace(FLAGS_profile);
+        LOG(INFO) << "Profile written to " << FLAGS_profile << "\n" << profiler.Summary();
+      }
+      return ret;
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
       PyErr_Print();
@@ -0,0 +1,72 @@
+// This program converts trained weights between binary proto (.caffemodel)
+// and memory mappable weight files (see caffe/util/weight_file.hpp). The
+// direction is given by the input: a weight file is converted to a binary
+// proto, anything else is read as a binary proto.
+// Usage:
+//    convert_weights weights_in weights_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_file.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+static void WeightFileToBinaryProto(const string& input, const string& output) {
+  WeightFile file(input);
+  NetParameter net_param;
+  for (const WeightFileIndex::Entry& entry : file.index().entry()) {
+    if (net_param.layer_size() == 0 ||
+        net_param.layer(net_param.layer_size() - 1).name() != entry.layer()) {
+      LayerParameter* layer = net_param.add_layer();
+      layer->set_name(entry.layer());
+      layer->set_type(entry.layer_type());
+    }
+    LayerParameter* layer = net_param.mutable_layer(net_param.layer_size() - 1);
+    CHECK_EQ(entry.blob(), layer->blobs_size()) << "Blob " << layer->blobs_size()
+        << " of layer " << entry.layer() << " is shared with another layer and "
+        << "not stored in " << input;
+    BlobProto* blob = layer->add_blobs();
+    *blob->mutable_shape() = entry.shape();
+    blob->set_raw_data_type(entry.type());
+    blob->set_raw_data(file.data(entry), entry.bytes());
+  }
+  WriteProtoToBinaryFile(net_param, output);
+}
+
+static void BinaryProtoToWeightFile(const string& input, const string& output) {
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(input, &net_param);
+  WeightFileWriter writer(output);
+  for (const LayerParameter& layer : net_param.layer()) {
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& proto = layer.blobs(j);
+      Type type = proto.has_raw_data() ? proto.raw_data_type() :
+          proto.double_data_size() > 0 ? DOUBLE : FLOAT;
+      shared_ptr<Blob> blob = Blob::create(type, type);
+      blob->FromProto(proto);
+      writer.Add(layer.name(), layer.type(), j, blob.get());
+    }
+  }
+  writer.Close();
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_weights weights_in weights_out";
+    return 1;
+  }
+  const string input(argv[1]), output(argv[2]);
+  if (WeightFile::Check(input)) {
+    WeightFileToBinaryProto(input, output);
+    LOG(INFO) << "Wrote binary proto weights to " << output;
+  } else {
+    BinaryProtoToWeightFile(input, output);
+    LOG(INFO) << "Wrote weight file " << output;
+  }
+  return 0;
+}
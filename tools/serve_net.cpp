@@ -0,0 +1,163 @@
+// Serves a trained net over a Unix domain socket with dynamic batching.
+//
+// Every request is a message of one sample: a uint32 count of floats
+// followed by that many floats, the inputs of the net (batch dimension 1)
+// concatenated in input order. The answer is a message of the same kind
+// holding the net's outputs for that sample, concatenated in output order.
+// A connection sends any number of requests, one answer follows each.
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include <glog/logging.h>
+
+#include "caffe/batching_server.hpp"
+#include "caffe/caffe.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "", "The model definition protocol buffer text file.");
+DEFINE_string(weights, "", "The trained weights.");
+DEFINE_string(socket, "/tmp/caffe.sock", "Path of the Unix domain socket to listen on.");
+DEFINE_int32(max_batch, 8, "Maximum number of requests run as one batch.");
+DEFINE_int32(max_latency_us, 2000,
+    "Maximum time in microseconds a request waits for its batch to fill.");
+DEFINE_int32(workers, 1, "Number of batches run concurrently, 0 for one per hardware thread.");
+
+static bool ReadAll(int fd, void* buffer, size_t size) {
+  char* p = static_cast<char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// A client going away mid-response only ends its own connection: send does
+// not raise SIGPIPE, and EPIPE/ECONNRESET are not reported as errors
+static bool WriteAll(int fd, const void* buffer, size_t size) {
+  const char* p = static_cast<const char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      LOG_IF(ERROR, n < 0 && errno != EPIPE && errno != ECONNRESET)
+          << "send: " << std::strerror(errno);
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void Serve(int fd, BatchingServer* server, const vector<vector<int>>* input_shapes,
+    int num_outputs) {
+  vector<shared_ptr<Blob>> inputs, outputs;
+  vector<Blob*> input_ptrs, output_ptrs;
+  uint32_t sample_count = 0U;
+  for (const vector<int>& shape : *input_shapes) {
+    inputs.push_back(Blob::create<float>(shape));
+    input_ptrs.push_back(inputs.back().get());
+    sample_count += inputs.back()->count();
+  }
+  for (int j = 0; j < num_outputs; ++j) {
+    outputs.push_back(Blob::create<float>());
+    output_ptrs.push_back(outputs.back().get());
+  }
+  vector<float> message;
+  uint32_t count;
+  while (ReadAll(fd, &count, sizeof(count))) {
+    if (count != sample_count) {
+      LOG(ERROR) << "Expected " << sample_count << " floats, got " << count;
+      break;
+    }
+    message.resize(count);
+    if (!ReadAll(fd, message.data(), count * sizeof(float))) {
+      break;
+    }
+    const float* src = message.data();
+    for (shared_ptr<Blob>& input : inputs) {
+      std::memcpy(input->mutable_cpu_data<float>(), src, input->count() * sizeof(float));
+      src += input->count();
+    }
+    server->Infer(input_ptrs, output_ptrs);
+    message.clear();
+    for (shared_ptr<Blob>& output : outputs) {
+      const float* data = output->cpu_data<float>();
+      message.insert(message.end(), data, data + output->count());
+    }
+    count = message.size();
+    if (!WriteAll(fd, &count, sizeof(count))
+        || !WriteAll(fd, message.data(), count * sizeof(float))) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Serve a trained net over a Unix domain socket\n"
+      "Usage:\n"
+      "    serve_net --model=deploy.prototxt --weights=net.caffemodel "
+      "[--socket=/tmp/caffe.sock]\n");
+  GlobalInit(&argc, &argv);
+  CHECK(!FLAGS_model.empty()) << "Need a model definition to serve.";
+  CHECK(!FLAGS_weights.empty()) << "Need model weights to serve.";
+  Caffe::set_mode(Caffe::CPU);
+  // Writes to disconnected clients must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  shared_ptr<Net> net(new Net(FLAGS_model, TEST));
+  net->CopyTrainedLayersFrom(FLAGS_weights);
+  // Sample shapes are taken before the server starts reshaping the net
+  vector<vector<int>> input_shapes;
+  for (const Blob* input : net->input_blobs()) {
+    input_shapes.push_back(input->shape());
+    input_shapes.back()[0] = 1;
+  }
+  const int num_outputs = net->num_outputs();
+  BatchingServer server(net, FLAGS_max_batch, FLAGS_max_latency_us, FLAGS_workers);
+
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(listener, 0) << "socket: " << std::strerror(errno);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CHECK_LT(FLAGS_socket.size(), sizeof(address.sun_path)) << "Socket path too long";
+  std::strncpy(address.sun_path, FLAGS_socket.c_str(), sizeof(address.sun_path) - 1);
+  unlink(FLAGS_socket.c_str());
+  CHECK_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0)
+      << "bind " << FLAGS_socket << ": " << std::strerror(errno);
+  CHECK_EQ(listen(listener, SOMAXCONN), 0) << "listen: " << std::strerror(errno);
+  LOG(INFO) << "Serving " << FLAGS_model << " on " << FLAGS_socket;
+  while (true) {
+    const int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      LOG(ERROR) << "accept: " << std::strerror(errno);
+      continue;
+    }
+    std::thread(Serve, fd, &server, &input_shapes, num_outputs).detach();
+  }
+  return 0;
+}